@@ -65,4 +65,169 @@ ast_cat (struct ast *l, struct ast *r)
     }
 }
 
+/** 
+ * Make the statement that assigns @c value to @c var.
+ * 
+ * @param var The variable or other lvalue to store to.
+ * @param value The value to store.
+ * 
+ * @return The assignment, with its value thrown away.
+ */
+static inline struct ast *
+make_assign (struct ast *var, struct ast *value)
+{
+  struct ast *t = make_binary ('=', var, value);
+  t->throw_away = 1;
+  return t;
+}
+
+/** 
+ * Test if evaluating the expression @c s could change the state of
+ * the program.
+ * 
+ * @param s The expression to check.
+ * 
+ * @return true if @c s has side effects, false otherwise.
+ */
+static inline int
+ast_has_side_effects (const struct ast *s)
+{
+  if (s == NULL)
+    return 0;
+  switch (s->type)
+    {
+    case function_call_type:
+    case alloc_type:
+      return 1;
+
+    case binary_type:
+      if (s->op.binary.op == '=')
+	return 1;
+      break;
+
+    case unary_type:
+      switch (s->op.unary.op)
+	{
+	case '*':
+	case '&':
+	case '-':
+	case '~':
+	  break;
+	default:
+	  return 1;
+	}
+      break;
+
+    default:
+      break;
+    }
+  int i;
+  for (i = 0; i < s->num_ops; i++)
+    if (ast_has_side_effects (s->ops[i]))
+      return 1;
+  return 0;
+}
+
+/** 
+ * Test if evaluating the expression @c s can trap.
+ * 
+ * @param s The expression to check.
+ * 
+ * @return true if @c s divides or reads through a pointer, false
+ * otherwise.
+ */
+static inline int
+ast_can_trap (const struct ast *s)
+{
+  if (s == NULL)
+    return 0;
+  switch (s->type)
+    {
+    case binary_type:
+      if (s->op.binary.op == '/' || s->op.binary.op == '%'
+	  || s->op.binary.op == '[')
+	return 1;
+      break;
+
+    case unary_type:
+      if (s->op.unary.op == '*')
+	return 1;
+      break;
+
+    default:
+      break;
+    }
+  int i;
+  for (i = 0; i < s->num_ops; i++)
+    if (ast_can_trap (s->ops[i]))
+      return 1;
+  return 0;
+}
+
+/** 
+ * Estimate the cost of evaluating the expression @c s, where a read
+ * of a variable costs one.
+ * 
+ * @param s The expression.
+ * 
+ * @return The cost.
+ */
+static inline int
+ast_cost (const struct ast *s)
+{
+  if (s == NULL)
+    return 0;
+  switch (s->type)
+    {
+    case variable_type:
+      return 1;
+
+    case binary_type:
+      switch (s->op.binary.op)
+	{
+	case '[':
+	  return 2 + ast_cost (s->ops[0]) + ast_cost (s->ops[1]);
+	case '*':
+	  return 3 + ast_cost (s->ops[0]) + ast_cost (s->ops[1]);
+	case '/':
+	case '%':
+	  return 8 + ast_cost (s->ops[0]) + ast_cost (s->ops[1]);
+	default:
+	  return 1 + ast_cost (s->ops[0]) + ast_cost (s->ops[1]);
+	}
+
+    case unary_type:
+      return (s->op.unary.op == '*' ? 2 : 1) + ast_cost (s->ops[0]);
+
+    default:
+      return 0;
+    }
+}
+
+/** 
+ * Get the name of the label that a label, jump or cond refers to.
+ * 
+ * @param s The control flow AST.
+ * 
+ * @return The name of the label, or NULL if @c s is not a control
+ * flow AST.
+ */
+static inline const char *
+ast_label_name (const struct ast *s)
+{
+  if (s->loc != NULL)
+    return s->loc->base;
+  switch (s->type)
+    {
+    case label_type:
+      return s->op.label.name;
+    case jump_type:
+      return s->op.jump.name;
+    case cond_type:
+      return s->op.cond.name;
+    default:
+      return NULL;
+    }
+}
+
 #endif
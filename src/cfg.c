@@ -0,0 +1,492 @@
+/**
+ * @file   cfg.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This is the pass that simplifies the control flow graph.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The body of each function is flattened into a single list of
+ * statements, which is split into basic blocks at every label and
+ * after every jump, cond and ret.  The blocks that can't be reached
+ * from the entry are deleted.  Branches are threaded straight to
+ * where they end up, through blocks that contain nothing but labels
+ * or a jump, and a cond that only skips over a jump takes over that
+ * jump with its test inverted.  Labels that nothing branches to are
+ * deleted and so are branches to the statement that follows them
+ * anyway.  This repeats until nothing changes.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "loc.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * A basic block of statements.
+ *
+ */
+struct cfg_block
+{
+  size_t first;			/**< Index of the first statement. */
+  size_t count;			/**< Number of statements. */
+  int succ[2];			/**< The fall through and branch
+				   successors, -1 if there is none. */
+  int reachable;		/**< Whether the entry reaches this
+				   block. */
+};
+
+/**
+ * A label and the block that it starts.
+ *
+ */
+struct cfg_label
+{
+  const char *name;		/**< The name of the label. */
+  size_t stmt;			/**< The label statement. */
+  int block;			/**< The block it is in. */
+  int refs;			/**< Number of branches to it. */
+};
+
+static struct ast ***links = NULL; /**< The link to each statement. */
+static size_t nstmts = 0;	/**< Number of statements. */
+static size_t astmts = 0;	/**< Allocated statements. */
+static char *dead = NULL;	/**< Which statements to delete. */
+static struct cfg_block *blocks = NULL; /**< The basic blocks. */
+static size_t nblocks = 0;	/**< Number of blocks. */
+static size_t ablocks = 0;	/**< Allocated blocks. */
+static struct cfg_label *labels = NULL; /**< The labels, sorted by
+					   name. */
+static size_t nlabels = 0;	/**< Number of labels. */
+static size_t alabels = 0;	/**< Allocated labels. */
+
+/**
+ * Get statement number @c N.
+ *
+ */
+#define STMT(N) (*links[N])
+
+/**
+ * Get the last statement of block @c B.
+ *
+ */
+#define LAST_STMT(B) STMT (blocks[B].first + blocks[B].count - 1)
+
+/**
+ * Splice the contents of every nested block into the statement list
+ * @c ss.  The scopes of the variables have already been resolved by
+ * dealias, so the blocks mean nothing any more.
+ *
+ */
+static void
+flatten (struct ast **ss)
+{
+  while (*ss != NULL)
+    {
+      struct ast *t = *ss;
+      if (t->type == block_type)
+	{
+	  *ss = ast_cat (t->ops[0], t->next);
+	  t->ops[0] = NULL;
+	  t->next = NULL;
+	  AST_FREE (t);
+	}
+      else
+	ss = &t->next;
+    }
+}
+
+static int
+compare_label (const void *a, const void *b)
+{
+  return strcmp (((const struct cfg_label *) a)->name,
+		 ((const struct cfg_label *) b)->name);
+}
+
+/**
+ * Find the label that the control flow AST @c s refers to.
+ *
+ * @return The label or NULL if it doesn't exist.
+ */
+static struct cfg_label *
+find_label (const struct ast *s)
+{
+  struct cfg_label key = { ast_label_name (s), 0, 0, 0 };
+  return bsearch (&key, labels, nlabels, sizeof *labels, compare_label);
+}
+
+/**
+ * Test if the statement @c s ends a basic block.
+ *
+ */
+static int
+ends_block (const struct ast *s)
+{
+  return (s->type == jump_type || s->type == cond_type
+	  || s->type == ret_type);
+}
+
+/**
+ * Split the statements of @c body into basic blocks and link them up.
+ *
+ */
+static void
+build_cfg (struct ast *body)
+{
+  struct ast **link;
+  size_t i;
+  nstmts = nblocks = nlabels = 0;
+  for (link = &body->ops[0]; *link != NULL; link = &(*link)->next)
+    {
+      if (nstmts == astmts)
+	links = x2nrealloc (links, &astmts, sizeof *links);
+      links[nstmts++] = link;
+    }
+  dead = xzalloc (nstmts + 1);
+
+  for (i = 0; i < nstmts; i++)
+    {
+      if (i == 0 || STMT (i)->type == label_type || ends_block (STMT (i - 1)))
+	{
+	  if (nblocks == ablocks)
+	    blocks = x2nrealloc (blocks, &ablocks, sizeof *blocks);
+	  blocks[nblocks].first = i;
+	  blocks[nblocks].count = 0;
+	  blocks[nblocks].succ[0] = blocks[nblocks].succ[1] = -1;
+	  blocks[nblocks].reachable = 0;
+	  nblocks++;
+	}
+      blocks[nblocks - 1].count++;
+      if (STMT (i)->type == label_type)
+	{
+	  if (nlabels == alabels)
+	    labels = x2nrealloc (labels, &alabels, sizeof *labels);
+	  labels[nlabels].name = ast_label_name (STMT (i));
+	  labels[nlabels].stmt = i;
+	  labels[nlabels].block = nblocks - 1;
+	  labels[nlabels].refs = 0;
+	  nlabels++;
+	}
+    }
+  qsort (labels, nlabels, sizeof *labels, compare_label);
+
+  size_t b;
+  for (b = 0; b < nblocks; b++)
+    {
+      struct ast *t = LAST_STMT (b);
+      struct cfg_label *l;
+      if (t->type != jump_type && t->type != ret_type && b + 1 < nblocks)
+	blocks[b].succ[0] = b + 1;
+      if ((t->type == jump_type || t->type == cond_type)
+	  && (l = find_label (t)) != NULL)
+	blocks[b].succ[t->type == cond_type] = l->block;
+    }
+}
+
+/**
+ * Test if block @c b does nothing but fall through to the next
+ * block.
+ *
+ */
+static int
+empty_block (size_t b)
+{
+  size_t i;
+  if (b + 1 >= nblocks)
+    return 0;
+  for (i = blocks[b].first; i < blocks[b].first + blocks[b].count; i++)
+    if (STMT (i)->type != label_type)
+      return 0;
+  return 1;
+}
+
+/**
+ * Find the first block that is not empty when starting from @c b.
+ *
+ */
+static size_t
+skip_empty (size_t b)
+{
+  while (empty_block (b))
+    b++;
+  return b;
+}
+
+/**
+ * Make the jump or cond @c s branch to the label @c label instead.
+ *
+ */
+static void
+retarget (struct ast *s, const struct ast *label)
+{
+  char **name = s->type == jump_type ? &s->op.jump.name : &s->op.cond.name;
+  FREE (*name);
+  *name = xstrdup (label->op.label.name);
+  FREE_LOC (s->loc);
+  if (label->loc != NULL)
+    s->loc = loc_dup (label->loc);
+}
+
+/**
+ * Find where a branch to block @c b really ends up, following the
+ * empty blocks that fall through and the blocks that do nothing but
+ * jump elsewhere.
+ *
+ * @return The final block, or @c b if the branches form a cycle.
+ */
+static size_t
+final_target (size_t b)
+{
+  size_t to = b, steps;
+  for (steps = 0; steps <= nblocks; steps++)
+    {
+      to = skip_empty (to);
+      struct ast *t = LAST_STMT (to);
+      if (t->type != jump_type || blocks[to].succ[0] < 0)
+	return to;
+      size_t i;
+      for (i = blocks[to].first; STMT (i) != t; i++)
+	if (STMT (i)->type != label_type)
+	  return to;
+      to = blocks[to].succ[0];
+    }
+  return b;
+}
+
+/**
+ * Send every branch straight to the block where it ends up.
+ *
+ * @return true if anything changed, false otherwise.
+ */
+static int
+thread_jumps (void)
+{
+  size_t b;
+  int changed = 0;
+  for (b = 0; b < nblocks; b++)
+    {
+      struct ast *t = LAST_STMT (b);
+      int k = t->type == cond_type;
+      if ((t->type != jump_type && t->type != cond_type)
+	  || blocks[b].succ[k] < 0)
+	continue;
+      size_t to = final_target (blocks[b].succ[k]);
+      if (to != (size_t) blocks[b].succ[k])
+	{
+	  retarget (t, STMT (blocks[to].first));
+	  blocks[b].succ[k] = to;
+	  changed = 1;
+	}
+    }
+  return changed;
+}
+
+/**
+ * Mark every block that can be reached from the entry.
+ *
+ */
+static void
+mark_reachable (void)
+{
+  if (nblocks == 0)
+    return;
+  int *stack = xnmalloc (nblocks + 1, sizeof *stack);
+  size_t n = 0;
+  stack[n++] = 0;
+  blocks[0].reachable = 1;
+  while (n > 0)
+    {
+      int b = stack[--n];
+      int k;
+      for (k = 0; k < 2; k++)
+	{
+	  int s = blocks[b].succ[k];
+	  if (s >= 0 && !blocks[s].reachable)
+	    {
+	      blocks[s].reachable = 1;
+	      stack[n++] = s;
+	    }
+	}
+    }
+  FREE (stack);
+}
+
+/**
+ * Test if control falling into block @c b gets to block @c to without
+ * doing anything, once the unreachable blocks are gone.
+ *
+ */
+static int
+falls_through_to (size_t b, int to)
+{
+  while ((int) b < to && (!blocks[b].reachable || empty_block (b)))
+    b++;
+  return (int) b == to;
+}
+
+/**
+ * Turn a cond that branches over a lone jump into a single cond with
+ * the opposite test, so
+ *
+ * @code
+ *	if (x) goto L1;
+ *	goto L2;
+ * L1:
+ * @endcode
+ *
+ * becomes @c if (!x) goto L2;
+ *
+ * @return true if anything changed, false otherwise.
+ */
+static int
+invert_branches (void)
+{
+  size_t b;
+  int changed = 0;
+  for (b = 0; b + 1 < nblocks; b++)
+    {
+      struct ast *t = LAST_STMT (b);
+      struct ast *j = STMT (blocks[b + 1].first);
+      if (!blocks[b].reachable || t->type != cond_type
+	  || j->type != jump_type || blocks[b + 1].count != 1
+	  || blocks[b].succ[1] < 0 || blocks[b + 1].succ[0] < 0
+	  || !falls_through_to (b + 2, blocks[b].succ[1]))
+	continue;
+      t->ops[0]->boolean_not ^= 1;
+      retarget (t, STMT (blocks[blocks[b + 1].succ[0]].first));
+      blocks[b].succ[1] = blocks[b + 1].succ[0];
+      dead[blocks[b + 1].first] = 1;
+      changed = 1;
+    }
+  return changed;
+}
+
+/**
+ * Mark the statements that can be deleted.
+ *
+ */
+static void
+mark_dead (void)
+{
+  size_t b, i;
+  struct cfg_label *l;
+  for (b = 0; b < nblocks; b++)
+    {
+      struct ast *t = LAST_STMT (b);
+      if (!blocks[b].reachable)
+	memset (dead + blocks[b].first, 1, blocks[b].count);
+      else if ((t->type == jump_type || t->type == cond_type)
+	       && (l = find_label (t)) != NULL)
+	l->refs++;
+    }
+
+  for (i = 0; i < nlabels; i++)
+    if (labels[i].refs == 0)
+      dead[labels[i].stmt] = 1;
+
+  /* A branch to where control goes anyway does nothing. */
+  for (b = 0; b < nblocks; b++)
+    {
+      struct ast *t = LAST_STMT (b);
+      int k = t->type == cond_type;
+      if (!blocks[b].reachable
+	  || (t->type != jump_type && t->type != cond_type)
+	  || blocks[b].succ[k] < 0
+	  || (k && ast_has_side_effects (t->ops[0])))
+	continue;
+      if (falls_through_to (b + 1, blocks[b].succ[k]))
+	dead[blocks[b].first + blocks[b].count - 1] = 1;
+    }
+}
+
+/**
+ * Delete the statements that were marked dead.
+ *
+ * @return true if any were deleted, false otherwise.
+ */
+static int
+sweep (void)
+{
+  size_t i;
+  int changed = 0;
+  /* Go backwards so that the link of each statement is still alive
+     when it is deleted. */
+  for (i = nstmts; i-- > 0;)
+    if (dead[i])
+      {
+	struct ast *t = STMT (i);
+	STMT (i) = t->next;
+	t->next = NULL;
+	AST_FREE (t);
+	changed = 1;
+      }
+  return changed;
+}
+
+/**
+ * Simplify the control flow of the function @c s.
+ *
+ */
+static void
+simplify_function (struct ast *s)
+{
+  struct ast *body = s->ops[1];
+  assert (body != NULL && body->type == block_type);
+  flatten (&body->ops[0]);
+
+  int changed;
+  do
+    {
+      build_cfg (body);
+      changed = thread_jumps ();
+      mark_reachable ();
+      changed |= invert_branches ();
+      mark_dead ();
+      changed |= sweep ();
+      FREE (dead);
+    }
+  while (changed);
+}
+
+int
+simplify_cfg (struct ast *s)
+{
+  if (optimize < 1)
+    return 0;
+  for (; s != NULL; s = s->next)
+    if (s->type == function_type)
+      simplify_function (s);
+  FREE (labels);
+  nlabels = alabels = 0;
+  FREE (blocks);
+  nblocks = ablocks = 0;
+  FREE (links);
+  nstmts = astmts = 0;
+  return 0;
+}
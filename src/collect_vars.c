@@ -34,6 +34,9 @@
 #include "ast_util.h"
 #include "compiler.h"
 #include "lib.h"
+#include "loc.h"
+#include "my_printf.h"
+#include "xalloc.h"
 
 #include <assert.h>
 
@@ -71,8 +74,11 @@ collect_vars_r (struct ast *s)
     default:
       ;
       int i;
+      /* An allocation that is an operand is an array, which has to
+	 stay where it is to give its address. */
       for (i = 0; i < s->num_ops; i++)
-	vars = ast_cat (vars, collect_vars_r (s->ops[i]));
+	if (s->ops[i] == NULL || s->ops[i]->type != alloc_type)
+	  vars = ast_cat (vars, collect_vars_r (s->ops[i]));
     }
   vars = ast_cat (vars, collect_vars_r (s->next));
   return vars;
@@ -84,3 +90,39 @@ collect_vars (struct ast *s)
   collect_vars_r (s);
   return 0;
 }
+
+struct ast *
+make_temporary (struct ast *function)
+{
+  static int tempno = 0;
+  assert (function->type == function_type);
+  assert (function->ops[1]->type == block_type);
+
+  /* The arguments are stored first, followed by everything that was
+     collected into the start of the body. */
+  long long size = 0;
+  struct ast *i;
+  for (i = function->ops[0]; i != NULL; i = i->next)
+    if (i->type == variable_type)
+      size += i->op.variable.alloc;
+  struct ast **body = &function->ops[1]->ops[0];
+  for (i = *body; i != NULL && i->type == alloc_type; i = i->next)
+    if (i->ops[0] != NULL)
+      {
+	if (i->ops[0]->type != integer_type)
+	  break;
+	size += i->ops[0]->op.integer.i;
+      }
+
+  if (*body != NULL && (*body)->type == alloc_type && (*body)->ops[0] != NULL
+      && (*body)->ops[0]->type == integer_type)
+    (*body)->ops[0]->op.integer.i += 8;
+  else
+    *body = ast_cat (make_alloc (make_integer (8)), *body);
+
+  struct ast *t = make_variable (NULL, my_printf (".T%d", tempno++));
+  t->op.variable.alloc = 8;
+  MAKE_BASE_LOC (t->loc, memory_loc, xstrdup ("%rbp"));
+  t->loc->offset = -(size + 8);
+  return t;
+}
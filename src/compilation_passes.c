@@ -36,9 +36,22 @@ run_compilation_passes (struct ast **ss)
   int ret = 0;
   ret = ret || semantic (*ss);
   ret = ret || transform (ss);
+  ret = ret || inline_functions (*ss);
   ret = ret || dealias (ss);
   ret = ret || collect_vars (*ss);
+  ret = ret || restore_stack (*ss);
+  ret = ret || eliminate_tail_recursion (*ss);
+  ret = ret || propagate_constants (*ss);
   ret = ret || optimizer (ss);
+  ret = ret || simplify_cfg (*ss);
+  ret = ret || convert_branches (*ss);
+  ret = ret || replace_loop_idioms (*ss);
+  ret = ret || vectorize_loops (*ss);
+  ret = ret || unroll (*ss);
+  ret = ret || hoist_invariants (*ss);
+  ret = ret || reduce_induction_variables (*ss);
+  ret = ret || number_values (*ss);
+  ret = ret || lower_ir (*ss);
   ret = ret || gen_code (*ss);
   AST_FREE (*ss);
   return ret;
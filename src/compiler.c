@@ -97,6 +97,16 @@ struct argp_option opts[] = {
     N_("Only run the preprocessor") },
   { "quiet",    'q',   NULL,                   0,
     N_("Don't print anything (disables -d and -v)") },
+  { NULL,       'f', "FLAG",                   0,
+    N_("Set the code generation flag FLAG (dump-ir prints the"
+       " intermediate representation of every function, peephole-stats"
+       " prints how often each peephole rule was applied, optimizer-stats"
+       " prints how many nodes the optimizer removed, unroll-loops"
+       " unrolls small loops when optimizing, inline-limit=N sets the"
+       " size of the largest function that is inlined)") },
+  { NULL,       'm', "FEATURE",                0,
+    N_("Let the generated code use the instructions of FEATURE (popcnt,"
+       " lzcnt, bmi or avx2)") },
 #if 0
   { "link",     'l',  "LIB",                   0,
     N_("Add LIB to the list of linked-in libraries") },
@@ -159,6 +169,34 @@ arg_parse (int key, char *arg, struct argp_state *state)
       yydebug = 0;
       break;
 
+    case 'f':
+      if (STREQ (arg, "dump-ir"))
+	dump_ir = 1;
+      else if (STREQ (arg, "peephole-stats"))
+	peephole_stats = 1;
+      else if (STREQ (arg, "optimizer-stats"))
+	optimizer_stats = 1;
+      else if (STREQ (arg, "unroll-loops"))
+	unroll_loops = 1;
+      else if (strncmp (arg, "inline-limit=", 13) == 0)
+	inline_limit = strtol (arg + 13, NULL, 0);
+      else
+	argp_error (state, _("unrecognized flag '%s'"), arg);
+      break;
+
+    case 'm':
+      if (STREQ (arg, "popcnt"))
+	target_popcnt = 1;
+      else if (STREQ (arg, "lzcnt"))
+	target_lzcnt = 1;
+      else if (STREQ (arg, "bmi"))
+	target_bmi = 1;
+      else if (STREQ (arg, "avx2"))
+	target_avx2 = 1;
+      else
+	argp_error (state, _("unrecognized target feature '%s'"), arg);
+      break;
+
     case ARGP_KEY_ARG:
       gl_list_add_last (infile_name, arg);
       break;
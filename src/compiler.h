@@ -80,6 +80,45 @@ extern char stop;		/**< A character that defines how far
 				   the compiler should go during its
 				   compilation routines. */
 
+extern int dump_ir;		/**< A flag that if true will cause
+				   the IR of every function to be
+				   printed on stderr. */
+
+extern int peephole_stats;	/**< A flag that if true will cause
+				   the number of times each peephole
+				   rule was applied to be printed on
+				   stderr. */
+
+extern int optimizer_stats;	/**< A flag that if true will cause
+				   the number of nodes removed by the
+				   optimizer to be printed on
+				   stderr. */
+
+extern int unroll_loops;	/**< A flag that if true will cause
+				   small loops to be unrolled. */
+
+extern int inline_limit;	/**< The most nodes that a function
+				   declared inline may have to be
+				   inlined. */
+
+extern int target_popcnt;	/**< A flag that if true says that
+				   the target has the popcnt
+				   instruction. */
+
+extern int target_lzcnt;	/**< A flag that if true says that
+				   the target has the lzcnt
+				   instruction. */
+
+extern int target_bmi;		/**< A flag that if true says that
+				   the target has the BMI1
+				   instructions (tzcnt, blsr and
+				   blsi). */
+
+extern int target_avx2;		/**< A flag that if true says that
+				   the target has the AVX2
+				   instructions, so that vectorized
+				   loops can use 32 byte vectors. */
+
 struct ast;
 
 /** 
@@ -100,6 +139,44 @@ extern int gen_code (struct ast *s);
  */
 extern int optimizer (struct ast **ss);
 
+/** 
+ * Run the optimizer over the expression @c ss alone, for the passes
+ * that make new expressions after it has run.
+ * 
+ * @param ss Reference to the expression.
+ * 
+ * @return Error code.
+ */
+extern int simplify_expression (struct ast **ss);
+
+/** 
+ * Fold the binary operator @c op on two constants with the semantics
+ * of the target.
+ * 
+ * @param op The operator.
+ * @param l The left hand side.
+ * @param r The right hand side.
+ * @param out Where to store the result.
+ * 
+ * @return true if the result was stored in @c out, false if it can't
+ * be computed at compile time (like a division by zero).
+ */
+extern int fold_constant_binary (int op, long long l, long long r,
+				 long long *out);
+
+/** 
+ * Fold the unary operator @c op on a constant with the semantics of
+ * the target.
+ * 
+ * @param op The operator.
+ * @param a The operand.
+ * @param out Where to store the result.
+ * 
+ * @return true if the result was stored in @c out, false if it can't
+ * be computed at compile time (like the leading zeros of zero).
+ */
+extern int fold_constant_unary (int op, long long a, long long *out);
+
 /** 
  * The transformation pass for the lower level passes.
  * 
@@ -109,6 +186,17 @@ extern int optimizer (struct ast **ss);
  */
 extern int transform (struct ast **ss);
 
+/** 
+ * Build the call graph of the file and expand the calls to small
+ * functions and functions declared inline that don't call
+ * themselves.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int inline_functions (struct ast *s);
+
 /** 
  * This pass collects all the allocated variables into the start of
  * the function definition, making it easier to optimize them into a
@@ -120,6 +208,47 @@ extern int transform (struct ast **ss);
  */
 extern int collect_vars (struct ast *s);
 
+/** 
+ * Allocate a new eight byte stack slot in a function that has been
+ * through collect_vars, for a value that the optimizer wants to keep.
+ * 
+ * @param function The function_type AST to allocate it in.
+ * 
+ * @return A variable that refers to the new slot.
+ */
+extern struct ast *make_temporary (struct ast *function);
+
+/** 
+ * Make the blocks that allocate memory of a size that isn't known on
+ * the stack give it back when they end.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int restore_stack (struct ast *s);
+
+/** 
+ * Test if the address of a variable or of memory allocated on the
+ * stack could be taken in @c s, so that it could still be used after
+ * the function returns.
+ * 
+ * @param s The body of a function.
+ * 
+ * @return true if it could be, false otherwise.
+ */
+extern int address_escapes (const struct ast *s);
+
+/** 
+ * Turn the calls that functions make to themselves right before they
+ * return into jumps back to the start of their bodies.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int eliminate_tail_recursion (struct ast *s);
+
 /** 
  * The de-alias pass translates variable names into something we can
  * understand.
@@ -140,6 +269,118 @@ extern int dealias (struct ast **ss);
  */
 extern int semantic (struct ast *s);
 
+/** 
+ * Lower every function into the three-address IR, printing it on
+ * stderr if the @c dump_ir flag is set.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int lower_ir (struct ast *s);
+
+/** 
+ * Sparse conditional constant propagation over the SSA form of every
+ * function, which is only run at -O2 and above.  Variables that are
+ * known to be constant are replaced with their values and branches
+ * that are known to go one way have their conditions replaced, which
+ * leaves the optimizer to fold away the dead code.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int propagate_constants (struct ast *s);
+
+/** 
+ * Build the control flow graph of every function and simplify it by
+ * deleting unreachable blocks, merging empty blocks into their
+ * successors and deleting dead labels and redundant branches.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int simplify_cfg (struct ast *s);
+
+/** 
+ * Turn the branches around assignments or returns of cheap values
+ * into ternaries, which are compiled to conditional moves.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int convert_branches (struct ast *s);
+
+/** 
+ * Replace the loops that fill an array with a constant or copy one
+ * array into another with calls of memset or memcpy.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int replace_loop_idioms (struct ast *s);
+
+/** 
+ * Vectorize the innermost counted loops that combine arrays element
+ * by element or reduce one to a value.  Most of the iterations are
+ * done by a call of __builtin_vector_map, __builtin_vector_map_scalar
+ * or __builtin_vector_reduce, which the code generator expands into a
+ * loop over SSE2 or AVX2 vectors, and the original loop does the
+ * rest.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int vectorize_loops (struct ast *s);
+
+/** 
+ * Unroll the small counted loops of every function, completely if
+ * they run a small constant number of times.  This only does anything
+ * with -funroll-loops.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int unroll (struct ast *s);
+
+/** 
+ * Find the natural loops of every function and move the computations
+ * that give the same value on every iteration out of them.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int hoist_invariants (struct ast *s);
+
+/** 
+ * Replace the array accesses indexed by the induction variables of
+ * every loop with pointers that are stepped along with them, and turn
+ * counters that are only used to end their loops into counters that
+ * count down to zero.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int reduce_induction_variables (struct ast *s);
+
+/** 
+ * Number the values computed by every function and reuse the ones
+ * that are computed more than once.  At -O1 this is done within each
+ * basic block and at -O2 and above over the dominator tree.
+ * 
+ * @param s The AST to operate on.
+ * 
+ * @return Error code.
+ */
+extern int number_values (struct ast *s);
+
 /** 
  * This runs all the above routines in order and collects their return
  * values.
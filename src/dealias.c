@@ -139,28 +139,41 @@ free_state (struct state_stack *s)
 static struct state_stack *state = NULL; /**< The current state
 					    level. */
 
-static int func_allocd = 0;	/**< The amount of memory that has so
-				   far been allocated for the
+static int func_allocd = 0;	/**< The amount of memory that is
+				   allocated to the variables in
+				   scope. */
+static int func_peak = 0;	/**< The most memory that has been
+				   allocated at once in the
 				   function. */
 static int curr_labelno = 1;	/**< The number of the next label that
 				   will be identified. */
 
 /**
  * Add a variable to the state, noting the amount of memory that is
- * allocated to it.
+ * allocated to it.  The variables of blocks that have ended don't
+ * need their memory anymore, so it is reused.
  *
  * @param v The variable name to be added.
  * @param s The size of @c v (the amount of memory to allocate).
+ *
+ * @return The amount by which the memory of the function grew.
  */
-static inline void
+static inline size_t
 add_to_state (const char *v, size_t s)
 {
+  size_t grow = 0;
   func_allocd += s;
+  if (func_allocd > func_peak)
+    {
+      grow = func_allocd - func_peak;
+      func_peak = func_allocd;
+    }
   struct loc *l;
   MAKE_BASE_LOC (l, memory_loc, xstrdup ("%rbp"));
   l->offset = -func_allocd;
   gl_sortedlist_add (state->state, compare_entry, create_entry (v, l));
   FREE_LOC (l);
+  return grow;
 }
 
 /**
@@ -232,13 +245,16 @@ dealias_r (struct ast **ss)
   switch (s->type)
     {
     case block_type:
+      ;
+      int allocd = func_allocd;
       state = create_state (state);
       dealias_r (&s->ops[0]);
       state = free_state (state);
+      func_allocd = allocd;
       break;
 
     case function_type:
-      func_allocd = 0;
+      func_allocd = func_peak = 0;
       state = create_state (state);
       dealias_r (&s->ops[0]);
       dealias_r (&s->ops[1]);
@@ -248,9 +264,10 @@ dealias_r (struct ast **ss)
     case variable_type:
       if (s->op.variable.type != NULL)
 	{
-	  s->next = ast_cat (make_alloc (make_integer (8)), s->next);
+	  size_t grow = add_to_state (s->op.variable.name, 8);
+	  if (grow > 0)
+	    s->next = ast_cat (make_alloc (make_integer (grow)), s->next);
 	  s->op.variable.alloc = 8;
-	  add_to_state (s->op.variable.name, 8);
 	}
       s->loc = get_from_state (s->op.variable.name);
       assert (s->loc != NULL);
@@ -287,7 +304,7 @@ dealias (struct ast **ss)
   /* Nullify the global vars. */
   free_state (state);
   state = create_state (NULL);
-  func_allocd = 0;
+  func_allocd = func_peak = 0;
   curr_labelno = 1;
 
   dealias_r (ss);
@@ -66,14 +66,17 @@
   } while (0)
 
 #include "ast.h"
+#include "ast_util.h"
 #include "compiler.h"
 #include "extendf.h"
 #include "free.h"
 #include "lib.h"
 #include "my_printf.h"
 #include "parse.h"
+#include "peephole.h"
 #include "xalloc.h"
 
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -127,11 +130,13 @@
       fprintf (stderr, __VA_ARGS__);		\
   } while (0)
 
-#define EMIT_LABEL(L) PUT ("%s:\n", (L))
-#define EMIT0(OP) PUT ("\t%s\n", (OP))
-#define EMIT1(OP, A) PUT ("\t%s\t%s\n", (OP), (A))
-#define EMIT2(OP, A, B) PUT ("\t%s\t%s, %s\n", (OP), (A), (B))
-#define EMIT3(OP, A, B, C) PUT ("\t%s\t%s, %s, %s\n", (OP), (A), (B), (C))
+/* The instructions are buffered so that the peephole optimizer can
+   rewrite them before they are printed by asm_flush. */
+#define EMIT_LABEL(L) asm_label (L)
+#define EMIT0(OP) asm_emit ((OP), 0)
+#define EMIT1(OP, A) asm_emit ((OP), 1, (A))
+#define EMIT2(OP, A, B) asm_emit ((OP), 2, (A), (B))
+#define EMIT3(OP, A, B, C) asm_emit ((OP), 3, (A), (B), (C))
 
 /** 
  * Get the string variant of a register index.
@@ -152,6 +157,30 @@ regis (int a)
   return storage[a];
 }
 
+/** 
+ * Get the name of the low byte of a register.
+ * 
+ * @param r The name of the 64-bit register.
+ * 
+ * @return The name of its low byte.
+ */
+static const char *
+byte_regis (const char *r)
+{
+  const char *storage[][2] =
+    { { "%rax", "%al" }, { "%rbx", "%bl" }, { "%rcx", "%cl" },
+      { "%rdx", "%dl" }, { "%rdi", "%dil" }, { "%rsi", "%sil" },
+      { "%r8", "%r8b" }, { "%r9", "%r9b" }, { "%r10", "%r10b" },
+      { "%r11", "%r11b" }, { "%r12", "%r12b" }, { "%r13", "%r13b" },
+      { "%r14", "%r14b" }, { "%r15", "%r15b" } };
+  size_t i;
+  for (i = 0; i < sizeof storage / sizeof *storage; i++)
+    if (STREQ (storage[i][0], r))
+      return storage[i][1];
+  assert (0);
+  return NULL;
+}
+
 /** 
  * Yield registers in the order that a function call requires them.
  * 
@@ -168,7 +197,7 @@ static int
 call_regis(int a)
 {
   const int storage[] =
-    { 4, 5, 2, 3, 6, 7 };
+    { 4, 5, 3, 2, 6, 7 };
 #if USE_REGISTER_CHECKING
   CHECK_BOUNDS (storage, a);
 #endif
@@ -209,9 +238,25 @@ static int avail = 0;		/**< Top of available register
 static int str_labelno = 0;	/**< Current label number for strings
 				   in the data section. */
 static char *data_section = NULL; /**< The data section. */
+static char *rodata_section = NULL; /**< The read only data section,
+				       or NULL if it is empty. */
 static int branch_labelno = 0;	/**< Current label number for branch
 				   destinations in the text
 				   section. */
+static int tail_calls = 0;	/**< Whether the calls that the current
+				   function returns the result of can
+				   be made with a jump. */
+static int frame_pointer = 0;	/**< Whether the current function keeps
+				   its frame pointer in %rbp. */
+static long long frame_size = 0; /**< The number of bytes that the
+				    prologue took off of %rsp, not
+				    counting the saved %rbp. */
+static int stack_moves = 0;	/**< Whether the body of the current
+				   function moves %rsp. */
+
+/** The bytes below %rsp that a leaf function may use without moving
+    it. */
+#define RED_ZONE 128
 
 /** 
  * Macro to allocate a register to a location while also checking to
@@ -357,7 +402,7 @@ static int branch_labelno = 0;	/**< Current label number for branch
 	MOVE_LOC ((Y), _l);				\
 	(Y)->base = xstrdup ("%cl");			\
       }							\
-    if (IS_LITERAL (X))					\
+    if (!IS_REGISTER (X))				\
       GIVE_REGISTER (X);				\
   } while (0)
 
@@ -393,19 +438,121 @@ static int branch_labelno = 0;	/**< Current label number for branch
 /* Forward declaration for more specific functions. */
 static void gen_code_r (struct ast *);
 
+/** 
+ * Test if @c s contains an AST of type @c type.
+ * 
+ */
+static int
+contains (const struct ast *s, enum ast_code type)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == type && (type != alloc_type || s->ops[0] != NULL))
+	return 1;
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	if (contains (s->ops[i], type))
+	  return 1;
+    }
+  return 0;
+}
+
+/** 
+ * Take the allocations at the start of the function @c s out of its
+ * body, since they are made all at once by the prologue.
+ * 
+ * @return The size of the parameters and the allocations.
+ */
+static long long
+frame_allocs (struct ast *s)
+{
+  long long size = 0;
+  struct ast *i;
+  for (i = s->ops[0]; i != NULL; i = i->next)
+    if (i->type == variable_type)
+      size += i->op.variable.alloc;
+  for (i = s->ops[1]->ops[0]; i != NULL && i->type == alloc_type;
+       i = i->next)
+    if (i->ops[0] != NULL)
+      {
+	if (i->ops[0]->type != integer_type)
+	  break;
+	size += i->ops[0]->op.integer.i;
+	AST_FREE (i->ops[0]);
+      }
+  return size;
+}
+
+/** 
+ * Give each array in @c s whose size is known a fixed place in the
+ * frame, replacing its allocation with the address of that place.
+ * 
+ * @param ss Reference to an AST pointer.
+ * @param size The size of the frame, which is updated.
+ */
+static void
+place_arrays (struct ast **ss, long long *size)
+{
+  assert (ss != NULL);
+#define s (*ss)
+  if (s == NULL)
+    return;
+  int i;
+  for (i = 0; i < s->num_ops; i++)
+    place_arrays (&s->ops[i], size);
+  if (s->type == alloc_type && s->ops[0] != NULL
+      && s->ops[0]->type == integer_type)
+    {
+      *size += (s->ops[0]->op.integer.i + 7) & ~7;
+      struct ast *v = make_variable (NULL, xstrdup (".array"));
+      MAKE_BASE_LOC (v->loc, memory_loc, xstrdup ("%rbp"));
+      v->loc->offset = -*size;
+      struct ast *t = make_unary ('&', v);
+      SWAP_AST (t, s);
+      AST_FREE (t);
+    }
+  place_arrays (&s->next, size);
+#undef s
+}
+
 static void
 gen_code_function (struct ast *s)
 {
   /* Enter the .text section and declare this symbol as global. */
   EMIT1 (".global", s->op.function.name);
   EMIT_LABEL (s->op.function.name);
+  size_t start = asm_mark ();
+
+  /* Lay out the frame.  Everything whose size is known is made with
+     one adjustment of %rsp that keeps it aligned to 16 bytes at
+     calls.  The frame pointer is only needed if the body moves %rsp
+     itself, or for debugging.  A leaf function whose frame fits in
+     the red zone doesn't have to move %rsp at all. */
+  long long size = frame_allocs (s);
+  place_arrays (&s->ops[1]->ops[0], &size);
+
+  size = (size + 15) & ~15;
+  stack_moves = contains (s->ops[1], alloc_type);
+  frame_pointer = optimize < 1 || stack_moves;
+  if (frame_pointer)
+    {
+      EMIT1 ("push", "%rbp");
+      EMIT2 ("mov", "%rsp", "%rbp");
+      frame_size = size;
+    }
+  else if (size <= RED_ZONE && !contains (s->ops[1], function_call_type))
+    frame_size = 0;
+  else
+    frame_size = size + 8;
+  if (frame_size > 0)
+    {
+      char *t = my_printf ("$%lld", frame_size);
+      EMIT2 ("sub", t, "%rsp");
+      FREE (t);
+    }
 
-  /* Set up the stack frame. */
-  EMIT1 ("push", "%rbp");
-  EMIT2 ("mov", "%rsp", "%rbp");
-
-  /* Walk over the list of arguments and push them into the
-     stack. */
+  /* Walk over the list of arguments and store them into the
+     frame. */
   struct ast *i;
   int argnum;
   argnum = 0;
@@ -413,20 +560,80 @@ gen_code_function (struct ast *s)
     {
       if (i->type != variable_type)
 	continue;
-      const char *alloc = my_printf ("$%d", i->op.variable.alloc);
-      EMIT2 ("sub", alloc, "%rsp");
-      FREE (alloc);
       EMIT2 ("mov", regis(call_regis(argnum)), print_loc (i->loc));
       argnum++;
     }
 
+  /* Nothing in the frame may be used after a tail call tears it
+     down. */
+  tail_calls = optimize > 0 && !address_escapes (s->ops[1]);
+
   /* Generate the body of the function. */
   gen_code_r (s->ops[1]);
+
+  /* Without a frame pointer, %rbp stands for where %rsp was on
+     entry. */
+  if (!frame_pointer)
+    asm_rebase_frame (start, frame_size);
+}
+
+/** 
+ * Tear down the frame of the current function.
+ * 
+ */
+static void
+gen_code_epilogue (void)
+{
+  if (frame_pointer)
+    {
+      EMIT2 ("mov", "%rbp", "%rsp");
+      EMIT1 ("pop", "%rbp");
+    }
+  else if (frame_size > 0)
+    {
+      char *t = my_printf ("$%lld", frame_size);
+      EMIT2 ("add", t, "%rsp");
+      FREE (t);
+    }
 }
 
+/** 
+ * Test if the function call @c s can be made by jumping to the
+ * function after tearing down the frame, which requires all of its
+ * arguments to be passed in registers.
+ * 
+ */
+static int
+is_tail_call (const struct ast *s)
+{
+  if (!tail_calls || s == NULL || s->type != function_call_type
+      || s->boolean_not)
+    return 0;
+  int n = 0;
+  const struct ast *i;
+  for (i = s->ops[1]; i != NULL; i = i->next)
+    if (i->type != block_type)
+      n++;
+  return n <= 6;
+}
+
+static void gen_code_call_args (struct ast *);
+
 static void
 gen_code_ret (struct ast *s)
 {
+  if (is_tail_call (s->ops[0]))
+    {
+      /* The called function returns straight to our caller. */
+      struct ast *call = s->ops[0];
+      gen_code_call_args (call);
+      gen_code_epilogue ();
+      EMIT2 ("mov", "$0", "%rax");
+      EMIT1 ("jmp", call->ops[0]->loc->base);
+      FREE_LOC (call->ops[0]->loc);
+      return;
+    }
+
   /* Move the return value into the %rax register. */
   if (s->ops[0] != NULL)
     {
@@ -436,8 +643,7 @@ gen_code_ret (struct ast *s)
       MOVE_LOC (s->ops[0]->loc, ret);
     }
   /* Function footer. */
-  EMIT2 ("mov", "%rbp", "%rsp");
-  EMIT1 ("pop", "%rbp");
+  gen_code_epilogue ();
   EMIT0 ("ret");
 }
 
@@ -496,9 +702,312 @@ gen_code_cond (struct ast *s)
   FREE_LOC (s->ops[0]->loc);
 }
 
+/** 
+ * One case of a run of branches on the value of a variable.
+ * 
+ */
+struct switch_case
+{
+  long long value;		/**< The value it is taken for. */
+  const char *label;		/**< Where it branches to. */
+};
+
+/** The fewest branches that are turned into a dispatch. */
+#define MIN_CASES 4
+
+/** 
+ * Test if @c s branches when a variable equals an integer that fits
+ * in an immediate.
+ * 
+ * @param v Where to store the integer.
+ * 
+ * @return The variable, or NULL if @c s isn't such a branch.
+ */
+static struct ast *
+case_test (const struct ast *s, long long *v)
+{
+  if (s == NULL || s->type != cond_type)
+    return NULL;
+  const struct ast *c = s->ops[0];
+  if (c->type != binary_type || c->op.binary.op != EQ || c->boolean_not)
+    return NULL;
+  struct ast *var = c->ops[0], *k = c->ops[1];
+  if (var->type == integer_type)
+    {
+      var = c->ops[1];
+      k = c->ops[0];
+    }
+  if (var->type != variable_type || var->boolean_not || !IS_MEMORY (var->loc)
+      || var->loc->index != NULL || k->type != integer_type || k->boolean_not
+      || k->op.integer.i < INT_MIN || k->op.integer.i > INT_MAX)
+    return NULL;
+  *v = k->op.integer.i;
+  return var;
+}
+
+static int
+compare_case (const void *a, const void *b)
+{
+  long long x = ((const struct switch_case *) a)->value;
+  long long y = ((const struct switch_case *) b)->value;
+  return (x > y) - (x < y);
+}
+
+/** 
+ * Make the name of a new label in the text section.
+ * 
+ */
+static char *
+branch_label (void)
+{
+  return my_printf (".LB%d", branch_labelno++);
+}
+
+/** 
+ * Dispatch on the value in the register @c r with a balanced binary
+ * decision tree over the sorted cases @c c.
+ * 
+ * @param n The number of cases.
+ * @param deflt Where to go when none of them match.
+ */
+static void
+gen_code_case_tree (const struct switch_case *c, size_t n, const char *r,
+		    const char *deflt)
+{
+  char *imm;
+  if (n < MIN_CASES)
+    {
+      size_t i;
+      for (i = 0; i < n; i++)
+	{
+	  imm = my_printf ("$%lld", c[i].value);
+	  EMIT2 ("cmp", imm, r);
+	  EMIT1 ("je", c[i].label);
+	  FREE (imm);
+	}
+      EMIT1 ("jmp", deflt);
+      return;
+    }
+
+  size_t mid = n / 2;
+  char *right = branch_label ();
+  imm = my_printf ("$%lld", c[mid].value);
+  EMIT2 ("cmp", imm, r);
+  EMIT1 ("je", c[mid].label);
+  EMIT1 ("jg", right);
+  FREE (imm);
+  gen_code_case_tree (c, mid, r, deflt);
+  EMIT_LABEL (right);
+  gen_code_case_tree (c + mid + 1, n - mid - 1, r, deflt);
+  FREE (right);
+}
+
+/** 
+ * Generate the code for a run of at least @c MIN_CASES branches that
+ * compare the same variable against integers, which is what a switch
+ * statement is made of.  The value is loaded once and then dispatched
+ * on by one of:
+ *
+ * - A jump table in the read only data section, when at least a
+ *   third of the values in the range of the cases are taken.
+ * - Bit tests against a mask of the cases going to each label, when
+ *   the range fits in a word and there are few labels.
+ * - A balanced binary decision tree otherwise.
+ * 
+ * @param s The first branch.
+ * 
+ * @return The last statement that was generated, or NULL if @c s
+ * doesn't start such a run.
+ */
+static struct ast *
+gen_code_switch (struct ast *s)
+{
+  long long v;
+  struct ast *var = case_test (s, &v), *t, *last = s;
+  if (var == NULL)
+    return NULL;
+
+  size_t n = 0, i, j;
+  for (t = s; t != NULL; t = t->next)
+    {
+      struct ast *u = case_test (t, &v);
+      if (u == NULL || u->loc->offset != var->loc->offset
+	  || STRNEQ (u->loc->base, var->loc->base))
+	break;
+      n++;
+    }
+  if (n < MIN_CASES)
+    return NULL;
+
+  /* Only the first branch on a value is ever taken. */
+  struct switch_case *c = xnmalloc (n, sizeof *c);
+  size_t m = 0;
+  for (t = s, i = 0; i < n; t = t->next, i++)
+    {
+      case_test (t, &v);
+      for (j = 0; j < m && c[j].value != v; j++)
+	;
+      if (j == m)
+	{
+	  c[m].value = v;
+	  c[m++].label = print_loc (t->loc);
+	}
+      last = t;
+    }
+  qsort (c, m, sizeof *c, compare_case);
+
+  /* When no jump follows the run, the default is to fall through. */
+  char *deflt, *after = NULL;
+  if (last->next != NULL && last->next->type == jump_type)
+    {
+      last = last->next;
+      deflt = xstrdup (print_loc (last->loc));
+    }
+  else
+    deflt = after = branch_label ();
+
+  struct loc *r;
+  ALLOC_REGISTER (r);
+  EMIT2 ("mov", print_loc (var->loc), r->base);
+  unsigned long long range = c[m - 1].value - c[0].value;
+  size_t labels = 0;
+  for (i = 0; i < m; i++)
+    {
+      for (j = 0; j < i && STRNEQ (c[j].label, c[i].label); j++)
+	;
+      labels += j == i;
+    }
+
+  int dense = range + 1 <= 3 * m, bits = !dense && range < 64 && labels <= 3;
+  char *imm;
+  if (c[0].value != 0 && (dense || bits))
+    {
+      imm = my_printf ("$%lld", c[0].value);
+      EMIT2 ("sub", imm, r->base);
+      FREE (imm);
+    }
+  if (dense)
+    {
+      /* The subtraction made the values below the range wrap around
+	 to above it. */
+      char *table = branch_label (), *jump;
+      imm = my_printf ("$%llu", range);
+      EMIT2 ("cmp", imm, r->base);
+      EMIT1 ("ja", deflt);
+      jump = my_printf ("*%s(,%s,8)", table, r->base);
+      EMIT1 ("jmp", jump);
+      FREE (jump);
+      FREE (imm);
+
+      if (rodata_section == NULL)
+	rodata_section = xstrdup ("\t.section\t.rodata\n");
+      EXTENDF (rodata_section, "\t.align\t8\n%s:\n", table);
+      for (i = 0, v = c[0].value; i < m; v++)
+	if (c[i].value == v)
+	  EXTENDF (rodata_section, "\t.quad\t%s\n", c[i++].label);
+	else
+	  EXTENDF (rodata_section, "\t.quad\t%s\n", deflt);
+      FREE (table);
+    }
+  else if (bits)
+    {
+      imm = my_printf ("$%llu", range);
+      EMIT2 ("cmp", imm, r->base);
+      EMIT1 ("ja", deflt);
+      FREE (imm);
+      struct loc *mask;
+      ALLOC_REGISTER (mask);
+      for (i = 0; i < m; i++)
+	{
+	  unsigned long long set = 0;
+	  for (j = 0; j < m; j++)
+	    if (STREQ (c[j].label, c[i].label))
+	      {
+		if (j < i)
+		  break;
+		set |= 1ULL << (c[j].value - c[0].value);
+	      }
+	  if (j < m)
+	    continue;
+	  imm = my_printf ("$%#llx", set);
+	  EMIT2 ("mov", imm, mask->base);
+	  EMIT2 ("bt", r->base, mask->base);
+	  EMIT1 ("jc", c[i].label);
+	  FREE (imm);
+	}
+      EMIT1 ("jmp", deflt);
+      FREE_LOC (mask);
+    }
+  else
+    gen_code_case_tree (c, m, r->base, deflt);
+  FREE_LOC (r);
+
+  if (after != NULL)
+    EMIT_LABEL (after);
+  FREE (deflt);
+  FREE (c);
+  return last;
+}
+
+/** 
+ * Test if @c s is the integer @c v.
+ * 
+ */
+static int
+is_integer (const struct ast *s, long long v)
+{
+  return s->type == integer_type && s->op.integer.i == v
+    && !s->boolean_not;
+}
+
+/** 
+ * Generate code for the ternary @c s that gives 1 or 0 for its
+ * condition, by materializing the flags with a @c set instruction.
+ * 
+ * @param invert Whether it gives 0 when the condition holds.
+ */
+static void
+gen_code_setcc (struct ast *s, int invert)
+{
+  struct ast *c = s->ops[0];
+  gen_code_r (c);
+  c->boolean_not ^= invert;
+  char *instruct;
+  if (c->type == binary_type && binop_branch_suffix[c->op.binary.op] != NULL)
+    GEN_BINOP_BRANCH_CODE (instruct, "set", c);
+  else
+    {
+      if (!IS_REGISTER (c->loc))
+	GIVE_REGISTER (c->loc);
+      EMIT2 ("cmpq", "$0", print_loc (c->loc));
+      instruct = my_printf ("set%sz", !c->boolean_not ? "n" : "");
+    }
+  c->boolean_not ^= invert;
+  FREE_LOC (c->loc);
+
+  /* The register can be one that the comparison used, since only the
+     flags are read. */
+  ALLOC_REGISTER (s->loc);
+  const char *byte = byte_regis (s->loc->base);
+  EMIT1 (instruct, byte);
+  EMIT2 ("movzbq", byte, s->loc->base);
+  FREE (instruct);
+}
+
 static void
 gen_code_ternary (struct ast *s)
 {
+  if (is_integer (s->ops[1], 1) && is_integer (s->ops[2], 0))
+    {
+      gen_code_setcc (s, 0);
+      return;
+    }
+  if (is_integer (s->ops[1], 0) && is_integer (s->ops[2], 1))
+    {
+      gen_code_setcc (s, 1);
+      return;
+    }
+
   gen_code_r (s->ops[2]);
   s->loc = loc_dup (s->ops[2]->loc);
 
@@ -513,6 +1022,210 @@ gen_code_ternary (struct ast *s)
   FREE_LOC (s->ops[1]->loc);
 }
 
+/** 
+ * Get the base two logarithm of @c x.
+ * 
+ * @return The logarithm, or -1 if @c x is not a power of two.
+ */
+static int
+exact_log2 (unsigned long long x)
+{
+  int k = 0;
+  if (x == 0 || (x & (x - 1)) != 0)
+    return -1;
+  while (x >>= 1)
+    k++;
+  return k;
+}
+
+/** 
+ * Find the magic number that turns a signed division by @c d into a
+ * multiplication, as described in Hacker's Delight section 10-4.
+ * 
+ * @param d The divisor, which must not be -1, 0 or 1.
+ * @param shift Where to store the shift that follows the multiply.
+ * 
+ * @return The magic number.
+ */
+static long long
+division_magic (long long d, int *shift)
+{
+  const unsigned long long two63 = 1ULL << 63;
+  unsigned long long ad = (d < 0 ? -(unsigned long long) d
+			   : (unsigned long long) d);
+  unsigned long long t = two63 + ((unsigned long long) d >> 63);
+  unsigned long long anc = t - 1 - t % ad;
+  unsigned long long q1 = two63 / anc, r1 = two63 - q1 * anc;
+  unsigned long long q2 = two63 / ad, r2 = two63 - q2 * ad;
+  unsigned long long delta;
+  int p = 63;
+  do
+    {
+      p++;
+      q1 *= 2;
+      r1 *= 2;
+      if (r1 >= anc)
+	{
+	  q1++;
+	  r1 -= anc;
+	}
+      q2 *= 2;
+      r2 *= 2;
+      if (r2 >= ad)
+	{
+	  q2++;
+	  r2 -= ad;
+	}
+      delta = ad - r2;
+    }
+  while (q1 < delta || (q1 == delta && r1 == 0));
+  *shift = p - 64;
+  return d < 0 ? -(long long) (q2 + 1) : (long long) (q2 + 1);
+}
+
+/** 
+ * Emit an instruction with an immediate first operand.
+ * 
+ * @param OP The opcode.
+ * @param FMT The format of the immediate.
+ * @param V The value of the immediate.
+ * @param ... The rest of the operands.
+ */
+#define EMIT_IMM(OP, FMT, V, ...) do {				\
+    char *_imm = my_printf ("$" FMT, (V));			\
+    EMIT2 ((OP), _imm, __VA_ARGS__);				\
+    FREE (_imm);						\
+  } while (0)
+
+/** 
+ * Generate code for multiplying, dividing or taking the remainder of
+ * @c s->loc by the constant @c c without the slow idivq, using shifts,
+ * lea and multiplication by a magic number instead.  Division rounds
+ * towards zero and the remainder takes the sign of the dividend, as C
+ * requires.
+ * 
+ * @param s The binary AST.
+ * @param c The constant right hand operand.
+ * 
+ * @return true if the code was generated, false if the general
+ * sequence must be used instead.
+ */
+static int
+gen_code_muldiv_const (struct ast *s, long long c)
+{
+  int op = s->op.binary.op;
+  if (c == 0 || c == LLONG_MIN)
+    return 0;
+  unsigned long long ac = (c < 0 ? -(unsigned long long) c
+			   : (unsigned long long) c);
+  int k = exact_log2 (ac);
+  struct loc *t = NULL;
+  ENSURE_DESTINATION_REGISTER_UNI (s->loc);
+  const char *r = print_loc (s->loc);
+
+  if (op == '*')
+    {
+      static const int lea_factors[] = { 3, 5, 9 };
+      int m = 0, j;
+      for (j = 0; k < 0 && j < 3; j++)
+	if (ac % lea_factors[j] == 0 && exact_log2 (ac / lea_factors[j]) >= 0)
+	  m = lea_factors[j];
+      if (k < 0 && m == 0)
+	{
+	  if (c < INT_MIN || c > INT_MAX)
+	    return 0;
+	  char *imm = my_printf ("$%lld", c);
+	  EMIT3 ("imul", imm, r, r);
+	  FREE (imm);
+	  return 1;
+	}
+      if (k < 0)
+	{
+	  char *lea = my_printf ("(%s,%s,%d)", r, r, m - 1);
+	  EMIT2 ("lea", lea, r);
+	  FREE (lea);
+	  k = exact_log2 (ac / m);
+	}
+      if (k > 0)
+	EMIT_IMM ("shl", "%d", k, r);
+      if (c < 0)
+	EMIT1 ("negq", r);
+      return 1;
+    }
+
+  if (ac == 1)
+    {
+      if (op == '%')
+	EMIT2 ("mov", "$0", r);
+      else if (c < 0)
+	EMIT1 ("negq", r);
+      return 1;
+    }
+
+  if (k > 0)
+    {
+      if (op == '%' && k > 31)
+	return 0;
+      /* Add 2^k - 1 to negative dividends so that the arithmetic
+	 shift rounds towards zero. */
+      ALLOC_REGISTER (t);
+      EMIT2 ("mov", r, print_loc (t));
+      if (k > 1)
+	EMIT2 ("sar", "$63", print_loc (t));
+      EMIT_IMM ("shr", "%d", 64 - k, print_loc (t));
+      if (op == '/')
+	{
+	  EMIT2 ("add", print_loc (t), r);
+	  EMIT_IMM ("sar", "%d", k, r);
+	  if (c < 0)
+	    EMIT1 ("negq", r);
+	}
+      else
+	{
+	  EMIT2 ("add", r, print_loc (t));
+	  EMIT_IMM ("and", "%lld", -(1LL << k), print_loc (t));
+	  EMIT2 ("sub", print_loc (t), r);
+	}
+      FREE_LOC (t);
+      return 1;
+    }
+
+  /* The magic number sequence needs %rax and %rdx to itself. */
+  if (STREQ (r, "%rdx"))
+    return 0;
+  int shift;
+  long long magic = division_magic (c, &shift);
+  EMIT_IMM ("mov", "%lld", magic, "%rax");
+  EMIT1 ("imulq", r);
+  if (c > 0 && magic < 0)
+    EMIT2 ("add", r, "%rdx");
+  else if (c < 0 && magic > 0)
+    EMIT2 ("sub", r, "%rdx");
+  if (shift > 0)
+    EMIT_IMM ("sar", "%d", shift, "%rdx");
+  EMIT2 ("mov", "%rdx", "%rax");
+  EMIT2 ("shr", "$63", "%rax");
+  EMIT2 ("add", "%rax", "%rdx");
+  if (op == '/')
+    EMIT2 ("mov", "%rdx", r);
+  else
+    {
+      if (c >= INT_MIN && c <= INT_MAX)
+	{
+	  char *imm = my_printf ("$%lld", c);
+	  EMIT3 ("imul", imm, "%rdx", "%rdx");
+	  FREE (imm);
+	}
+      else
+	{
+	  EMIT_IMM ("mov", "%lld", c, "%rax");
+	  EMIT2 ("imul", "%rax", "%rdx");
+	}
+      EMIT2 ("sub", "%rdx", r);
+    }
+  return 1;
+}
+
 static void
 gen_code_binary (struct ast *s)
 {
@@ -537,6 +1250,16 @@ gen_code_binary (struct ast *s)
       AUTO_ENSURE_PUT ('-', 2, "sub");
       AUTO_ENSURE_PUT (RS, 3, "shr");
       AUTO_ENSURE_PUT (LS, 3, "shl");
+      AUTO_ENSURE_PUT (ROL, 3, "rol");
+      AUTO_ENSURE_PUT (ROR, 3, "ror");
+    case MIN:
+    case MAX:
+      /* There is no cmov from an immediate. */
+      ENSURE_DESTINATION_REGISTER (4, s->loc, from->loc);
+      EMIT2 ("cmp", print_loc (from->loc), print_loc (s->loc));
+      EMIT2 (s->op.binary.op == MIN ? "cmovg" : "cmovl",
+	     print_loc (from->loc), print_loc (s->loc));
+      break;
     case LE:
     case GE:
     case '<':
@@ -552,10 +1275,16 @@ gen_code_binary (struct ast *s)
 #define AUTO_MULDIV_PUT(CASE, OP, REG)			\
       case CASE:					\
 	do {						\
+	  if (optimize > 0				\
+	      && s->ops[1]->type == integer_type	\
+	      && gen_code_muldiv_const			\
+	      (s, s->ops[1]->op.integer.i))		\
+	    break;					\
 	  struct loc *l = NULL;				\
 	  MAKE_BASE_LOC (l, register_loc, "%rax");	\
 	  MOVE_LOC (s->loc, l);				\
-	  EMIT2 ("mov", "$0", "%rdx");			\
+	  if (CASE != '*')				\
+	    EMIT0 ("cqto");				\
 	  if (IS_LITERAL (from->loc))			\
 	    GIVE_REGISTER (from->loc);			\
 	  EMIT1 ((OP), print_loc (from->loc));		\
@@ -573,6 +1302,17 @@ gen_code_binary (struct ast *s)
 
     case '[':
       assert (!IS_LITERAL (s->loc));
+      /* Fold a constant index into the displacement. */
+      if (optimize > 0 && s->ops[1]->type == integer_type
+	  && !s->ops[1]->boolean_not
+	  && s->ops[1]->op.integer.i >= INT_MIN / 8
+	  && s->ops[1]->op.integer.i <= INT_MAX / 8)
+	{
+	  ENSURE_DESTINATION_REGISTER_UNI (s->loc);
+	  s->loc->kind = memory_loc;
+	  s->loc->offset = s->ops[1]->op.integer.i * 8;
+	  break;
+	}
       ENSURE_DESTINATION_REGISTER (4, s->loc, from->loc);
       s->loc->kind = memory_loc;
       s->loc->index = from->loc->base;
@@ -588,6 +1328,44 @@ gen_code_binary (struct ast *s)
   FREE_LOC (from->loc);
 }
 
+/**
+ * Count the bits that are set in the operand of @c s without the
+ * popcnt instruction, by adding up the bits of each pair, then of
+ * each nibble, then of each byte.
+ *
+ * @param s The population count, whose location holds the value to
+ * count.
+ */
+static void
+gen_code_popcount (struct ast *s)
+{
+  struct loc *t, *m;
+  ENSURE_DESTINATION_REGISTER_UNI (s->loc);
+  ALLOC_REGISTER (t);
+  ALLOC_REGISTER (m);
+  EMIT2 ("mov", print_loc (s->loc), print_loc (t));
+  EMIT2 ("shr", "$1", print_loc (t));
+  EMIT2 ("mov", "$0x5555555555555555", print_loc (m));
+  EMIT2 ("and", print_loc (m), print_loc (t));
+  EMIT2 ("sub", print_loc (t), print_loc (s->loc));
+  EMIT2 ("mov", print_loc (s->loc), print_loc (t));
+  EMIT2 ("shr", "$2", print_loc (t));
+  EMIT2 ("mov", "$0x3333333333333333", print_loc (m));
+  EMIT2 ("and", print_loc (m), print_loc (s->loc));
+  EMIT2 ("and", print_loc (m), print_loc (t));
+  EMIT2 ("add", print_loc (t), print_loc (s->loc));
+  EMIT2 ("mov", print_loc (s->loc), print_loc (t));
+  EMIT2 ("shr", "$4", print_loc (t));
+  EMIT2 ("add", print_loc (t), print_loc (s->loc));
+  EMIT2 ("mov", "$0x0f0f0f0f0f0f0f0f", print_loc (m));
+  EMIT2 ("and", print_loc (m), print_loc (s->loc));
+  EMIT2 ("mov", "$0x0101010101010101", print_loc (m));
+  EMIT2 ("imul", print_loc (m), print_loc (s->loc));
+  EMIT2 ("shr", "$56", print_loc (s->loc));
+  FREE_LOC (m);
+  FREE_LOC (t);
+}
+
 static void
 gen_code_unary (struct ast *s)
 {
@@ -619,6 +1397,67 @@ gen_code_unary (struct ast *s)
       EMIT1 ("notq", print_loc (s->loc));
       break;
 
+    case ABS:
+      {
+	/* Negating sets the sign flag when the value was positive. */
+	struct loc *t;
+	ENSURE_DESTINATION_REGISTER_UNI (s->loc);
+	ALLOC_REGISTER (t);
+	EMIT2 ("mov", print_loc (s->loc), print_loc (t));
+	EMIT1 ("negq", print_loc (s->loc));
+	EMIT2 ("cmovs", print_loc (t), print_loc (s->loc));
+	FREE_LOC (t);
+      }
+      break;
+
+    case POPCOUNT:
+      if (!target_popcnt)
+	{
+	  gen_code_popcount (s);
+	  break;
+	}
+      /* Fall through. */
+    case CTZ:
+    case CLZ:
+    case BLSR:
+    case BLSI:
+      {
+	const char *op;
+	switch (s->op.unary.op)
+	  {
+	  case POPCOUNT: op = "popcnt"; break;
+	  case CTZ: op = target_bmi ? "tzcnt" : "bsf"; break;
+	  case CLZ: op = target_lzcnt ? "lzcnt" : "bsr"; break;
+	  case BLSR: op = "blsr"; break;
+	  default: op = "blsi"; break;
+	  }
+	if (IS_LITERAL (s->loc))
+	  GIVE_REGISTER (s->loc);
+	if (IS_REGISTER (s->loc))
+	  {
+	    const char *r = print_loc (s->loc);
+	    EMIT2 (op, r, r);
+	  }
+	else
+	  GIVE_REGISTER_HOW (op, s->loc);
+	/* Without lzcnt, bsr finds the index of the highest set bit,
+	   which is 63 minus the number of leading zeros. */
+	if (s->op.unary.op == CLZ && !target_lzcnt)
+	  EMIT2 ("xor", "$63", print_loc (s->loc));
+      }
+      break;
+
+    case BSWAP:
+      ENSURE_DESTINATION_REGISTER_UNI (s->loc);
+      EMIT1 ("bswap", print_loc (s->loc));
+      break;
+
+    case PREFETCH:
+      ENSURE_DESTINATION_REGISTER_UNI (s->loc);
+      s->loc->kind = memory_loc;
+      EMIT1 ("prefetcht0", print_loc (s->loc));
+      break;
+
     case INC:
       if (!s->unary_prefix)
 	GIVE_REGISTER (s->loc);
@@ -639,12 +1478,13 @@ gen_code_unary (struct ast *s)
 }
 
 /** 
- * Generate code for a function call.
+ * Generate the arguments of the function call @c s and move them into
+ * the registers that they are passed in.
  * 
  * @param s The AST to parse.
  */
 static void
-gen_code_function_call (struct ast *s)
+gen_code_call_args (struct ast *s)
 {
   /** @todo Don't clobber other registers when making a
       function call. */
@@ -661,7 +1501,517 @@ gen_code_function_call (struct ast *s)
     }
   /* We don't support function pointers yet. */
   assert (s->ops[0]->type == variable_type);
+}
+
+/** The most bytes that memcpy, memmove and memset are expanded into
+    unrolled moves for. */
+#define MAX_UNROLLED_BYTES 128
+
+/** The most bytes that memcpy and memset are done with a string
+    instruction for, instead of calling the library. */
+#define MAX_STRING_BYTES 4096
+
+/** 
+ * A piece of a block of memory that is moved with one instruction.
+ * 
+ */
+struct chunk
+{
+  long long offset;		/**< Where it starts in the block. */
+  int size;			/**< The number of bytes in it. */
+};
+
+/** 
+ * Split a block of @c n bytes into as many 16-byte chunks as fit, and
+ * cover the rest with one or two smaller chunks that may overlap the
+ * ones before them.
+ * 
+ * @param n The size of the block, at most @c MAX_UNROLLED_BYTES.
+ * @param c Where to store the chunks.
+ * 
+ * @return The number of chunks.
+ */
+static int
+split_chunks (long long n, struct chunk *c)
+{
+  int k = 0;
+  long long off;
+  for (off = 0; off + 16 <= n; off += 16)
+    c[k++] = (struct chunk) { off, 16 };
+  if (off == n)
+    return k;
+  if (n >= 8)
+    {
+      if (n - off > 8)
+	c[k++] = (struct chunk) { off, 8 };
+      c[k++] = (struct chunk) { n - 8, 8 };
+    }
+  else if (n >= 4)
+    {
+      c[k++] = (struct chunk) { 0, 4 };
+      if (n > 4)
+	c[k++] = (struct chunk) { n - 4, 4 };
+    }
+  else
+    {
+      if (n >= 2)
+	c[k++] = (struct chunk) { 0, 2 };
+      if (n & 1)
+	c[k++] = (struct chunk) { n - 1, 1 };
+    }
+  return k;
+}
+
+/** 
+ * Test if the registers that the string instructions and the
+ * expansions of memcpy and memset use are free while the arguments
+ * of a call are held in registers.
+ * 
+ */
+static int
+string_regis_free (void)
+{
+  int k;
+  /* Each of the three arguments might hold a base and an index. */
+  for (k = 0; k < avail + 6; k++)
+    switch (general_regis (k))
+      {
+      case 2:
+      case 3:
+      case 4:
+      case 5:
+	return 0;
+      }
+  return 1;
+}
+
+/** 
+ * Copy a block of memory with unrolled moves.  Every chunk is loaded
+ * before any of them are stored, so the block may overlap itself.
+ * 
+ * @param dst The register with the destination address.
+ * @param src The register with the source address.
+ * @param n The number of bytes.
+ */
+static void
+gen_code_unrolled_copy (const char *dst, const char *src, long long n)
+{
+  static const char *const small[][2] =
+    { { "%al", "%ax" }, { "%cl", "%cx" } };
+  struct chunk c[MAX_UNROLLED_BYTES / 16 + 2];
+  int k = split_chunks (n, c), i, store;
+  for (store = 0; store < 2; store++)
+    for (i = 0; i < k; i++)
+      {
+	char *r = c[i].size >= 4 ? my_printf ("%%xmm%d", i)
+	  : xstrdup (small[i][c[i].size - 1]);
+	char *m = my_printf ("%lld(%s)", c[i].offset, store ? dst : src);
+	const char *op = c[i].size == 16 ? "movdqu" : c[i].size == 8 ? "movq"
+	  : c[i].size == 4 ? "movd" : c[i].size == 2 ? "movw" : "movb";
+	if (store)
+	  EMIT2 (op, r, m);
+	else
+	  EMIT2 (op, m, r);
+	FREE (m);
+	FREE (r);
+      }
+}
+
+/** 
+ * Set a block of memory to the byte in %rax with unrolled moves.
+ * 
+ * @param dst The register with the destination address.
+ * @param n The number of bytes.
+ */
+static void
+gen_code_unrolled_set (const char *dst, long long n)
+{
+  static const char *const parts[] = { "%al", "%ax", NULL, "%eax",
+				       NULL, NULL, NULL, "%rax" };
+  struct chunk c[MAX_UNROLLED_BYTES / 16 + 2];
+  int k = split_chunks (n, c), i;
+  if (n >= 16)
+    {
+      EMIT2 ("movq", "%rax", "%xmm0");
+      EMIT2 ("punpcklqdq", "%xmm0", "%xmm0");
+    }
+  for (i = 0; i < k; i++)
+    {
+      char *m = my_printf ("%lld(%s)", c[i].offset, dst);
+      if (c[i].size == 16)
+	EMIT2 ("movdqu", "%xmm0", m);
+      else
+	EMIT2 ("mov", parts[c[i].size - 1], m);
+      FREE (m);
+    }
+}
+
+/** 
+ * Expand a call of memcpy, memmove or memset with a constant length
+ * in place.  Small blocks are done with unrolled moves and medium
+ * ones with rep movsb or rep stosb.  Anything else is left to the
+ * library.
+ * 
+ * @param s The function call.
+ * 
+ * @return true if the call was expanded, false otherwise.
+ */
+static int
+gen_code_string_call (struct ast *s)
+{
+  const char *name = s->ops[0]->op.variable.name;
+  int move = STREQ (name, "memmove");
+  int copy = move || STREQ (name, "memcpy");
+  if (!copy && STRNEQ (name, "memset"))
+    return 0;
+  struct ast *dst = s->ops[1], *src = dst == NULL ? NULL : dst->next;
+  struct ast *len = src == NULL ? NULL : src->next;
+  if (len == NULL || len->next != NULL || dst->type == block_type
+      || src->type == block_type || len->type != integer_type
+      || len->boolean_not)
+    return 0;
+  /* A string instruction can't copy backwards without changing the
+     direction flag, so an overlapping move goes to the library. */
+  long long n = len->op.integer.i;
+  if (n < 0 || n > (move ? MAX_UNROLLED_BYTES : MAX_STRING_BYTES)
+      || !string_regis_free ())
+    return 0;
+
+  gen_code_r (s->ops[1]);
+  if (n > MAX_UNROLLED_BYTES)
+    {
+      EMIT2 ("mov", print_loc (dst->loc), "%rdi");
+      EMIT2 ("mov", "%rdi", "%rdx");
+      EMIT2 ("mov", print_loc (src->loc), copy ? "%rsi" : "%rax");
+      EMIT2 ("mov", print_loc (len->loc), "%rcx");
+      EMIT0 (copy ? "rep movsb" : "rep stosb");
+      EMIT2 ("mov", "%rdx", "%rax");
+    }
+  else
+    {
+      ENSURE_DESTINATION_REGISTER_UNI (dst->loc);
+      if (copy)
+	{
+	  ENSURE_DESTINATION_REGISTER_UNI (src->loc);
+	  gen_code_unrolled_copy (print_loc (dst->loc), print_loc (src->loc),
+				  n);
+	}
+      else
+	{
+	  /* Spread the byte over all of %rax. */
+	  if (src->type == integer_type && !src->boolean_not)
+	    {
+	      char *v = my_printf ("$%lld", (long long)
+				   ((src->op.integer.i & 0xff)
+				    * 0x0101010101010101ull));
+	      EMIT2 ("mov", v, "%rax");
+	      FREE (v);
+	    }
+	  else
+	    {
+	      EMIT2 ("mov", print_loc (src->loc), "%rax");
+	      EMIT2 ("and", "$255", "%rax");
+	      EMIT2 ("mov", "$0x0101010101010101", "%rcx");
+	      EMIT2 ("imul", "%rcx", "%rax");
+	    }
+	  gen_code_unrolled_set (print_loc (dst->loc), n);
+	}
+      EMIT2 ("mov", print_loc (dst->loc), "%rax");
+    }
+  FREE_LOC (s->ops[0]->loc);
+  FREE_LOC (len->loc);
+  FREE_LOC (src->loc);
+  FREE_LOC (dst->loc);
+  MAKE_BASE_LOC (s->loc, register_loc, xstrdup ("%rax"));
+  GIVE_REGISTER (s->loc);
+  return 1;
+}
 
+/** 
+ * Name the vector register number @c k, which is a 32-byte ymm
+ * register if @c wide is true and a 16-byte xmm register otherwise.
+ * 
+ */
+static char *
+vector_reg (int k, int wide)
+{
+  return my_printf ("%%%cmm%d", wide ? 'y' : 'x', k);
+}
+
+/** 
+ * Emit the vector instruction @c insn that combines the operand @c a
+ * into the register @c b.  With AVX2 its three operand form is used
+ * instead, so that the legacy encoding isn't mixed with the VEX one.
+ * 
+ */
+static void
+emit_vector (const char *insn, const char *a, const char *b)
+{
+  if (target_avx2)
+    {
+      char *v = my_printf ("v%s", insn);
+      EMIT3 (v, a, b, b);
+      FREE (v);
+    }
+  else
+    EMIT2 (insn, a, b);
+}
+
+/** 
+ * Apply the operator @c op to each element of the vector registers
+ * number @c x and @c y, leaving the results in @c x.  The registers
+ * number 2 and 3 are used for the minimum and maximum, which are only
+ * available with AVX2.
+ * 
+ */
+static void
+gen_code_vector_op (int op, int x, int y, int wide)
+{
+  char *a = vector_reg (x, wide), *b = vector_reg (y, wide);
+  switch (op)
+    {
+    case '+':
+      emit_vector ("paddq", b, a);
+      break;
+    case '-':
+      emit_vector ("psubq", b, a);
+      break;
+    case '&':
+      emit_vector ("pand", b, a);
+      break;
+    case '|':
+      emit_vector ("por", b, a);
+      break;
+    case '^':
+      emit_vector ("pxor", b, a);
+      break;
+    case MIN:
+    case MAX:
+      {
+	/* With m = (x ^ y) & (x > y), the minimum is x ^ m and the
+	   maximum is y ^ m. */
+	assert (target_avx2);
+	char *m = vector_reg (2, wide), *d = vector_reg (3, wide);
+	EMIT3 ("vpcmpgtq", b, a, m);
+	EMIT3 ("vpxor", b, a, d);
+	EMIT3 ("vpand", d, m, m);
+	EMIT3 ("vpxor", m, op == MIN ? a : b, a);
+	FREE (d);
+	FREE (m);
+      }
+      break;
+    default:
+      assert (0);
+    }
+  FREE (b);
+  FREE (a);
+}
+
+/** 
+ * Start a loop over the vectors of @c n elements, with %rax counting
+ * the elements that have been done.
+ * 
+ * @param done Where to store the label after the loop.
+ * 
+ * @return The label of the top of the loop.
+ */
+static char *
+gen_code_vector_loop (const char *n, char **done)
+{
+  *done = branch_label ();
+  char *top = branch_label ();
+  EMIT2 ("xor", "%rax", "%rax");
+  EMIT2 ("cmp", n, "%rax");
+  EMIT1 ("jae", *done);
+  EMIT_LABEL (top);
+  return top;
+}
+
+/** 
+ * End the loop that @c gen_code_vector_loop started.
+ * 
+ */
+static void
+gen_code_vector_loop_end (const char *n, char *top, char *done)
+{
+  EMIT2 ("add", target_avx2 ? "$4" : "$2", "%rax");
+  EMIT2 ("cmp", n, "%rax");
+  EMIT1 ("jb", top);
+  EMIT_LABEL (done);
+  FREE (top);
+  FREE (done);
+}
+
+/** 
+ * Load the vector of the elements at %rax of the array that the
+ * register @c base points to into the vector register number @c k,
+ * or store it there if @c store is true.
+ * 
+ */
+static void
+gen_code_vector_move (const char *base, int k, int store)
+{
+  char *m = my_printf ("(%s,%%rax,8)", base);
+  char *r = vector_reg (k, target_avx2);
+  const char *op = target_avx2 ? "vmovdqu" : "movdqu";
+  if (store)
+    EMIT2 (op, r, m);
+  else
+    EMIT2 (op, m, r);
+  FREE (r);
+  FREE (m);
+}
+
+/** 
+ * Copy the value at the location of @c s into every element of the
+ * vector register number @c k.
+ * 
+ */
+static void
+gen_code_vector_splat (struct ast *s, int k)
+{
+  char *x = vector_reg (k, 0), *r = vector_reg (k, target_avx2);
+  if (IS_LITERAL (s->loc))
+    {
+      EMIT2 ("mov", print_loc (s->loc), "%rax");
+      EMIT2 ("movq", "%rax", x);
+    }
+  else
+    EMIT2 ("movq", print_loc (s->loc), x);
+  if (target_avx2)
+    EMIT2 ("vpbroadcastq", x, r);
+  else
+    EMIT2 ("punpcklqdq", x, x);
+  FREE (r);
+  FREE (x);
+}
+
+/** 
+ * Expand a call of one of the builtins that the loop vectorizer
+ * makes into a loop over vectors:
+ *
+ * - __builtin_vector_map (op, dst, a, b, n) stores a[k] op b[k] into
+ *   dst[k] for each k less than n.
+ * - __builtin_vector_map_scalar (op, dst, a, v, n) stores a[k] op v
+ *   into dst[k].
+ * - __builtin_vector_reduce (op, a, n, v) returns v op a[0] op ... op
+ *   a[n - 1].
+ *
+ * The number of elements is a multiple of the number in a vector,
+ * which is four with AVX2 and two otherwise.
+ * 
+ * @param s The function call.
+ * 
+ * @return true if the call was expanded, false otherwise.
+ */
+static int
+gen_code_vector_call (struct ast *s)
+{
+  const char *name = s->ops[0]->op.variable.name;
+  int map = STREQ (name, BUILTIN (vector_map));
+  int scalar = STREQ (name, BUILTIN (vector_map_scalar));
+  if (!map && !scalar && STRNEQ (name, BUILTIN (vector_reduce)))
+    return 0;
+  struct ast *args[5], *t;
+  int nargs = 0;
+  for (t = s->ops[1]; t != NULL && nargs < 5; t = t->next)
+    {
+      if (t->type == block_type)
+	return 0;
+      args[nargs++] = t;
+    }
+  if (t != NULL || nargs != (map || scalar ? 5 : 4)
+      || args[0]->type != integer_type)
+    return 0;
+
+  gen_code_r (s->ops[1]);
+  int op = args[0]->op.integer.i, wide = target_avx2, k;
+  char *top, *done;
+  if (map || scalar)
+    {
+      struct ast *dst = args[1], *src = args[2], *other = args[3];
+      ENSURE_DESTINATION_REGISTER_UNI (dst->loc);
+      ENSURE_DESTINATION_REGISTER_UNI (src->loc);
+      if (map)
+	ENSURE_DESTINATION_REGISTER_UNI (other->loc);
+      else if (op != LS && op != RS)
+	gen_code_vector_splat (other, 15);
+      const char *n = print_loc (args[4]->loc);
+      top = gen_code_vector_loop (n, &done);
+      gen_code_vector_move (src->loc->base, 0, 0);
+      if (map)
+	{
+	  gen_code_vector_move (other->loc->base, 1, 0);
+	  gen_code_vector_op (op, 0, 1, wide);
+	}
+      else if (op == LS || op == RS)
+	{
+	  char *r = vector_reg (0, wide);
+	  emit_vector (op == LS ? "psllq" : "psrlq", print_loc (other->loc),
+		       r);
+	  FREE (r);
+	}
+      else
+	gen_code_vector_op (op, 0, 15, wide);
+      gen_code_vector_move (dst->loc->base, 0, 1);
+      gen_code_vector_loop_end (n, top, done);
+    }
+  else
+    {
+      struct ast *src = args[1], *init = args[3];
+      ENSURE_DESTINATION_REGISTER_UNI (src->loc);
+      ENSURE_DESTINATION_REGISTER_UNI (init->loc);
+      char *v = vector_reg (0, wide);
+      /* The partial results start out as the identity of the
+	 operator, or as the initial value for the minimum and maximum
+	 since taking it again doesn't change them. */
+      if (op == MIN || op == MAX)
+	gen_code_vector_splat (init, 0);
+      else
+	emit_vector (op == '&' ? "pcmpeqd" : "pxor", v, v);
+      FREE (v);
+      const char *n = print_loc (args[2]->loc);
+      top = gen_code_vector_loop (n, &done);
+      gen_code_vector_move (src->loc->base, 1, 0);
+      gen_code_vector_op (op, 0, 1, wide);
+      gen_code_vector_loop_end (n, top, done);
+
+      /* Fold the halves of the vector together until one element is
+	 left. */
+      if (wide)
+	{
+	  EMIT3 ("vextracti128", "$1", "%ymm0", "%xmm1");
+	  gen_code_vector_op (op, 0, 1, 0);
+	}
+      EMIT3 (wide ? "vpshufd" : "pshufd", "$0x4e", "%xmm0", "%xmm1");
+      gen_code_vector_op (op, 0, 1, 0);
+      EMIT2 (wide ? "vmovq" : "movq", "%xmm0", "%rax");
+      if (op != MIN && op != MAX)
+	EMIT2 (op == '+' ? "add" : op == '&' ? "and" : op == '|' ? "or"
+	       : "xor", print_loc (init->loc), "%rax");
+    }
+  if (wide)
+    EMIT0 ("vzeroupper");
+
+  FREE_LOC (s->ops[0]->loc);
+  for (k = 0; k < nargs; k++)
+    FREE_LOC (args[k]->loc);
+  MAKE_BASE_LOC (s->loc, register_loc, xstrdup ("%rax"));
+  GIVE_REGISTER (s->loc);
+  return 1;
+}
+
+/** 
+ * Generate code for a function call.
+ * 
+ * @param s The AST to parse.
+ */
+static void
+gen_code_function_call (struct ast *s)
+{
+  if (gen_code_string_call (s) || gen_code_vector_call (s))
+    return;
+  gen_code_call_args (s);
   EMIT2 ("mov", "$0", "%rax"); /* Needed for printf. */
   EMIT1 ("call", s->ops[0]->loc->base);
   FREE_LOC (s->ops[0]->loc);
@@ -678,6 +2028,7 @@ gen_code_function_call (struct ast *s)
 static void
 gen_code_r (struct ast *s)
 {
+  struct ast *t;
   if (s == NULL)
     return;
   switch (s->type)
@@ -691,7 +2042,11 @@ gen_code_r (struct ast *s)
       break;
 
     case cond_type:
-      gen_code_cond (s);
+      t = gen_code_switch (s);
+      if (t != NULL)
+	s = t;
+      else
+	gen_code_cond (s);
       break;
 
     case label_type:
@@ -740,6 +2095,15 @@ gen_code_r (struct ast *s)
 	}
       break;
 
+    case stack_type:
+      /* The arrays that this was for might have been given a fixed
+	 place in the frame. */
+      if (stack_moves && s->op.stack.restore)
+	EMIT2 ("mov", print_loc (s->loc), "%rsp");
+      else if (stack_moves)
+	EMIT2 ("mov", "%rsp", print_loc (s->loc));
+      break;
+
     case ternary_type:
       gen_code_ternary (s);
       break;
@@ -767,6 +2131,7 @@ gen_code (struct ast *s)
   avail = 0;
   str_labelno = 0;
   FREE (data_section);
+  FREE (rodata_section);
   branch_labelno = 0;
 
   /* Set up branch codes. */
@@ -778,7 +2143,13 @@ gen_code (struct ast *s)
 
   data_section = xstrdup ("\t.data\n");
   gen_code_r (s);
+  asm_flush (outfile);
+  if (peephole_stats)
+    peephole_print_stats (stderr);
   PUT ("%s", data_section);
   FREE (data_section);
+  if (rodata_section != NULL)
+    PUT ("%s", rodata_section);
+  FREE (rodata_section);
   return 0;
 }
@@ -0,0 +1,743 @@
+/**
+ * @file   gvn.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief  Value numbering and common subexpression elimination.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Each function is lowered into the IR and put into SSA form.  Every
+ * value is then given a number from a hash table keyed on its
+ * operator and the numbers of its operands, so that two instructions
+ * computing the same value get the same number.  Loads are keyed on
+ * the state of memory too, which changes at every store through a
+ * pointer, store to a variable whose address is taken, and call.  At
+ * -O1 the table is emptied at the start of every basic block, while
+ * at -O2 it is scoped over the dominator tree so that a value
+ * computed in a block is reused in all the blocks it dominates.
+ *
+ * The results are written back into the AST.  The first expression
+ * computing a value that is needed again saves it in a new stack
+ * slot, and the later ones are replaced by a read of that slot.  Only
+ * expressions that are more expensive than such a read are
+ * considered.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "compiler.h"
+#include "free.h"
+#include "ir.h"
+#include "lib.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The kinds of values that don't come from an instruction.
+ *
+ */
+enum leaf_code {
+  leaf_imm = -1,		/**< An immediate. */
+  leaf_slot = -2,		/**< The value of a slot on entry. */
+  leaf_symbol = -3,		/**< The address of a symbol. */
+  leaf_string = -4		/**< The address of a string. */
+};
+
+/**
+ * An entry in the value table.
+ *
+ */
+struct value
+{
+  int code;			/**< The ir_code or leaf_code. */
+  int op;			/**< The operator. */
+  long long a;			/**< The first operand's number or the
+				   leaf's value. */
+  long long b;			/**< The second operand's number. */
+  long long c;			/**< The third operand's number, or
+				   the state of memory. */
+  const char *sym;		/**< The symbol of a leaf. */
+  int number;			/**< The value number. */
+  int leader;			/**< The instruction whose AST can be
+				   reused, or -1. */
+  size_t hash;			/**< The hash of the key. */
+  int prev;			/**< The previous entry in the same
+				   bucket. */
+};
+
+static struct ir_func *f = NULL; /**< The function being numbered. */
+static struct value *table = NULL; /**< The entries, innermost scope
+				      last. */
+static size_t ntable = 0;	/**< Number of entries. */
+static size_t atable = 0;	/**< Allocated entries. */
+static size_t floor_entry = 0;	/**< Entries before this one are out
+				   of scope. */
+static int *buckets = NULL;	/**< The newest entry of each
+				   bucket. */
+static size_t nbuckets = 0;	/**< Number of buckets, a power of
+				   two. */
+static int *numbers = NULL;	/**< The value number of each
+				   register. */
+static int nnumbers = 0;	/**< Number of value numbers handed
+				   out. */
+static int memory = 0;		/**< The current state of memory. */
+static int *leader_of = NULL;	/**< The leader that each instruction
+				   can reuse, or -1. */
+static char *clobbers = NULL;	/**< Which blocks change memory. */
+
+/**
+ * Hash the key of the entry @c v.
+ *
+ */
+static size_t
+hash_value (const struct value *v)
+{
+  size_t h = v->code * 31 + v->op;
+  h = h * 1000003 + (size_t) v->a;
+  h = h * 1000003 + (size_t) v->b;
+  h = h * 1000003 + (size_t) v->c;
+  if (v->sym != NULL)
+    {
+      const char *p;
+      for (p = v->sym; *p != '\0'; p++)
+	h = h * 31 + (unsigned char) *p;
+    }
+  return h;
+}
+
+/**
+ * Test if the entries @c x and @c y have the same key.
+ *
+ */
+static int
+same_key (const struct value *x, const struct value *y)
+{
+  return (x->hash == y->hash && x->code == y->code && x->op == y->op
+	  && x->a == y->a && x->b == y->b && x->c == y->c
+	  && (x->sym == y->sym
+	      || (x->sym != NULL && y->sym != NULL && STREQ (x->sym, y->sym))));
+}
+
+/**
+ * Find the entry in scope with the same key as @c key.
+ *
+ * @return The entry, or NULL if there is none.
+ */
+static struct value *
+lookup (struct value *key)
+{
+  key->hash = hash_value (key);
+  int e;
+  for (e = buckets[key->hash & (nbuckets - 1)];
+       e >= 0 && (size_t) e >= floor_entry; e = table[e].prev)
+    if (same_key (&table[e], key))
+      return &table[e];
+  return NULL;
+}
+
+/**
+ * Enter @c key into the innermost scope, shadowing any entry with the
+ * same key.
+ *
+ */
+static void
+insert (const struct value *key)
+{
+  if (ntable == atable)
+    table = x2nrealloc (table, &atable, sizeof *table);
+  size_t b = key->hash & (nbuckets - 1);
+  table[ntable] = *key;
+  table[ntable].prev = buckets[b];
+  buckets[b] = ntable++;
+}
+
+/**
+ * Leave every scope that was entered after @c mark.
+ *
+ */
+static void
+pop_scope (size_t mark)
+{
+  while (ntable > mark)
+    {
+      ntable--;
+      buckets[table[ntable].hash & (nbuckets - 1)] = table[ntable].prev;
+    }
+}
+
+/**
+ * Get the value number of a leaf.
+ *
+ */
+static int
+number_leaf (int code, long long a, const char *sym)
+{
+  struct value key = { code, 0, a, 0, 0, sym, 0, -1, 0, -1 };
+  struct value *v = lookup (&key);
+  if (v != NULL)
+    return v->number;
+  key.number = nnumbers++;
+  insert (&key);
+  return key.number;
+}
+
+/**
+ * Get the value number of the operand @c o.
+ *
+ */
+static long long
+number_operand (const struct ir_operand *o)
+{
+  switch (o->kind)
+    {
+    case ir_vreg:
+      assert (numbers[o->val] >= 0);
+      return numbers[o->val];
+    case ir_imm:
+      return number_leaf (leaf_imm, o->val, NULL);
+    case ir_slot:
+      return number_leaf (leaf_slot, o->val, NULL);
+    case ir_symbol:
+      return number_leaf (leaf_symbol, 0, o->sym);
+    case ir_string:
+      return number_leaf (leaf_string, 0, o->sym);
+    default:
+      return -1;
+    }
+}
+
+/**
+ * Test if the operator @c op is commutative.
+ *
+ */
+static int
+commutative (int op)
+{
+  switch (op)
+    {
+    case '+':
+    case '*':
+    case '&':
+    case '|':
+    case '^':
+    case EQ:
+    case NE:
+      return 1;
+    default:
+      return 0;
+    }
+}
+
+/**
+ * Test if the AST of the instruction @c i is worth saving in a stack
+ * slot to reuse.
+ *
+ */
+static int
+reusable (const struct ir_insn *i)
+{
+  return ir_defines_origin (i) && ast_cost (i->origin) >= 3;
+}
+
+/**
+ * Number the instructions of block @c b.
+ *
+ */
+static void
+number_block (int b)
+{
+  struct ir_block *bb = &f->blocks[b];
+  size_t p;
+  for (p = bb->phi_first; p < bb->phi_first + bb->phi_count; p++)
+    numbers[f->phis[p].dest] = nnumbers++;
+
+  struct ir_insn *i;
+  IR_FOR_INSNS (i, f, b)
+    {
+      if (ir_clobbers_memory (i))
+	memory = nnumbers++;
+      if (i->dest < 0)
+	continue;
+      if (i->code == ir_copy)
+	{
+	  numbers[i->dest] = number_operand (&i->a);
+	  continue;
+	}
+
+      struct value key = { i->code, i->op, -1, -1, -1, NULL, 0, -1, 0, -1 };
+      switch (i->code)
+	{
+	case ir_load:
+	case ir_addr:
+	  key.a = i->a.val;
+	  key.c = i->code == ir_load ? memory : -1;
+	  break;
+
+	case ir_loadm:
+	  key.a = number_operand (&i->a);
+	  key.c = memory;
+	  break;
+
+	case ir_index:
+	case ir_binary:
+	case ir_unary:
+	case ir_select:
+	  key.a = number_operand (&i->a);
+	  key.b = number_operand (&i->b);
+	  key.c = number_operand (&i->c);
+	  if (i->code == ir_binary && commutative (i->op) && key.a > key.b)
+	    {
+	      long long t = key.a;
+	      key.a = key.b;
+	      key.b = t;
+	    }
+	  break;
+
+	default:
+	  /* Calls and allocations always give new values. */
+	  numbers[i->dest] = nnumbers++;
+	  continue;
+	}
+
+      int here = i - f->insns;
+      struct value *v = lookup (&key);
+      if (v != NULL)
+	{
+	  numbers[i->dest] = v->number;
+	  if (v->leader >= 0)
+	    leader_of[here] = v->leader;
+	  else if (reusable (i))
+	    {
+	      /* Nothing before this can be reused, so it becomes the
+		 one that the rest reuse. */
+	      key.number = v->number;
+	      key.leader = here;
+	      insert (&key);
+	    }
+	}
+      else
+	{
+	  key.number = numbers[i->dest] = nnumbers++;
+	  key.leader = reusable (i) ? here : -1;
+	  insert (&key);
+	}
+    }
+}
+
+/**
+ * Test if memory can change on the way from the end of block @c d to
+ * the start of block @c b, which it dominates.
+ *
+ * @param seen Scratch space for every block.
+ * @param stack Scratch space for every block.
+ */
+static int
+clobbered_between (int d, int b, char *seen, int *stack)
+{
+  /* Find the blocks that can be reached from d without going through
+     it again. */
+  size_t n = 0, x;
+  int k;
+  memset (seen, 0, f->nblocks);
+  for (k = 0; k < 2; k++)
+    if (f->blocks[d].succ[k] >= 0 && f->blocks[d].succ[k] != d
+	&& !seen[f->blocks[d].succ[k]])
+      {
+	seen[f->blocks[d].succ[k]] = 1;
+	stack[n++] = f->blocks[d].succ[k];
+      }
+  while (n > 0)
+    {
+      int c = stack[--n];
+      for (k = 0; k < 2; k++)
+	{
+	  int s = f->blocks[c].succ[k];
+	  if (s >= 0 && s != d && !seen[s])
+	    {
+	      seen[s] = 1;
+	      stack[n++] = s;
+	    }
+	}
+    }
+
+  /* Of those, any that can reach b without going through d lie on a
+     path between them. */
+  for (k = 0; k < f->blocks[b].npreds; k++)
+    {
+      int p = f->blocks[b].preds[k];
+      if (p != d && seen[p] == 1)
+	{
+	  seen[p] = 2;
+	  stack[n++] = p;
+	}
+    }
+  while (n > 0)
+    {
+      int c = stack[--n];
+      if (clobbers[c])
+	return 1;
+      for (x = 0; x < (size_t) f->blocks[c].npreds; x++)
+	{
+	  int p = f->blocks[c].preds[x];
+	  if (p != d && seen[p] == 1)
+	    {
+	      seen[p] = 2;
+	      stack[n++] = p;
+	    }
+	}
+    }
+  return 0;
+}
+
+/**
+ * Number block @c b and then every block that it dominates.
+ *
+ * @param children The dominator tree, as a list of first children.
+ * @param sibling The next sibling of each block in the dominator tree.
+ * @param seen Scratch space for clobbered_between.
+ * @param stack Scratch space for clobbered_between.
+ */
+static void
+number_tree (int b, const int *children, const int *sibling, char *seen,
+	     int *stack)
+{
+  size_t mark = ntable, old_floor = floor_entry;
+  int old_memory = memory;
+  if (optimize < 2)
+    floor_entry = ntable;
+  if (optimize < 2 || b == 0
+      || clobbered_between (f->blocks[b].idom, b, seen, stack))
+    memory = nnumbers++;
+
+  number_block (b);
+
+  int c;
+  for (c = children[b]; c >= 0; c = sibling[c])
+    number_tree (c, children, sibling, seen, stack);
+
+  pop_scope (mark);
+  floor_entry = old_floor;
+  memory = old_memory;
+}
+
+/**
+ * The role of an AST in the rewrite.
+ *
+ */
+struct rewrite
+{
+  struct ast *node;		/**< The AST. */
+  int group;			/**< The leader it belongs to. */
+  int leader;			/**< Whether this is the leader. */
+  int active;			/**< Whether this reuse will be made. */
+};
+
+/**
+ * An AST whose value is reused, and the slot that it is saved in.
+ *
+ */
+struct group
+{
+  struct ast *temp;		/**< The variable holding the value. */
+  int uses;			/**< Number of reuses that will be
+				   made. */
+  int hidden;			/**< Whether the leader is inside an
+				   AST that is being reused. */
+};
+
+static struct rewrite *rewrites = NULL; /**< The rewrites, sorted by
+					   node. */
+static size_t nrewrites = 0;	/**< Number of rewrites. */
+static size_t arewrites = 0;	/**< Allocated rewrites. */
+static struct group *groups = NULL; /**< The leaders. */
+static size_t ngroups = 0;	/**< Number of leaders. */
+static size_t agroups = 0;	/**< Allocated leaders. */
+
+static int
+compare_rewrite (const void *a, const void *b)
+{
+  uintptr_t x = (uintptr_t) ((const struct rewrite *) a)->node;
+  uintptr_t y = (uintptr_t) ((const struct rewrite *) b)->node;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Find the rewrite of @c s.
+ *
+ * @return The rewrite, or NULL if @c s is left alone.
+ */
+static struct rewrite *
+find_rewrite (struct ast *s)
+{
+  struct rewrite key = { s, 0, 0, 0 };
+  return bsearch (&key, rewrites, nrewrites, sizeof *rewrites,
+		  compare_rewrite);
+}
+
+/**
+ * Queue a rewrite of @c node.
+ *
+ */
+static void
+add_rewrite (struct ast *node, int group, int leader)
+{
+  if (nrewrites == arewrites)
+    rewrites = x2nrealloc (rewrites, &arewrites, sizeof *rewrites);
+  rewrites[nrewrites].node = node;
+  rewrites[nrewrites].group = group;
+  rewrites[nrewrites].leader = leader;
+  rewrites[nrewrites].active = !leader;
+  nrewrites++;
+}
+
+/**
+ * Collect the rewrites from the value numbers.
+ *
+ */
+static void
+collect_rewrites (void)
+{
+  int *group_of = xnmalloc (f->ninsns + 1, sizeof *group_of);
+  size_t n;
+  for (n = 0; n < f->ninsns; n++)
+    group_of[n] = -1;
+  for (n = 0; n < f->ninsns; n++)
+    {
+      int l = leader_of[n];
+      if (l < 0 || !reusable (&f->insns[n]))
+	continue;
+      if (group_of[l] < 0)
+	{
+	  if (ngroups == agroups)
+	    groups = x2nrealloc (groups, &agroups, sizeof *groups);
+	  groups[ngroups].temp = NULL;
+	  groups[ngroups].uses = 0;
+	  groups[ngroups].hidden = 0;
+	  group_of[l] = ngroups++;
+	  add_rewrite (f->insns[l].origin, group_of[l], 1);
+	}
+      add_rewrite (f->insns[n].origin, group_of[l], 0);
+    }
+  FREE (group_of);
+  qsort (rewrites, nrewrites, sizeof *rewrites, compare_rewrite);
+}
+
+/**
+ * Count the reuses that will be made and find the leaders that lie
+ * inside of an AST that won't be evaluated any more.
+ *
+ * @param s The AST to check.
+ * @param inside Whether @c s is inside a reuse.
+ */
+static void
+find_hidden_r (struct ast *s, int inside)
+{
+  for (; s != NULL; s = s->next)
+    {
+      struct rewrite *r = find_rewrite (s);
+      int in = inside;
+      if (r != NULL && r->leader && inside)
+	groups[r->group].hidden = 1;
+      else if (r != NULL && r->active && !inside)
+	{
+	  groups[r->group].uses++;
+	  in = 1;
+	}
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	find_hidden_r (s->ops[i], in);
+    }
+}
+
+/**
+ * Drop the reuses of every leader that won't be evaluated, until the
+ * remaining ones are consistent.
+ *
+ */
+static void
+find_hidden (struct ast *body)
+{
+  int changed = 1;
+  while (changed)
+    {
+      size_t g, n;
+      for (g = 0; g < ngroups; g++)
+	groups[g].uses = groups[g].hidden = 0;
+      find_hidden_r (body, 0);
+      changed = 0;
+      for (n = 0; n < nrewrites; n++)
+	if (rewrites[n].active && groups[rewrites[n].group].hidden)
+	  {
+	    rewrites[n].active = 0;
+	    changed = 1;
+	  }
+    }
+}
+
+/**
+ * Apply the collected rewrites to the AST.
+ *
+ * @param ss Reference to an AST pointer.
+ */
+static void
+rewrite_r (struct ast **ss)
+{
+  assert (ss != NULL);
+#define s (*ss)
+  if (s == NULL)
+    return;
+  struct rewrite *r = find_rewrite (s);
+  struct group *g = r != NULL ? &groups[r->group] : NULL;
+  if (r != NULL && r->active)
+    {
+      struct ast *t = ast_dup (g->temp);
+      t->throw_away = s->throw_away;
+      t->noreturnint = s->noreturnint;
+      SWAP_AST (t, s);
+      AST_FREE (t);
+    }
+  else
+    {
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	rewrite_r (&s->ops[i]);
+      if (r != NULL && r->leader && g->uses > 0 && !g->hidden)
+	{
+	  struct ast *t = s, *n = s->next;
+	  t->next = NULL;
+	  s = make_binary ('=', ast_dup (g->temp), t);
+	  s->next = n;
+	  s->noreturnint = t->noreturnint;
+	  t->noreturnint = 0;
+	}
+    }
+  rewrite_r (&s->next);
+#undef s
+}
+
+/**
+ * Give every leader that is reused its slot.  This is done before any
+ * rewrite is made since it adds to the allocation at the start of the
+ * function.
+ *
+ */
+static void
+make_temporaries (struct ast *function)
+{
+  size_t g;
+  for (g = 0; g < ngroups; g++)
+    if (groups[g].uses > 0 && !groups[g].hidden)
+      groups[g].temp = make_temporary (function);
+}
+
+/**
+ * Number the values of the function @c s and reuse the redundant
+ * ones.
+ *
+ */
+static void
+gvn_function (struct ast *s)
+{
+  f = ir_lower (s);
+  ir_build_ssa (f);
+
+  size_t b, n;
+  nbuckets = 64;
+  while (nbuckets < 2 * f->ninsns)
+    nbuckets *= 2;
+  buckets = xnmalloc (nbuckets, sizeof *buckets);
+  for (n = 0; n < nbuckets; n++)
+    buckets[n] = -1;
+  numbers = xnmalloc (f->nvregs + 1, sizeof *numbers);
+  for (n = 0; n < (size_t) f->nvregs; n++)
+    numbers[n] = -1;
+  leader_of = xnmalloc (f->ninsns + 1, sizeof *leader_of);
+  for (n = 0; n < f->ninsns; n++)
+    leader_of[n] = -1;
+  clobbers = xzalloc (f->nblocks + 1);
+  for (b = 0; b < f->nblocks; b++)
+    {
+      struct ir_insn *i;
+      IR_FOR_INSNS (i, f, b)
+	if (ir_clobbers_memory (i))
+	  clobbers[b] = 1;
+    }
+
+  int *children = xnmalloc (f->nblocks + 1, sizeof *children);
+  int *sibling = xnmalloc (f->nblocks + 1, sizeof *sibling);
+  for (b = 0; b < f->nblocks; b++)
+    children[b] = sibling[b] = -1;
+  for (b = f->nblocks; b-- > 1;)
+    {
+      int d = f->blocks[b].idom;
+      if (d >= 0)
+	{
+	  sibling[b] = children[d];
+	  children[d] = b;
+	}
+    }
+  char *seen = xzalloc (f->nblocks + 1);
+  int *stack = xnmalloc (f->nblocks + 1, sizeof *stack);
+  nnumbers = 0;
+  floor_entry = 0;
+  if (f->nblocks > 0)
+    number_tree (0, children, sibling, seen, stack);
+  FREE (stack);
+  FREE (seen);
+  FREE (sibling);
+  FREE (children);
+
+  collect_rewrites ();
+  find_hidden (s->ops[1]);
+  make_temporaries (s);
+  rewrite_r (&s->ops[1]);
+
+  for (n = 0; n < ngroups; n++)
+    AST_FREE (groups[n].temp);
+  FREE (groups);
+  ngroups = agroups = 0;
+  FREE (rewrites);
+  nrewrites = arewrites = 0;
+  FREE (table);
+  ntable = atable = 0;
+  FREE (buckets);
+  FREE (clobbers);
+  FREE (leader_of);
+  FREE (numbers);
+  f = ir_free (f);
+}
+
+int
+number_values (struct ast *s)
+{
+  if (optimize < 1)
+    return 0;
+  for (; s != NULL; s = s->next)
+    if (s->type == function_type)
+      gvn_function (s);
+  return 0;
+}
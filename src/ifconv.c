@@ -0,0 +1,253 @@
+/**
+ * @file   ifconv.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief  If-conversion of small branches into conditional moves.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Once the control flow has been simplified, an if statement that
+ * assigns the same variable in both of its arms is a branch around
+ * two moves:
+ *
+ *     cond (else, c);
+ *     x = a;
+ *     jump (end);
+ *   else:
+ *     x = b;
+ *   end:
+ *
+ * becomes
+ *
+ *     x = c ? b : a;
+ *
+ * which the code generator turns into a cmov.  An if without an else
+ * becomes x = c ? x : a, and a branch between two returns becomes the
+ * return of a ternary.  Both values are computed every time, so this
+ * is only done when they can't trap, nothing has side effects and
+ * computing them is cheaper than a mispredicted branch.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "loc.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+/** The most that the values of a converted branch may cost
+    together. */
+#define BRANCH_COST 6
+
+/**
+ * Count the branches in @c s to the label @c label.
+ *
+ */
+static int
+refs (const struct ast *s, const char *label)
+{
+  int n = 0;
+  for (; s != NULL; s = s->next)
+    {
+      if ((s->type == cond_type || s->type == jump_type)
+	  && STREQ (ast_label_name (s), label))
+	n++;
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	n += refs (s->ops[i], label);
+    }
+  return n;
+}
+
+/**
+ * Test if @c s is the label that the branch @c branch goes to.
+ *
+ */
+static int
+is_target (const struct ast *s, const struct ast *branch)
+{
+  return s != NULL && s->type == label_type
+    && STREQ (ast_label_name (s), ast_label_name (branch));
+}
+
+/**
+ * Test if @c s is the label that the branch @c branch goes to, and
+ * nothing else in @c body goes there.
+ *
+ */
+static int
+only_target (const struct ast *s, const struct ast *branch,
+	     const struct ast *body)
+{
+  return is_target (s, branch) && refs (body, ast_label_name (s)) == 1;
+}
+
+/**
+ * Test if @c s can be computed whether or not it is needed.
+ *
+ */
+static int
+movable (const struct ast *s)
+{
+  return s != NULL && !ast_has_side_effects (s) && !ast_can_trap (s);
+}
+
+/**
+ * Get the variable that the statement @c s assigns a movable value
+ * to.
+ *
+ * @return The variable, or NULL if @c s is something else.
+ */
+static struct ast *
+assigned (const struct ast *s)
+{
+  if (s == NULL || s->type != binary_type || s->op.binary.op != '='
+      || !s->throw_away || !movable (s->ops[1]))
+    return NULL;
+  struct ast *v = s->ops[0];
+  if (v->type != variable_type || v->op.variable.type != NULL
+      || !IS_MEMORY (v->loc) || v->loc->index != NULL)
+    return NULL;
+  return v;
+}
+
+/**
+ * Test if @c a and @c b are the same variable.
+ *
+ */
+static int
+same_variable (const struct ast *a, const struct ast *b)
+{
+  return a->loc->offset == b->loc->offset
+    && STREQ (a->loc->base, b->loc->base);
+}
+
+/**
+ * Delete the statement at @c link.
+ *
+ */
+static void
+unlink_stmt (struct ast **link)
+{
+  struct ast *t = *link;
+  *link = t->next;
+  t->next = NULL;
+  AST_FREE (t);
+}
+
+/**
+ * Convert the branch at @c link if it is one of the shapes that can
+ * be converted.
+ *
+ * @param link The link to the cond.
+ * @param body The body of the function.
+ *
+ * @return true if anything changed, false otherwise.
+ */
+static int
+convert (struct ast **link, const struct ast *body)
+{
+  struct ast *c = *link;
+  if (c->type != cond_type || ast_has_side_effects (c->ops[0]))
+    return 0;
+  struct ast *t1 = c->next, *t2 = t1 == NULL ? NULL : t1->next;
+  struct ast *t3 = t2 == NULL ? NULL : t2->next;
+  struct ast *x = assigned (t1), *value = NULL;
+
+  if (x != NULL && t2 != NULL && t2->type == jump_type
+      && only_target (t3, c, body) && assigned (t3->next) != NULL
+      && same_variable (x, assigned (t3->next))
+      && is_target (t3->next->next, t2)
+      && ast_cost (t1->ops[1]) + ast_cost (t3->next->ops[1]) <= BRANCH_COST)
+    {
+      /* The diamond of an if with an else.  The label at the end
+	 stays if other branches go there too. */
+      struct ast *t4 = t3->next;
+      value = make_ternary (c->ops[0], t4->ops[1], t1->ops[1]);
+      t4->ops[1] = NULL;
+      unlink_stmt (&t3->next);
+      if (only_target (t3->next, t2, body))
+	unlink_stmt (&t3->next);
+      unlink_stmt (&t2->next);
+      unlink_stmt (&t1->next);
+    }
+  else if (x != NULL && only_target (t2, c, body)
+	   && ast_cost (t1->ops[1]) + 1 <= BRANCH_COST)
+    {
+      /* An if without an else keeps the old value otherwise. */
+      value = make_ternary (c->ops[0], ast_dup (x), t1->ops[1]);
+      unlink_stmt (&t1->next);
+    }
+  else if (t1 != NULL && t1->type == ret_type && movable (t1->ops[0])
+	   && only_target (t2, c, body) && t2->next != NULL
+	   && t2->next->type == ret_type && movable (t2->next->ops[0])
+	   && (ast_cost (t1->ops[0]) + ast_cost (t2->next->ops[0])
+	       <= BRANCH_COST))
+    {
+      /* A branch between two returns. */
+      struct ast *r = t2->next;
+      value = make_ternary (c->ops[0], r->ops[0], t1->ops[0]);
+      r->ops[0] = NULL;
+      unlink_stmt (&t2->next);
+      unlink_stmt (&t1->next);
+    }
+  else
+    return 0;
+
+  /* The ternary might be one of the idioms that the optimizer knows
+     a better instruction for. */
+  c->ops[0] = NULL;
+  struct ast **slot = t1->type == ret_type ? &t1->ops[0] : &t1->ops[1];
+  *slot = value;
+  simplify_expression (slot);
+  unlink_stmt (link);
+  return 1;
+}
+
+int
+convert_branches (struct ast *s)
+{
+  if (optimize < 1)
+    return 0;
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type != function_type)
+	continue;
+      struct ast *body = s->ops[1];
+      assert (body != NULL && body->type == block_type);
+
+      /* Converting an inner if can make its outer if convertible. */
+      int changed;
+      do
+	{
+	  changed = 0;
+	  struct ast **link;
+	  for (link = &body->ops[0]; *link != NULL; link = &(*link)->next)
+	    changed |= convert (link, body);
+	}
+      while (changed);
+    }
+  return 0;
+}
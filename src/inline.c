@@ -0,0 +1,525 @@
+/**
+ * @file   inline.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief  Function inlining.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This pass runs before the dealias pass, while every variable and
+ * label is still known by its name.  A call graph is built over the
+ * functions of the file, and the functions that can call themselves
+ * are never inlined.  The functions are visited callees first, so
+ * the body that is copied into a caller has already had its own calls
+ * inlined.
+ *
+ * A call is expanded right before the statement containing it:
+ *
+ *     int inline$N$0 = arg0;
+ *     int inline$N;
+ *     {
+ *       int param0 = inline$N$0;
+ *       { body with return e; turned into inline$N = e; goto end; }
+ *     }
+ *   end:
+ *     statement with the call replaced by inline$N
+ *
+ * The names with a '$' in them can't be written in a program, and the
+ * labels of the copied body get the number of the call added to their
+ * names, so nothing collides.  The block scopes then leave it to the
+ * dealias pass to give the parameters and locals of each copy stack
+ * slots of their own.  Only calls that are always evaluated along
+ * with their statement are expanded, so the branches of a ternary are
+ * left alone.
+ *
+ * The size of a function is the number of nodes in its body.
+ * Functions declared inline are inlined if they have at most
+ * inline_limit nodes, and other functions if they have at most a
+ * quarter of that.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "my_printf.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * A function in the call graph.
+ *
+ */
+struct call_node
+{
+  struct ast *function;		/**< The function. */
+  size_t *callees;		/**< The functions that it calls. */
+  size_t ncallees;		/**< Number of callees. */
+  size_t acallees;		/**< Allocated callees. */
+  int visited;			/**< Whether it has been visited. */
+  int recursive;		/**< Whether it can call itself. */
+};
+
+static struct call_node *graph = NULL; /**< The call graph. */
+static size_t nnodes = 0;	/**< Number of functions. */
+static size_t *order = NULL;	/**< The functions, callees first. */
+static size_t norder = 0;	/**< Number of ordered functions. */
+static int siteno = 0;		/**< The number of the next call that
+				   is expanded. */
+
+/**
+ * Find the function @c name in the call graph.
+ *
+ * @return Its index, or @c nnodes if it isn't defined in this file.
+ */
+static size_t
+find_node (const char *name)
+{
+  size_t n;
+  for (n = 0; n < nnodes; n++)
+    if (STREQ (graph[n].function->op.function.name, name))
+      break;
+  return n;
+}
+
+/**
+ * Find the function that the call @c s calls.
+ *
+ * @return Its index, or @c nnodes if it isn't a direct call to a
+ * function of this file.
+ */
+static size_t
+callee_of (const struct ast *s)
+{
+  const struct ast *name = s->ops[0];
+  if (name->type != variable_type || name->op.variable.type != NULL)
+    return nnodes;
+  return find_node (name->op.variable.name);
+}
+
+/**
+ * Add an edge from function @c from to every function called in @c s.
+ *
+ */
+static void
+add_edges (const struct ast *s, size_t from)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == function_call_type)
+	{
+	  struct call_node *c = &graph[from];
+	  size_t to = callee_of (s);
+	  if (to < nnodes)
+	    {
+	      if (c->ncallees == c->acallees)
+		c->callees = x2nrealloc (c->callees, &c->acallees,
+					 sizeof *c->callees);
+	      c->callees[c->ncallees++] = to;
+	    }
+	}
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	add_edges (s->ops[i], from);
+    }
+}
+
+/**
+ * Test if function @c target can be reached from function @c n.
+ *
+ * @param seen The functions that have already been searched.
+ */
+static int
+reaches (size_t n, size_t target, char *seen)
+{
+  size_t i;
+  for (i = 0; i < graph[n].ncallees; i++)
+    {
+      size_t m = graph[n].callees[i];
+      if (m == target)
+	return 1;
+      if (!seen[m])
+	{
+	  seen[m] = 1;
+	  if (reaches (m, target, seen))
+	    return 1;
+	}
+    }
+  return 0;
+}
+
+/**
+ * Put function @c n in the order after everything that it calls.
+ *
+ */
+static void
+visit (size_t n)
+{
+  size_t i;
+  graph[n].visited = 1;
+  for (i = 0; i < graph[n].ncallees; i++)
+    if (!graph[graph[n].callees[i]].visited)
+      visit (graph[n].callees[i]);
+  order[norder++] = n;
+}
+
+/**
+ * Build the call graph of the functions in @c s.
+ *
+ */
+static void
+build_graph (struct ast *s)
+{
+  struct ast *t;
+  size_t n, anodes = 0;
+  for (t = s; t != NULL; t = t->next)
+    if (t->type == function_type)
+      {
+	if (nnodes == anodes)
+	  graph = x2nrealloc (graph, &anodes, sizeof *graph);
+	memset (&graph[nnodes], 0, sizeof *graph);
+	graph[nnodes++].function = t;
+      }
+  for (n = 0; n < nnodes; n++)
+    add_edges (graph[n].function->ops[1], n);
+
+  char *seen = xnmalloc (nnodes + 1, 1);
+  for (n = 0; n < nnodes; n++)
+    {
+      memset (seen, 0, nnodes + 1);
+      graph[n].recursive = reaches (n, n, seen);
+    }
+  FREE (seen);
+
+  order = xnmalloc (nnodes + 1, sizeof *order);
+  norder = 0;
+  for (n = 0; n < nnodes; n++)
+    if (!graph[n].visited)
+      visit (n);
+}
+
+/**
+ * Count the nodes of @c s and the ASTs that follow it.
+ *
+ */
+static size_t
+count_nodes (const struct ast *s)
+{
+  size_t n = 0;
+  for (; s != NULL; s = s->next)
+    {
+      int i;
+      n++;
+      for (i = 0; i < s->num_ops; i++)
+	n += count_nodes (s->ops[i]);
+    }
+  return n;
+}
+
+/**
+ * Test if @c s or the ASTs that follow it allocate memory on the
+ * stack, which would only be given back when the caller returns.
+ *
+ */
+static int
+allocates (const struct ast *s)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == alloc_type)
+	return 1;
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	if (allocates (s->ops[i]))
+	  return 1;
+    }
+  return 0;
+}
+
+/**
+ * Test if the variable @c name is declared in @c s or the ASTs that
+ * follow it.
+ *
+ */
+static int
+declares (const struct ast *s, const char *name)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == variable_type && s->op.variable.type != NULL
+	  && STREQ (s->op.variable.name, name))
+	return 1;
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	if (declares (s->ops[i], name))
+	  return 1;
+    }
+  return 0;
+}
+
+/**
+ * Test if a name that @c s uses without the function @c callee
+ * declaring it is declared in the function @c caller, where it would
+ * mean something else.
+ *
+ */
+static int
+captures (const struct ast *s, const struct ast *callee,
+	  const struct ast *caller)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == variable_type && s->op.variable.type == NULL)
+	{
+	  const char *name = s->op.variable.name;
+	  if (!declares (callee->ops[0], name)
+	      && !declares (callee->ops[1], name)
+	      && (declares (caller->ops[0], name)
+		  || declares (caller->ops[1], name)))
+	    return 1;
+	}
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	if (captures (s->ops[i], callee, caller))
+	  return 1;
+    }
+  return 0;
+}
+
+/**
+ * Test if the call @c s in the function @c caller can be expanded.
+ *
+ */
+static int
+can_inline (const struct ast *s, const struct ast *caller)
+{
+  size_t n = callee_of (s);
+  if (n == nnodes || graph[n].recursive)
+    return 0;
+  const struct ast *callee = graph[n].function;
+  size_t limit = inline_limit < 0 ? 0 : inline_limit;
+  if (!callee->op.function.declared_inline)
+    limit /= 4;
+  if (count_nodes (callee->ops[1]) > limit || allocates (callee->ops[1]))
+    return 0;
+
+  const struct ast *arg = s->ops[1], *param = callee->ops[0];
+  for (; arg != NULL && param != NULL; arg = arg->next, param = param->next)
+    ;
+  if (arg != NULL || param != NULL)
+    return 0;
+  return (!declares (caller->ops[0], s->ops[0]->op.variable.name)
+	  && !declares (caller->ops[1], s->ops[0]->op.variable.name)
+	  && !captures (callee->ops[1], callee, caller));
+}
+
+/**
+ * Find the first call that can be expanded in the expression @c s,
+ * without looking at the ASTs that follow it.
+ *
+ * @param ss Reference to an AST pointer.
+ * @param caller The function that @c s is in.
+ *
+ * @return The link to the call, or NULL if there is none.
+ */
+static struct ast **
+find_call (struct ast **ss, const struct ast *caller)
+{
+  assert (ss != NULL);
+#define s (*ss)
+  if (s == NULL)
+    return NULL;
+
+  /* Only the condition of a ternary is always evaluated. */
+  int i, n = s->type == ternary_type ? 1 : s->num_ops;
+  for (i = 0; i < n; i++)
+    {
+      struct ast **t;
+      for (t = &s->ops[i]; *t != NULL; t = &(*t)->next)
+	{
+	  struct ast **call = find_call (t, caller);
+	  if (call != NULL)
+	    return call;
+	}
+    }
+  if (s->type == function_call_type && can_inline (s, caller))
+    return ss;
+  return NULL;
+#undef s
+}
+
+/**
+ * Rename the labels of the copied body @c s and turn its returns into
+ * assignments to @c result and jumps to @c end.
+ *
+ * @param ss Reference to an AST pointer.
+ * @param site The number of the call.
+ */
+static void
+rewrite_body (struct ast **ss, int site, const char *result, const char *end)
+{
+  assert (ss != NULL);
+#define s (*ss)
+  if (s == NULL)
+    return;
+  rewrite_body (&s->next, site, result, end);
+  char **name = NULL;
+  switch (s->type)
+    {
+    case label_type:
+      name = &s->op.label.name;
+      break;
+
+    case jump_type:
+      name = &s->op.jump.name;
+      break;
+
+    case cond_type:
+      name = &s->op.cond.name;
+      break;
+
+    case ret_type:
+      ;
+      struct ast *t = make_jump (xstrdup (end));
+      if (s->ops[0] != NULL)
+	{
+	  struct ast *v = make_binary ('=', make_variable (NULL, xstrdup (result)),
+				       s->ops[0]);
+	  v->throw_away = 1;
+	  s->ops[0] = NULL;
+	  t = ast_cat (v, t);
+	}
+      t = ast_cat (t, s->next);
+      s->next = NULL;
+      AST_FREE (s);
+      s = t;
+      return;
+
+    default:
+      break;
+    }
+  if (name != NULL)
+    {
+      char *t = my_printf ("%s$%d", *name, site);
+      FREE (*name);
+      *name = t;
+    }
+  int i;
+  for (i = 0; i < s->num_ops; i++)
+    rewrite_body (&s->ops[i], site, result, end);
+#undef s
+}
+
+/**
+ * Expand the call at @c call right before the statement at @c link.
+ *
+ */
+static void
+expand (struct ast **link, struct ast **call)
+{
+  const struct ast *callee = graph[callee_of (*call)].function;
+  int site = siteno++, k = 0;
+  char *result = my_printf ("inline$%d", site);
+  char *end = my_printf ("inline$%d$end", site);
+
+  /* The arguments are evaluated in the caller's scope before any of
+     the parameters can hide the names that they use. */
+  struct ast *out = NULL, *params = NULL, *arg = (*call)->ops[1], *t;
+  const struct ast *p;
+  (*call)->ops[1] = NULL;
+  for (p = callee->ops[0]; p != NULL; p = p->next, k++)
+    {
+      struct ast *next = arg->next;
+      char *temp = my_printf ("inline$%d$%d", site, k);
+      arg->next = NULL;
+      t = make_binary ('=', make_variable (xstrdup (p->op.variable.type),
+					   xstrdup (temp)), arg);
+      t->throw_away = 1;
+      out = ast_cat (out, t);
+      t = make_binary ('=', make_variable (xstrdup (p->op.variable.type),
+					   xstrdup (p->op.variable.name)),
+		       make_variable (NULL, temp));
+      t->throw_away = 1;
+      params = ast_cat (params, t);
+      arg = next;
+    }
+  out = ast_cat (out, make_variable (xstrdup (callee->op.function.type),
+				     xstrdup (result)));
+  t = ast_dup (callee->ops[1]);
+  rewrite_body (&t->ops[0], site, result, end);
+  out = ast_cat (out, make_block (ast_cat (params, t)));
+  out = ast_cat (out, make_label (end));
+
+  t = make_variable (NULL, result);
+  t->throw_away = (*call)->throw_away;
+  t->boolean_not = (*call)->boolean_not;
+  t->noreturnint = (*call)->noreturnint;
+  SWAP_AST (t, *call);
+  AST_FREE (t);
+  *link = ast_cat (out, *link);
+}
+
+/**
+ * Expand the calls in the statements at @c link.
+ *
+ * @param caller The function that the statements are in.
+ */
+static void
+inline_stmts (struct ast **link, const struct ast *caller)
+{
+  while (*link != NULL)
+    {
+      struct ast *s = *link, **call;
+      if (s->type == block_type)
+	inline_stmts (&s->ops[0], caller);
+      else if ((call = find_call (link, caller)) != NULL)
+	{
+	  expand (link, call);
+	  continue;
+	}
+      link = &s->next;
+    }
+}
+
+int
+inline_functions (struct ast *s)
+{
+  if (optimize < 1)
+    return 0;
+  build_graph (s);
+  size_t n;
+  for (n = 0; n < norder; n++)
+    {
+      struct ast *f = graph[order[n]].function;
+      inline_stmts (&f->ops[1]->ops[0], f);
+    }
+  for (n = 0; n < nnodes; n++)
+    FREE (graph[n].callees);
+  FREE (graph);
+  FREE (order);
+  nnodes = norder = 0;
+  return 0;
+}
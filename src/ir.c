@@ -0,0 +1,992 @@
+/**
+ * @file   ir.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This is the routine that lowers the AST into the three-address
+ * intermediate representation.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * @note The lowering follows the same evaluation order as gen_code so
+ * that the instructions line up with the code that is really
+ * emitted.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "compiler.h"
+#include "free.h"
+#include "ir.h"
+#include "lib.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/** An operand that is not used. */
+static const struct ir_operand no_operand = { ir_none, 0, NULL };
+
+/**
+ * Make an operand of kind @c K with value @c V and symbol @c S.
+ *
+ */
+static inline struct ir_operand
+make_operand (enum ir_operand_kind k, long long v, const char *s)
+{
+  struct ir_operand out = { k, v, s };
+  return out;
+}
+
+/**
+ * Get the current (last) block of @c f.
+ *
+ */
+#define CURRENT_BLOCK(F) (&(F)->blocks[(F)->nblocks - 1])
+
+/**
+ * Test if the instruction @c I transfers control away.
+ *
+ */
+#define IS_TERMINATOR(I)						\
+  ((I)->code == ir_jump || (I)->code == ir_branch || (I)->code == ir_ret)
+
+/** Whether the current block may still receive instructions. */
+static int block_open = 0;
+
+/**
+ * Append a new block to @c f.
+ *
+ * @param f The function being built.
+ * @param label The label starting the block (or NULL).
+ */
+static void
+new_block (struct ir_func *f, const char *label)
+{
+  if (f->nblocks == f->ablocks)
+    f->blocks = x2nrealloc (f->blocks, &f->ablocks, sizeof *f->blocks);
+  struct ir_block *b = &f->blocks[f->nblocks++];
+  b->label = label;
+  b->first = f->ninsns;
+  b->count = 0;
+  b->succ[0] = b->succ[1] = -1;
+  b->preds = NULL;
+  b->npreds = 0;
+  b->idom = -1;
+  b->phi_first = 0;
+  b->phi_count = 0;
+  block_open = 1;
+}
+
+/**
+ * Append an instruction to the current block of @c f, opening a new
+ * (unreachable) block first if the last one was already terminated.
+ *
+ * @param f The function being built.
+ * @param code The type of instruction.
+ * @param origin The AST that the instruction came from.
+ *
+ * @return The new instruction.
+ */
+static struct ir_insn *
+emit (struct ir_func *f, enum ir_code code, struct ast *origin)
+{
+  if (!block_open)
+    new_block (f, NULL);
+  if (f->ninsns == f->ainsns)
+    f->insns = x2nrealloc (f->insns, &f->ainsns, sizeof *f->insns);
+  struct ir_insn *i = &f->insns[f->ninsns++];
+  i->code = code;
+  i->op = 0;
+  i->dest = -1;
+  i->a = i->b = i->c = no_operand;
+  i->origin = origin;
+  CURRENT_BLOCK (f)->count++;
+  if (IS_TERMINATOR (i))
+    block_open = 0;
+  return i;
+}
+
+/**
+ * Emit an instruction that defines a new virtual register.
+ *
+ * @return The operand of the new virtual register.
+ */
+static struct ir_operand
+emit_value (struct ir_func *f, enum ir_code code, int op,
+	    struct ir_operand a, struct ir_operand b, struct ir_operand c,
+	    struct ast *origin)
+{
+  struct ir_insn *i = emit (f, code, origin);
+  i->op = op;
+  i->dest = f->nvregs++;
+  i->a = a;
+  i->b = b;
+  i->c = c;
+  return make_operand (ir_vreg, i->dest, NULL);
+}
+
+/**
+ * Start a block with the label @c label, linking the previous block
+ * to it if it falls through.
+ *
+ */
+static void
+start_label (struct ir_func *f, const char *label)
+{
+  if (block_open)
+    {
+      struct ir_block *b = CURRENT_BLOCK (f);
+      /* The entry block is never a branch target. */
+      if (b->count == 0 && b->label == NULL && f->nblocks > 1)
+	{
+	  b->label = label;
+	  return;
+	}
+      struct ir_insn *j = emit (f, ir_jump, NULL);
+      j->a = make_operand (ir_label, f->nblocks, label);
+    }
+  new_block (f, label);
+}
+
+static struct ir_operand lower_expr (struct ir_func *, struct ast *);
+
+/**
+ * Lower the address of an lval.  Variables in the stack frame are
+ * returned as slots so that they can be accessed directly.
+ *
+ * @return The slot or address of @c s.
+ */
+static struct ir_operand
+lower_lval (struct ir_func *f, struct ast *s)
+{
+  switch (s->type)
+    {
+    case variable_type:
+      assert (s->loc != NULL);
+      if (IS_MEMORY (s->loc))
+	return make_operand (ir_slot, s->loc->offset, NULL);
+      return make_operand (ir_symbol, 0, s->loc->base);
+
+    case string_type:
+      return make_operand (ir_string, 0, s->op.string.val);
+
+    case binary_type:
+      if (s->op.binary.op == '[')
+	{
+	  struct ir_operand base = lower_expr (f, s->ops[0]);
+	  struct ir_operand idx = lower_expr (f, s->ops[1]);
+	  return emit_value (f, ir_index, 0, base, idx, no_operand, s);
+	}
+      break;
+
+    case unary_type:
+      if (s->op.unary.op == '*')
+	return lower_expr (f, s->ops[0]);
+      break;
+
+    default:
+      break;
+    }
+  return lower_expr (f, s);
+}
+
+/**
+ * Load the value stored at the slot or address @c where.
+ *
+ */
+static struct ir_operand
+load (struct ir_func *f, struct ir_operand where, struct ast *origin)
+{
+  return emit_value (f, where.kind == ir_slot ? ir_load : ir_loadm, 0,
+		     where, no_operand, no_operand, origin);
+}
+
+/**
+ * Store @c v at the slot or address @c where.
+ *
+ */
+static void
+store (struct ir_func *f, struct ir_operand where, struct ir_operand v,
+       struct ast *origin)
+{
+  struct ir_insn *i = emit (f, where.kind == ir_slot ? ir_store : ir_storem,
+			    origin);
+  i->a = where;
+  i->b = v;
+}
+
+/**
+ * Lower the expression @c s.
+ *
+ * @return The operand holding the value of @c s.
+ */
+static struct ir_operand
+lower_expr (struct ir_func *f, struct ast *s)
+{
+  struct ir_operand out = no_operand;
+  struct ir_operand l, r;
+  int j;
+  if (s == NULL)
+    return out;
+  switch (s->type)
+    {
+    case integer_type:
+      out = make_operand (ir_imm, s->op.integer.i, NULL);
+      break;
+
+    case string_type:
+    case variable_type:
+      l = lower_lval (f, s);
+      if (l.kind == ir_slot)
+	out = load (f, l, s);
+      else
+	out = l;
+      break;
+
+    case binary_type:
+      switch (s->op.binary.op)
+	{
+	case '=':
+	  l = lower_lval (f, s->ops[0]);
+	  out = lower_expr (f, s->ops[1]);
+	  store (f, l, out, s);
+	  break;
+
+	case '[':
+	  out = load (f, lower_lval (f, s), s);
+	  break;
+
+	default:
+	  l = lower_expr (f, s->ops[0]);
+	  r = lower_expr (f, s->ops[1]);
+	  out = emit_value (f, ir_binary, s->op.binary.op, l, r, no_operand,
+			    s);
+	}
+      break;
+
+    case unary_type:
+      switch (s->op.unary.op)
+	{
+	case '*':
+	  out = load (f, lower_lval (f, s), s);
+	  break;
+
+	case '&':
+	  l = lower_lval (f, s->ops[0]);
+	  if (l.kind == ir_slot)
+	    out = emit_value (f, ir_addr, 0, l, no_operand, no_operand, s);
+	  else
+	    out = l;
+	  break;
+
+	case INC:
+	case DEC:
+	  l = lower_lval (f, s->ops[0]);
+	  r = load (f, l, s);
+	  out = emit_value (f, ir_binary, s->op.unary.op == INC ? '+' : '-',
+			    r, make_operand (ir_imm, 1, NULL), no_operand, s);
+	  store (f, l, out, s);
+	  if (!s->unary_prefix)
+	    out = r;
+	  break;
+
+	default:
+	  l = lower_expr (f, s->ops[0]);
+	  out = emit_value (f, ir_unary, s->op.unary.op, l, no_operand,
+			    no_operand, s);
+	}
+      break;
+
+    case ternary_type:
+      /* Use the same order as gen_code_ternary. */
+      r = lower_expr (f, s->ops[2]);
+      l = lower_expr (f, s->ops[1]);
+      out = lower_expr (f, s->ops[0]);
+      out = emit_value (f, ir_select, 0, out, l, r, s);
+      break;
+
+    case function_call_type:
+      ;
+      struct ast *i;
+      int nargs = 0;
+      for (i = s->ops[1]; i != NULL; i = i->next)
+	if (i->type != block_type)
+	  nargs++;
+      struct ir_operand *args = xnmalloc (nargs + 1, sizeof *args);
+      j = 0;
+      for (i = s->ops[1]; i != NULL; i = i->next)
+	if (i->type != block_type)
+	  args[j++] = lower_expr (f, i);
+      for (j = 0; j < nargs; j++)
+	{
+	  struct ir_insn *a = emit (f, ir_arg, s);
+	  a->a = make_operand (ir_imm, j, NULL);
+	  a->b = args[j];
+	}
+      FREE (args);
+      l = lower_lval (f, s->ops[0]);
+      out = emit_value (f, ir_call, 0, l, make_operand (ir_imm, nargs, NULL),
+			no_operand, s);
+      break;
+
+    case alloc_type:
+      if (s->ops[0] != NULL)
+	out = emit_value (f, ir_alloc, 0, lower_expr (f, s->ops[0]),
+			  no_operand, no_operand, s);
+      break;
+
+    default:
+      for (j = 0; j < s->num_ops; j++)
+	lower_expr (f, s->ops[j]);
+    }
+
+  if (s->boolean_not && out.kind != ir_none)
+    out = emit_value (f, ir_unary, '!', out, no_operand, no_operand, s);
+  return out;
+}
+
+/**
+ * Lower a chain of statements.
+ *
+ * @param f The function being built.
+ * @param s The first statement.
+ */
+static void
+lower_stmts (struct ir_func *f, struct ast *s)
+{
+  struct ir_insn *i;
+  struct ir_operand v;
+  for (; s != NULL; s = s->next)
+    switch (s->type)
+      {
+      case block_type:
+	lower_stmts (f, s->ops[0]);
+	break;
+
+      case label_type:
+	start_label (f, ast_label_name (s));
+	break;
+
+      case jump_type:
+	i = emit (f, ir_jump, s);
+	i->a = make_operand (ir_label, -1, ast_label_name (s));
+	break;
+
+      case cond_type:
+	v = lower_expr (f, s->ops[0]);
+	i = emit (f, ir_branch, s);
+	i->a = v;
+	i->b = make_operand (ir_label, -1, ast_label_name (s));
+	i->c = make_operand (ir_label, f->nblocks, NULL);
+	new_block (f, NULL);
+	break;
+
+      case ret_type:
+	v = lower_expr (f, s->ops[0]);
+	i = emit (f, ir_ret, s);
+	i->a = v;
+	break;
+
+      case variable_type:
+	/* A declaration without an initializer does nothing. */
+	break;
+
+      default:
+	lower_expr (f, s);
+      }
+}
+
+/** A label and the block it starts, used for resolving targets. */
+struct label_entry
+{
+  const char *label;		/**< The label. */
+  int block;			/**< The block it starts. */
+};
+
+static int
+compare_label (const void *a, const void *b)
+{
+  return strcmp (((const struct label_entry *) a)->label,
+		 ((const struct label_entry *) b)->label);
+}
+
+/**
+ * Resolve an unresolved label operand against the sorted table.
+ *
+ */
+static void
+resolve (struct ir_operand *o, struct label_entry *table, size_t n)
+{
+  if (o->kind != ir_label || o->val >= 0)
+    return;
+  struct label_entry key = { o->sym, 0 };
+  struct label_entry *e = bsearch (&key, table, n, sizeof *table,
+				   compare_label);
+  if (e != NULL)
+    o->val = e->block;
+}
+
+/**
+ * Resolve every branch target and fill in the successor and
+ * predecessor lists of the blocks.
+ *
+ */
+static void
+link_blocks (struct ir_func *f)
+{
+  size_t n = 0, b;
+  struct label_entry *table = xnmalloc (f->nblocks + 1, sizeof *table);
+  for (b = 0; b < f->nblocks; b++)
+    if (f->blocks[b].label != NULL)
+      {
+	table[n].label = f->blocks[b].label;
+	table[n].block = b;
+	n++;
+      }
+  qsort (table, n, sizeof *table, compare_label);
+
+  for (b = 0; b < f->nblocks; b++)
+    {
+      struct ir_block *bb = &f->blocks[b];
+      assert (bb->count > 0);
+      struct ir_insn *t = &f->insns[bb->first + bb->count - 1];
+      assert (IS_TERMINATOR (t));
+      resolve (&t->a, table, n);
+      resolve (&t->b, table, n);
+      if (t->code == ir_jump)
+	bb->succ[0] = t->a.val;
+      else if (t->code == ir_branch)
+	{
+	  bb->succ[0] = t->b.val;
+	  bb->succ[1] = t->c.val;
+	}
+    }
+  FREE (table);
+
+  for (b = 0; b < f->nblocks; b++)
+    {
+      int k;
+      for (k = 0; k < 2; k++)
+	if (f->blocks[b].succ[k] >= 0)
+	  f->blocks[f->blocks[b].succ[k]].npreds++;
+    }
+  for (b = 0; b < f->nblocks; b++)
+    {
+      f->blocks[b].preds = xnmalloc (f->blocks[b].npreds + 1, sizeof (int));
+      f->blocks[b].npreds = 0;
+    }
+  for (b = 0; b < f->nblocks; b++)
+    {
+      int k;
+      for (k = 0; k < 2; k++)
+	{
+	  int t = f->blocks[b].succ[k];
+	  if (t >= 0)
+	    f->blocks[t].preds[f->blocks[t].npreds++] = b;
+	}
+    }
+}
+
+struct ir_func *
+ir_lower (struct ast *s)
+{
+  assert (s != NULL && s->type == function_type);
+  struct ir_func *f = xzalloc (sizeof *f);
+  f->name = s->op.function.name;
+  f->ast = s;
+
+  new_block (f, NULL);
+  lower_stmts (f, s->ops[1]);
+  if (block_open)
+    emit (f, ir_ret, NULL);
+  link_blocks (f);
+  return f;
+}
+
+struct ir_func *
+ir_free (struct ir_func *f)
+{
+  if (f == NULL)
+    return NULL;
+  size_t b;
+  for (b = 0; b < f->nblocks; b++)
+    FREE (f->blocks[b].preds);
+  for (b = 0; b < f->nphis; b++)
+    FREE (f->phis[b].args);
+  FREE (f->phis);
+  for (b = 0; b < f->nloops; b++)
+    FREE (f->loops[b].blocks);
+  FREE (f->loops);
+  FREE (f->rpo);
+  FREE (f->blocks);
+  FREE (f->insns);
+  FREE (f);
+  return NULL;
+}
+
+/**
+ * Number the blocks reachable from @c b in postorder.
+ *
+ * @param f The function.
+ * @param b The block to start from.
+ * @param seen Which blocks have been visited.
+ * @param n The number of blocks numbered so far.
+ */
+static void
+postorder (struct ir_func *f, int b, char *seen, size_t *n)
+{
+  seen[b] = 1;
+  int k;
+  for (k = 0; k < 2; k++)
+    {
+      int t = f->blocks[b].succ[k];
+      if (t >= 0 && !seen[t])
+	postorder (f, t, seen, n);
+    }
+  f->rpo[(*n)++] = b;
+}
+
+/**
+ * Walk up the dominator tree from @c a and @c b until they meet.
+ *
+ * @param order The position of each block in reverse postorder.
+ */
+static int
+intersect (struct ir_func *f, const int *order, int a, int b)
+{
+  while (a != b)
+    {
+      while (order[a] > order[b])
+	a = f->blocks[a].idom;
+      while (order[b] > order[a])
+	b = f->blocks[b].idom;
+    }
+  return a;
+}
+
+/**
+ * This is the algorithm of Cooper, Harvey and Kennedy, iterating
+ * over the blocks in reverse postorder until the dominator tree
+ * settles.
+ */
+void
+ir_dominators (struct ir_func *f)
+{
+  size_t b, i;
+  char *seen = xzalloc (f->nblocks + 1);
+  FREE (f->rpo);
+  f->rpo = xnmalloc (f->nblocks + 1, sizeof *f->rpo);
+  f->nrpo = 0;
+  postorder (f, 0, seen, &f->nrpo);
+  FREE (seen);
+  for (i = 0; i < f->nrpo / 2; i++)
+    {
+      int t = f->rpo[i];
+      f->rpo[i] = f->rpo[f->nrpo - 1 - i];
+      f->rpo[f->nrpo - 1 - i] = t;
+    }
+
+  int *order = xnmalloc (f->nblocks + 1, sizeof *order);
+  for (b = 0; b < f->nblocks; b++)
+    {
+      order[b] = -1;
+      f->blocks[b].idom = -1;
+    }
+  for (i = 0; i < f->nrpo; i++)
+    order[f->rpo[i]] = i;
+  f->blocks[0].idom = 0;
+
+  int changed = 1;
+  while (changed)
+    {
+      changed = 0;
+      for (i = 1; i < f->nrpo; i++)
+	{
+	  struct ir_block *bb = &f->blocks[f->rpo[i]];
+	  int k, idom = -1;
+	  for (k = 0; k < bb->npreds; k++)
+	    {
+	      int p = bb->preds[k];
+	      if (f->blocks[p].idom < 0)
+		continue;
+	      idom = idom < 0 ? p : intersect (f, order, p, idom);
+	    }
+	  if (bb->idom != idom)
+	    {
+	      bb->idom = idom;
+	      changed = 1;
+	    }
+	}
+    }
+  FREE (order);
+}
+
+int
+ir_dominates (const struct ir_func *f, int a, int b)
+{
+  if (f->blocks[b].idom < 0)
+    return 0;
+  while (b != a && b != 0)
+    b = f->blocks[b].idom;
+  return b == a;
+}
+
+/**
+ * Add the blocks that reach @c b without going through the header of
+ * @c l to it.
+ *
+ * @param stack Scratch space for every block.
+ */
+static void
+grow_loop (const struct ir_func *f, struct ir_loop *l, int b, int *stack)
+{
+  size_t n = 0;
+  if (!l->blocks[b])
+    {
+      l->blocks[b] = 1;
+      l->size++;
+      stack[n++] = b;
+    }
+  while (n > 0)
+    {
+      const struct ir_block *bb = &f->blocks[stack[--n]];
+      int k;
+      for (k = 0; k < bb->npreds; k++)
+	{
+	  int p = bb->preds[k];
+	  if (!l->blocks[p] && f->blocks[p].idom >= 0)
+	    {
+	      l->blocks[p] = 1;
+	      l->size++;
+	      stack[n++] = p;
+	    }
+	}
+    }
+}
+
+static int
+compare_loop (const void *a, const void *b)
+{
+  size_t x = ((const struct ir_loop *) a)->size;
+  size_t y = ((const struct ir_loop *) b)->size;
+  return (x < y) - (x > y);
+}
+
+void
+ir_find_loops (struct ir_func *f)
+{
+  size_t b, l, nl = 0, al = 0;
+  int *stack = xnmalloc (f->nblocks + 1, sizeof *stack);
+  int *loop_of = xnmalloc (f->nblocks + 1, sizeof *loop_of);
+  struct ir_loop *loops = NULL;
+  for (b = 0; b < f->nblocks; b++)
+    loop_of[b] = -1;
+
+  for (b = 0; b < f->nblocks; b++)
+    {
+      int k;
+      for (k = 0; k < 2; k++)
+	{
+	  int h = f->blocks[b].succ[k];
+	  if (h < 0 || !ir_dominates (f, h, b))
+	    continue;
+	  if (loop_of[h] < 0)
+	    {
+	      if (nl == al)
+		loops = x2nrealloc (loops, &al, sizeof *loops);
+	      loops[nl].header = h;
+	      loops[nl].blocks = xzalloc (f->nblocks + 1);
+	      loops[nl].blocks[h] = 1;
+	      loops[nl].size = 1;
+	      loops[nl].parent = -1;
+	      loop_of[h] = nl++;
+	    }
+	  grow_loop (f, &loops[loop_of[h]], b, stack);
+	}
+    }
+  FREE (loop_of);
+  FREE (stack);
+
+  /* Natural loops with different headers are either disjoint or
+     nested, so the bigger one of two comes first. */
+  qsort (loops, nl, sizeof *loops, compare_loop);
+  for (l = 0; l < nl; l++)
+    {
+      size_t o;
+      for (o = l; o-- > 0;)
+	if (loops[o].blocks[loops[l].header])
+	  {
+	    loops[l].parent = o;
+	    break;
+	  }
+    }
+  f->loops = loops;
+  f->nloops = nl;
+}
+
+int
+ir_loop_preheader (const struct ir_func *f, const struct ir_loop *l)
+{
+  const struct ir_block *h = &f->blocks[l->header];
+  int k, pre = -1;
+  for (k = 0; k < h->npreds; k++)
+    {
+      int p = h->preds[k];
+      if (l->blocks[p])
+	continue;
+      if (pre >= 0)
+	return -1;
+      pre = p;
+    }
+  if (pre < 0 || pre + 1 != l->header)
+    return -1;
+
+  /* The edge has to be the fall through, not a branch to the
+     label. */
+  const struct ir_block *pb = &f->blocks[pre];
+  const struct ir_insn *t = &f->insns[pb->first + pb->count - 1];
+  if (t->code == ir_jump && t->origin == NULL)
+    return pre;
+  if (t->code == ir_branch && t->b.val != l->header)
+    return pre;
+  return -1;
+}
+
+int
+ir_clobbers_memory (const struct ir_insn *i)
+{
+  return (i->code == ir_store || i->code == ir_storem
+	  || i->code == ir_call);
+}
+
+int
+ir_defines_origin (const struct ir_insn *i)
+{
+  const struct ast *o = i->origin;
+  if (o == NULL || o->boolean_not || o->throw_away
+      || ast_has_side_effects (o))
+    return 0;
+  switch (i->code)
+    {
+    case ir_binary:
+      if (o->type != binary_type || o->op.binary.op != i->op)
+	return 0;
+      switch (i->op)
+	{
+	case EQ:
+	case '<':
+	case '>':
+	case LE:
+	case GE:
+	  return 0;
+	}
+      return 1;
+
+    case ir_unary:
+      return o->type == unary_type && o->op.unary.op == i->op;
+
+    case ir_loadm:
+      return ((o->type == binary_type && o->op.binary.op == '[')
+	      || (o->type == unary_type && o->op.unary.op == '*'));
+
+    default:
+      return 0;
+    }
+}
+
+const char *
+ir_op_name (int op)
+{
+  static char single[2];
+  switch (op)
+    {
+    case EQ:
+      return "==";
+    case NE:
+      return "!=";
+    case LE:
+      return "<=";
+    case GE:
+      return ">=";
+    case RS:
+      return ">>";
+    case LS:
+      return "<<";
+    case INC:
+      return "++";
+    case DEC:
+      return "--";
+    case MIN:
+      return "min";
+    case MAX:
+      return "max";
+    case ABS:
+      return "abs";
+    case ROL:
+      return "rol";
+    case ROR:
+      return "ror";
+    case BLSR:
+      return "blsr";
+    case BLSI:
+      return "blsi";
+    case POPCOUNT:
+      return "popcount";
+    case CTZ:
+      return "ctz";
+    case CLZ:
+      return "clz";
+    case BSWAP:
+      return "bswap";
+    case PREFETCH:
+      return "prefetch";
+    default:
+      single[0] = op;
+      single[1] = '\0';
+      return single;
+    }
+}
+
+/**
+ * Print the operand @c o to @c out.
+ *
+ */
+static void
+dump_operand (FILE *out, const struct ir_func *f, const struct ir_operand *o)
+{
+  switch (o->kind)
+    {
+    case ir_none:
+      break;
+    case ir_vreg:
+      fprintf (out, "%%%lld", o->val);
+      break;
+    case ir_imm:
+      fprintf (out, "$%lld", o->val);
+      break;
+    case ir_slot:
+      fprintf (out, "[%lld]", o->val);
+      break;
+    case ir_symbol:
+      fprintf (out, "%s", o->sym);
+      break;
+    case ir_string:
+      fprintf (out, "\"%s\"", o->sym);
+      break;
+    case ir_label:
+      if (o->val >= 0 && f->blocks[o->val].label != NULL)
+	fprintf (out, ".B%lld <%s>", o->val, f->blocks[o->val].label);
+      else if (o->val >= 0)
+	fprintf (out, ".B%lld", o->val);
+      else
+	fprintf (out, "<%s>", o->sym);
+      break;
+    }
+}
+
+/** The printable names of the instructions. */
+static const char *const code_names[] = {
+  "nop", "copy", "addr", "load", "store", "loadm", "storem",
+  "index", "binary", "unary", "select", "arg", "call", "alloc", "jump",
+  "br", "ret"
+};
+
+void
+ir_dump (FILE *out, const struct ir_func *f)
+{
+  fprintf (out, "function %s (", f->name);
+  struct ast *p;
+  const char *sep = "";
+  for (p = f->ast->ops[0]; p != NULL; p = p->next)
+    if (p->type == variable_type && p->loc != NULL)
+      {
+	fprintf (out, "%s[%d]", sep, p->loc->offset);
+	sep = ", ";
+      }
+  fprintf (out, ")\n");
+
+  size_t b;
+  for (b = 0; b < f->nblocks; b++)
+    {
+      const struct ir_block *bb = &f->blocks[b];
+      fprintf (out, ".B%zu:", b);
+      if (bb->label != NULL)
+	fprintf (out, "\t\t\t<%s>", bb->label);
+      fprintf (out, "\t; preds:");
+      int k;
+      for (k = 0; k < bb->npreds; k++)
+	fprintf (out, " .B%d", bb->preds[k]);
+      fprintf (out, "\n");
+
+      size_t n;
+      for (n = bb->phi_first; n < bb->phi_first + bb->phi_count; n++)
+	{
+	  const struct ir_phi *phi = &f->phis[n];
+	  fprintf (out, "\t%%%d = phi [%lld]", phi->dest, phi->slot);
+	  for (k = 0; k < bb->npreds; k++)
+	    {
+	      fprintf (out, "%s.B%d: ", k ? ", " : " ", bb->preds[k]);
+	      dump_operand (out, f, &phi->args[k]);
+	    }
+	  fprintf (out, "\n");
+	}
+
+      const struct ir_insn *i;
+      IR_FOR_INSNS (i, f, b)
+	{
+	  fprintf (out, "\t");
+	  if (i->dest >= 0)
+	    fprintf (out, "%%%d = ", i->dest);
+	  fprintf (out, "%s", code_names[i->code]);
+	  if (i->code == ir_binary || i->code == ir_unary)
+	    fprintf (out, " %s", ir_op_name (i->op));
+	  const struct ir_operand *ops[] = { &i->a, &i->b, &i->c };
+	  sep = " ";
+	  for (k = 0; k < 3; k++)
+	    if (ops[k]->kind != ir_none)
+	      {
+		fprintf (out, "%s", sep);
+		dump_operand (out, f, ops[k]);
+		sep = ", ";
+	      }
+	  fprintf (out, "\n");
+	}
+    }
+  fprintf (out, "\n");
+}
+
+int
+lower_ir (struct ast *s)
+{
+  if (!dump_ir)
+    return 0;
+  for (; s != NULL; s = s->next)
+    if (s->type == function_type)
+      {
+	struct ir_func *f = ir_lower (s);
+	ir_dump (stderr, f);
+	f = ir_free (f);
+      }
+  return 0;
+}
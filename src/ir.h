@@ -0,0 +1,318 @@
+/**
+ * @file   ir.h
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief  This is the linear three-address intermediate representation.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * A function is lowered from its post-collect_vars AST into a flat
+ * array of instructions that is partitioned into basic blocks.  Every
+ * value lives in a virtual register that is written by exactly one
+ * instruction, while the variables of the function stay in their
+ * stack slots and are only touched through explicit loads and
+ * stores.  Every block ends with an explicit jump, branch or return,
+ * so the control flow graph can be read straight off the
+ * terminators.
+ *
+ * @note The IR borrows all of its strings (symbols and labels) from
+ * the AST it was lowered from, thus it must never outlive that AST.
+ */
+
+#ifndef IR_H
+#define IR_H
+
+#include <stdio.h>
+
+struct ast;
+
+/**
+ * The different kinds of instructions.
+ *
+ */
+enum ir_code {
+  ir_nop,			/**< Does nothing. */
+  ir_copy,			/**< dest = a */
+  ir_addr,			/**< dest = &a */
+  ir_load,			/**< dest = a, where a is a stack
+				   slot. */
+  ir_store,			/**< a = b, where a is a stack slot. */
+  ir_loadm,			/**< dest = *a */
+  ir_storem,			/**< *a = b */
+  ir_index,			/**< dest = a + b * 8 */
+  ir_binary,			/**< dest = a op b */
+  ir_unary,			/**< dest = op a */
+  ir_select,			/**< dest = a ? b : c */
+  ir_arg,			/**< Pass b as argument number a. */
+  ir_call,			/**< dest = a (), using the preceding
+				   arguments. */
+  ir_alloc,			/**< dest = alloca (a) */
+  ir_jump,			/**< goto a */
+  ir_branch,			/**< if (a) goto b; else goto c; */
+  ir_ret			/**< return a */
+};
+
+/**
+ * The different kinds of operands.
+ *
+ */
+enum ir_operand_kind {
+  ir_none,			/**< The operand is unused. */
+  ir_vreg,			/**< A virtual register. */
+  ir_imm,			/**< An immediate integer. */
+  ir_slot,			/**< A stack slot, identified by its
+				   offset from the frame base. */
+  ir_symbol,			/**< The address of a symbol. */
+  ir_string,			/**< The address of a string
+				   literal. */
+  ir_label			/**< A branch target. */
+};
+
+/**
+ * An operand of an instruction.
+ *
+ */
+struct ir_operand
+{
+  enum ir_operand_kind kind;	/**< The type of operand. */
+  long long val;		/**< The register number, the
+				   immediate, the slot offset or the
+				   target block. */
+  const char *sym;		/**< The symbol, string or label
+				   name. */
+};
+
+/**
+ * A single three-address instruction.
+ *
+ */
+struct ir_insn
+{
+  enum ir_code code;		/**< What this instruction does. */
+  int op;			/**< The operator of ir_binary and
+				   ir_unary. */
+  int dest;			/**< The virtual register written, or
+				   -1. */
+  struct ir_operand a;		/**< First operand. */
+  struct ir_operand b;		/**< Second operand. */
+  struct ir_operand c;		/**< Third operand. */
+  struct ast *origin;		/**< The AST this instruction came
+				   from. */
+};
+
+/**
+ * A basic block, which is a contiguous run of instructions.
+ *
+ */
+struct ir_block
+{
+  const char *label;		/**< The label starting this block, or
+				   NULL. */
+  size_t first;			/**< Index of the first
+				   instruction. */
+  size_t count;			/**< Number of instructions. */
+  int succ[2];			/**< Successors, -1 if there is
+				   none. */
+  int *preds;			/**< Predecessors. */
+  int npreds;			/**< Number of predecessors. */
+  int idom;			/**< The immediate dominator, or -1 if
+				   this block is unreachable. */
+  size_t phi_first;		/**< Index of the first phi. */
+  size_t phi_count;		/**< Number of phis. */
+};
+
+/**
+ * A phi function, merging the values a stack slot has on entry to a
+ * block.  These only exist once the function is in SSA form.
+ *
+ */
+struct ir_phi
+{
+  int block;			/**< The block this phi belongs to. */
+  long long slot;		/**< The stack slot it merges. */
+  int dest;			/**< The virtual register written. */
+  struct ir_operand *args;	/**< The incoming values, one for each
+				   predecessor of the block. */
+};
+
+/**
+ * A natural loop, which is every block that can reach the source of a
+ * back edge to the header without going through the header.
+ *
+ */
+struct ir_loop
+{
+  int header;			/**< The block that dominates the
+				   loop. */
+  char *blocks;			/**< Which blocks are in the loop. */
+  size_t size;			/**< Number of blocks in the loop. */
+  int parent;			/**< The innermost loop containing this
+				   one, or -1. */
+};
+
+/**
+ * A function in the IR.
+ *
+ */
+struct ir_func
+{
+  const char *name;		/**< The name of the function. */
+  struct ast *ast;		/**< The function_type AST. */
+  struct ir_insn *insns;	/**< Every instruction, in block
+				   order. */
+  size_t ninsns;		/**< Number of instructions. */
+  size_t ainsns;		/**< Allocated instructions. */
+  struct ir_block *blocks;	/**< The basic blocks, in layout
+				   order. */
+  size_t nblocks;		/**< Number of blocks. */
+  size_t ablocks;		/**< Allocated blocks. */
+  int nvregs;			/**< Number of virtual registers. */
+  int *rpo;			/**< The reachable blocks in reverse
+				   postorder. */
+  size_t nrpo;			/**< Number of reachable blocks. */
+  struct ir_phi *phis;		/**< The phis, sorted by block. */
+  size_t nphis;			/**< Number of phis. */
+  struct ir_loop *loops;	/**< The loops, with every loop before
+				   the ones it contains. */
+  size_t nloops;		/**< Number of loops. */
+};
+
+/**
+ * Iterate @c I over every instruction in block @c B of function @c F.
+ *
+ * @param I A pointer to struct ir_insn.
+ * @param F The function.
+ * @param B The block index.
+ */
+#define IR_FOR_INSNS(I, F, B)						\
+  for ((I) = (F)->insns + (F)->blocks[B].first;				\
+       (I) < (F)->insns + (F)->blocks[B].first + (F)->blocks[B].count;	\
+       (I)++)
+
+/**
+ * Lower a function into the IR.
+ *
+ * @param s A function_type AST that has been through collect_vars.
+ *
+ * @return The newly allocated IR.
+ */
+extern struct ir_func *ir_lower (struct ast *s);
+
+/**
+ * Free a function in the IR.
+ *
+ * @param f The function to free.
+ *
+ * @return NULL
+ */
+extern struct ir_func *ir_free (struct ir_func *f);
+
+/**
+ * Print a textual version of @c f to @c out.
+ *
+ * @param out The stream to print on.
+ * @param f The function to print.
+ */
+extern void ir_dump (FILE *out, const struct ir_func *f);
+
+/**
+ * Compute the reverse postorder and the immediate dominator of every
+ * block of @c f.
+ *
+ * @param f The function to analyze.
+ */
+extern void ir_dominators (struct ir_func *f);
+
+/**
+ * Test if block @c a dominates block @c b.
+ *
+ * @param f The function, after ir_dominators.
+ * @param a The dominating block.
+ * @param b The dominated block.
+ *
+ * @return true if @c a dominates @c b, false otherwise.
+ */
+extern int ir_dominates (const struct ir_func *f, int a, int b);
+
+/**
+ * Find the natural loops of @c f.  Loops that share a header are
+ * merged into one.
+ *
+ * @param f The function, after ir_dominators.
+ */
+extern void ir_find_loops (struct ir_func *f);
+
+/**
+ * Find the block that code can be hoisted into out of a loop.  This
+ * is a block outside of the loop that falls through into its header
+ * and is the only way into the loop, so the code can be placed right
+ * before the header's label.
+ *
+ * @param f The function, after ir_find_loops.
+ * @param l The loop.
+ *
+ * @return The block, or -1 if there is none.
+ */
+extern int ir_loop_preheader (const struct ir_func *f,
+			      const struct ir_loop *l);
+
+/**
+ * Test if the instruction @c i can change memory that a load might
+ * read.  Once the function is in SSA form, the stores that are left
+ * are to slots whose address is taken.
+ *
+ * @param i The instruction.
+ *
+ * @return true if it can, false otherwise.
+ */
+extern int ir_clobbers_memory (const struct ir_insn *i);
+
+/**
+ * Test if @c i computes the value of the whole expression that it
+ * came from, so that the AST can be replaced by something else
+ * holding the same value.  The expression must be free of side
+ * effects and not be a comparison or thrown away.
+ *
+ * @param i The instruction.
+ *
+ * @return true if it does, false otherwise.
+ */
+extern int ir_defines_origin (const struct ir_insn *i);
+
+/**
+ * Put @c f into SSA form.  Every stack slot whose address is never
+ * taken is promoted: its loads become copies of the reaching value,
+ * its stores become nops and phis are placed where values merge.  A
+ * slot that is read before it is written reaches its uses as the slot
+ * operand itself, standing for the unknown value it has on entry.
+ *
+ * @param f The function to convert.
+ */
+extern void ir_build_ssa (struct ir_func *f);
+
+/**
+ * Get the name of the operator @c op.
+ *
+ * @param op An operator as stored in ast::binary or ast::unary.
+ *
+ * @return The printable name of @c op.
+ */
+extern const char *ir_op_name (int op);
+
+#endif
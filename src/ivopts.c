@@ -0,0 +1,728 @@
+/**
+ * @file   ivopts.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief  Induction variable strength reduction.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * A basic induction variable is a variable whose only change in a
+ * loop is a single statement adding the same constant to it on every
+ * iteration, which in SSA form is a phi at the loop header whose
+ * value from the back edge is the phi plus a constant.
+ *
+ * Every a[i] in the loop, where @c a doesn't change in the loop and
+ * @c i is an induction variable, is replaced by *p, where @c p is set
+ * to &a[i] before the loop and is stepped right after @c i is.  This
+ * saves reloading @c i and scaling it on every access.  An a[i + c]
+ * becomes p[c], which addresses memory with a constant displacement.
+ *
+ * If the only other use of @c i is the test that ends the loop
+ * against a value that doesn't change in the loop, then @c i is
+ * replaced by a counter that holds the distance to the end of the
+ * loop and counts down towards zero, so the test is a comparison with
+ * zero straight after the counter is stepped.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "compiler.h"
+#include "free.h"
+#include "ir.h"
+#include "lib.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct ir_func *f = NULL; /**< The function being optimized. */
+static int *insn_block = NULL;	/**< The block of each instruction. */
+static int *def_insn = NULL;	/**< The instruction defining each
+				   register, or -1 for a phi. */
+static int *def_block = NULL;	/**< The block defining each
+				   register. */
+static char *skip = NULL;	/**< The instructions that go away
+				   when the accesses are rewritten. */
+
+/**
+ * A basic induction variable.
+ *
+ */
+struct induction
+{
+  int loop;			/**< The loop it steps in. */
+  int phi;			/**< Its value at the top of the
+				   loop. */
+  int next;			/**< Its value after the step. */
+  long long step;		/**< The amount added every
+				   iteration. */
+  size_t inc;			/**< The instruction doing the step. */
+  struct ast *stmt;		/**< The statement doing the step. */
+  struct ast *var;		/**< A copy of the variable. */
+  size_t test;			/**< The instruction of the test that
+				   ends the loop. */
+  struct ast *cmp;		/**< The AST of that test, or NULL if
+				   the variable is kept. */
+  struct ast *counter;		/**< The variable counting down. */
+};
+
+/**
+ * A pointer that follows an induction variable through an array.
+ *
+ */
+struct pointer
+{
+  size_t iv;			/**< The induction variable. */
+  long long base;		/**< The register holding the
+				   array. */
+  struct ast *array;		/**< A copy of the variable holding
+				   the array. */
+  struct ast *temp;		/**< The pointer. */
+};
+
+/**
+ * An array access that is made through a pointer.
+ *
+ */
+struct access
+{
+  struct ast *node;		/**< The '[' AST. */
+  int ptr;			/**< The pointer. */
+  long long offset;		/**< The constant added to the
+				   index. */
+};
+
+static struct induction *ivs = NULL; /**< The induction variables. */
+static size_t nivs = 0;		/**< Number of induction variables. */
+static size_t aivs = 0;		/**< Allocated induction variables. */
+static struct pointer *ptrs = NULL; /**< The pointers. */
+static size_t nptrs = 0;	/**< Number of pointers. */
+static size_t aptrs = 0;	/**< Allocated pointers. */
+static struct access *accesses = NULL; /**< The accesses, sorted by
+					  node. */
+static size_t naccesses = 0;	/**< Number of accesses. */
+static size_t aaccesses = 0;	/**< Allocated accesses. */
+
+/**
+ * Look through the copies that reads of promoted variables become.
+ *
+ */
+static struct ir_operand
+value_of (struct ir_operand o)
+{
+  while (o.kind == ir_vreg && def_insn[o.val] >= 0
+	 && f->insns[def_insn[o.val]].code == ir_copy)
+    o = f->insns[def_insn[o.val]].a;
+  return o;
+}
+
+/**
+ * Test if the operand @c o holds the value of induction variable
+ * number @c n.
+ *
+ */
+static int
+is_iv (size_t n, struct ir_operand o)
+{
+  o = value_of (o);
+  return o.kind == ir_vreg && (o.val == ivs[n].phi || o.val == ivs[n].next);
+}
+
+/**
+ * Test if the operand @c o holds the same value throughout the loop
+ * @c l.
+ *
+ */
+static int
+loop_invariant (const struct ir_loop *l, struct ir_operand o)
+{
+  o = value_of (o);
+  if (o.kind == ir_imm)
+    return 1;
+  return o.kind == ir_vreg && !l->blocks[def_block[o.val]];
+}
+
+/**
+ * Find the top level statement @c s, or the assignment whose value is
+ * @c s, in the body @c body.
+ *
+ */
+static struct ast *
+find_statement (struct ast *body, struct ast *s)
+{
+  for (; body != NULL; body = body->next)
+    if (body == s
+	|| (body->type == binary_type && body->op.binary.op == '='
+	    && body->ops[1] == s))
+      return body;
+  return NULL;
+}
+
+/**
+ * Find the basic induction variables of loop number @c n.
+ *
+ * @param n The loop.
+ * @param body The statements of the function.
+ */
+static void
+find_inductions (size_t n, struct ast *body)
+{
+  const struct ir_loop *l = &f->loops[n];
+  const struct ir_block *h = &f->blocks[l->header];
+  size_t p;
+  if (h->npreds != 2 || ir_loop_preheader (f, l) < 0)
+    return;
+  int back = l->blocks[h->preds[0]] ? 0 : 1;
+  for (p = h->phi_first; p < h->phi_first + h->phi_count; p++)
+    {
+      struct ir_operand v = value_of (f->phis[p].args[back]);
+      if (v.kind != ir_vreg || def_insn[v.val] < 0)
+	continue;
+      size_t i = def_insn[v.val];
+      struct ir_insn *in = &f->insns[i];
+      struct ir_operand a = value_of (in->a);
+      if (in->code != ir_binary || (in->op != '+' && in->op != '-')
+	  || a.kind != ir_vreg || a.val != f->phis[p].dest
+	  || in->b.kind != ir_imm || in->b.val == 0
+	  || in->b.val < -(1 << 24) || in->b.val > (1 << 24))
+	continue;
+
+      struct ast *stmt = find_statement (body, in->origin);
+      if (stmt == NULL || stmt->ops[0]->type != variable_type
+	  || !IS_MEMORY (stmt->ops[0]->loc)
+	  || stmt->ops[0]->loc->offset != f->phis[p].slot)
+	continue;
+
+      if (nivs == aivs)
+	ivs = x2nrealloc (ivs, &aivs, sizeof *ivs);
+      struct induction *iv = &ivs[nivs++];
+      memset (iv, 0, sizeof *iv);
+      iv->loop = n;
+      iv->phi = f->phis[p].dest;
+      iv->next = v.val;
+      iv->step = in->op == '+' ? in->b.val : -in->b.val;
+      iv->inc = i;
+      iv->stmt = stmt;
+      iv->var = ast_dup (stmt->ops[0]);
+    }
+}
+
+/**
+ * Find the pointer for the array in register @c base stepped along
+ * with induction variable number @c n, making it if there isn't one.
+ *
+ */
+static int
+find_pointer (size_t n, long long base, struct ast *array)
+{
+  size_t p;
+  for (p = 0; p < nptrs; p++)
+    if (ptrs[p].iv == n && ptrs[p].base == base)
+      return p;
+  if (nptrs == aptrs)
+    ptrs = x2nrealloc (ptrs, &aptrs, sizeof *ptrs);
+  ptrs[nptrs].iv = n;
+  ptrs[nptrs].base = base;
+  ptrs[nptrs].array = ast_dup (array);
+  ptrs[nptrs].temp = NULL;
+  return nptrs++;
+}
+
+/**
+ * Find the array accesses indexed by induction variable number @c n.
+ *
+ */
+static void
+find_accesses (size_t n)
+{
+  const struct ir_loop *l = &f->loops[ivs[n].loop];
+  size_t i;
+  for (i = 0; i < f->ninsns; i++)
+    {
+      struct ir_insn *in = &f->insns[i];
+      if (in->code != ir_index || !l->blocks[insn_block[i]])
+	continue;
+      struct ast *s = in->origin;
+      struct ir_operand base = value_of (in->a);
+      if (s == NULL || s->type != binary_type || s->op.binary.op != '['
+	  || s->ops[0]->type != variable_type || base.kind != ir_vreg
+	  || !loop_invariant (l, base))
+	continue;
+
+      /* The index is either the variable or the variable plus a
+	 constant. */
+      long long offset = 0;
+      struct ir_operand idx = value_of (in->b);
+      size_t plus = i;
+      if (idx.kind == ir_vreg && def_insn[idx.val] >= 0
+	  && !is_iv (n, idx))
+	{
+	  plus = def_insn[idx.val];
+	  struct ir_insn *add = &f->insns[plus];
+	  if (add->code != ir_binary || add->op != '+'
+	      || add->origin != s->ops[1] || !is_iv (n, add->a)
+	      || add->b.kind != ir_imm
+	      || add->b.val < -(1 << 24) || add->b.val > (1 << 24))
+	    continue;
+	  offset = add->b.val;
+	}
+      else if (!is_iv (n, idx))
+	continue;
+
+      if (naccesses == aaccesses)
+	accesses = x2nrealloc (accesses, &aaccesses, sizeof *accesses);
+      accesses[naccesses].node = s;
+      accesses[naccesses].ptr = find_pointer (n, base.val, s->ops[0]);
+      accesses[naccesses].offset = offset;
+      naccesses++;
+      skip[i] = skip[plus] = 1;
+    }
+}
+
+/**
+ * Mark the register @c r and everything its value is made from as
+ * live.
+ *
+ */
+static void
+mark_live (char *live, long long r)
+{
+  while (!live[r])
+    {
+      live[r] = 1;
+      if (def_insn[r] < 0)
+	{
+	  size_t p;
+	  for (p = 0; p < f->nphis; p++)
+	    if (f->phis[p].dest == r)
+	      {
+		int k;
+		for (k = 0; k < f->blocks[f->phis[p].block].npreds; k++)
+		  if (f->phis[p].args[k].kind == ir_vreg)
+		    mark_live (live, f->phis[p].args[k].val);
+	      }
+	  return;
+	}
+      struct ir_insn *in = &f->insns[def_insn[r]];
+      if (in->code != ir_copy || in->a.kind != ir_vreg)
+	return;
+      r = in->a.val;
+    }
+}
+
+/**
+ * Test if induction variable number @c n is used for anything other
+ * than its step, the accesses that are being rewritten and the
+ * instruction @c test.
+ *
+ */
+static int
+iv_used (size_t n, size_t test)
+{
+  char *live = xzalloc (f->nvregs + 1);
+  size_t i;
+  for (i = 0; i < f->ninsns; i++)
+    {
+      struct ir_insn *in = &f->insns[i];
+      if (in->code == ir_copy || skip[i] || i == ivs[n].inc || i == test)
+	continue;
+      if (in->a.kind == ir_vreg)
+	mark_live (live, in->a.val);
+      if (in->b.kind == ir_vreg)
+	mark_live (live, in->b.val);
+      if (in->c.kind == ir_vreg)
+	mark_live (live, in->c.val);
+    }
+  int used = live[ivs[n].phi] || live[ivs[n].next];
+  FREE (live);
+  return used;
+}
+
+/**
+ * Test if @c op is one of the comparisons.
+ *
+ */
+static int
+is_compare (int op)
+{
+  return op == '<' || op == '>' || op == LE || op == GE || op == EQ;
+}
+
+/**
+ * Find the test that ends the loop of induction variable number @c n,
+ * and keep it if it is the only other use of the variable.
+ *
+ */
+static void
+find_exit_test (size_t n)
+{
+  const struct ir_loop *l = &f->loops[ivs[n].loop];
+  size_t b, found = 0, test = 0;
+  for (b = 0; b < f->nblocks; b++)
+    {
+      if (!l->blocks[b] || f->blocks[b].count == 0)
+	continue;
+      struct ir_insn *br = &f->insns[f->blocks[b].first
+				     + f->blocks[b].count - 1];
+      if (br->code != ir_branch || br->a.kind != ir_vreg
+	  || (l->blocks[f->blocks[b].succ[0]]
+	      && l->blocks[f->blocks[b].succ[1]]))
+	continue;
+      struct ir_operand c = value_of (br->a);
+      if (c.kind != ir_vreg || def_insn[c.val] < 0)
+	continue;
+      size_t i = def_insn[c.val];
+      if (f->insns[i].code == ir_unary && f->insns[i].op == '!')
+	{
+	  c = value_of (f->insns[i].a);
+	  if (c.kind != ir_vreg || def_insn[c.val] < 0)
+	    continue;
+	  i = def_insn[c.val];
+	}
+      struct ir_insn *in = &f->insns[i];
+      if (in->code != ir_binary || in->origin == NULL
+	  || in->origin->type != binary_type
+	  || in->origin->op.binary.op != in->op
+	  || !is_compare (in->op))
+	continue;
+      found++;
+      test = i;
+    }
+  if (found != 1)
+    return;
+
+  /* One side must be the variable and the other a constant or a
+     variable that doesn't change in the loop. */
+  struct ir_insn *in = &f->insns[test];
+  struct ast *s = in->origin;
+  int left = is_iv (n, in->a);
+  if (left ? !loop_invariant (l, in->b)
+      : !is_iv (n, in->b) || !loop_invariant (l, in->a))
+    return;
+  int j;
+  for (j = 0; j < 2; j++)
+    if (s->ops[j]->type != variable_type && s->ops[j]->type != integer_type)
+      return;
+  if (iv_used (n, test))
+    return;
+  ivs[n].test = test;
+  ivs[n].cmp = s;
+}
+
+static int
+compare_access (const void *a, const void *b)
+{
+  uintptr_t x = (uintptr_t) ((const struct access *) a)->node;
+  uintptr_t y = (uintptr_t) ((const struct access *) b)->node;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Replace the accesses with their pointers.
+ *
+ * @param ss Reference to an AST pointer.
+ */
+static void
+rewrite_r (struct ast **ss)
+{
+  assert (ss != NULL);
+#define s (*ss)
+  if (s == NULL)
+    return;
+  struct access key = { s, 0, 0 };
+  struct access *a = bsearch (&key, accesses, naccesses, sizeof *accesses,
+			      compare_access);
+  int i;
+  for (i = 0; i < s->num_ops; i++)
+    rewrite_r (&s->ops[i]);
+  if (a != NULL)
+    {
+      struct ast *p = ast_dup (ptrs[a->ptr].temp);
+      struct ast *t = a->offset == 0 ? make_unary ('*', p)
+	: make_binary ('[', p, make_integer (a->offset));
+      t->throw_away = s->throw_away;
+      t->boolean_not = s->boolean_not;
+      t->noreturnint = s->noreturnint;
+      SWAP_AST (t, s);
+      AST_FREE (t);
+    }
+  rewrite_r (&s->next);
+#undef s
+}
+
+/**
+ * Make the statement x = x + c.
+ *
+ */
+static struct ast *
+make_step (struct ast *x, long long c)
+{
+  struct ast *t = make_binary ('=', ast_dup (x),
+			       make_binary ('+', ast_dup (x),
+					    make_integer (c)));
+  t->throw_away = 1;
+  return t;
+}
+
+/**
+ * Make the statement x = v.
+ *
+ */
+static struct ast *
+make_set (struct ast *x, struct ast *v)
+{
+  struct ast *t = make_binary ('=', ast_dup (x), v);
+  t->throw_away = 1;
+  return t;
+}
+
+/**
+ * Turn the test of induction variable number @c n into a test of its
+ * counter, returning the statement that sets the counter.
+ *
+ */
+static struct ast *
+count_down (size_t n)
+{
+  struct induction *iv = &ivs[n];
+  struct ast *s = iv->cmp;
+  int left = is_iv (n, f->insns[iv->test].a);
+
+  /* l op r is the same as (l - r) op 0, and l - r moves by the step
+     if the variable is on the left and against it otherwise.  The
+     counter is whichever of l - r and r - l moves down. */
+  long long delta = left ? iv->step : -iv->step;
+  struct ast *init;
+  if (delta < 0)
+    init = make_binary ('-', ast_dup (s->ops[0]), ast_dup (s->ops[1]));
+  else
+    {
+      init = make_binary ('-', ast_dup (s->ops[1]), ast_dup (s->ops[0]));
+      switch (s->op.binary.op)
+	{
+	case '<': s->op.binary.op = '>'; break;
+	case '>': s->op.binary.op = '<'; break;
+	case LE: s->op.binary.op = GE; break;
+	case GE: s->op.binary.op = LE; break;
+	default: break;
+	}
+    }
+  AST_FREE (s->ops[0]);
+  AST_FREE (s->ops[1]);
+  s->ops[0] = ast_dup (iv->counter);
+  s->ops[1] = make_integer (0);
+  return make_set (iv->counter, init);
+}
+
+/**
+ * Insert the statements @c stmts right before the label @c label in
+ * the body @c body.
+ *
+ */
+static void
+insert_before_label (struct ast *body, const char *label, struct ast *stmts)
+{
+  struct ast **link;
+  for (link = &body->ops[0]; *link != NULL; link = &(*link)->next)
+    if ((*link)->type == label_type && STREQ (ast_label_name (*link), label))
+      break;
+  assert (*link != NULL);
+  *link = ast_cat (stmts, *link);
+}
+
+/**
+ * Rewrite the function @c function with the induction variables that
+ * were found.
+ *
+ */
+static void
+apply (struct ast *function)
+{
+  struct ast *body = function->ops[1];
+  size_t n, p;
+
+  /* The variables are all made before anything is changed since they
+     add to the allocation at the start of the function. */
+  for (p = 0; p < nptrs; p++)
+    ptrs[p].temp = make_temporary (function);
+  for (n = 0; n < nivs; n++)
+    if (ivs[n].cmp != NULL)
+      ivs[n].counter = make_temporary (function);
+
+  qsort (accesses, naccesses, sizeof *accesses, compare_access);
+  rewrite_r (&body->ops[0]);
+
+  struct ast **pre = xzalloc ((f->nloops + 1) * sizeof *pre);
+  for (n = 0; n < nivs; n++)
+    {
+      struct induction *iv = &ivs[n];
+      struct ast *after = NULL;
+      for (p = 0; p < nptrs; p++)
+	if (ptrs[p].iv == n)
+	  {
+	    struct ast *addr = make_unary ('&', make_binary
+					   ('[', ast_dup (ptrs[p].array),
+					    ast_dup (iv->var)));
+	    pre[iv->loop] = ast_cat (pre[iv->loop],
+				     make_set (ptrs[p].temp, addr));
+	    after = ast_cat (after, make_step (ptrs[p].temp, iv->step * 8));
+	  }
+
+      /* The counter replaces the variable's step, and goes last so
+	 that the test right after it can use the flags it sets. */
+      struct ast **link;
+      for (link = &body->ops[0]; *link != iv->stmt; link = &(*link)->next)
+	assert (*link != NULL);
+      if (iv->cmp != NULL)
+	{
+	  pre[iv->loop] = ast_cat (pre[iv->loop], count_down (n));
+	  struct ast *t = iv->stmt;
+	  struct ast *step;
+	  if (llabs (iv->step) == 1)
+	    {
+	      step = make_unary (DEC, ast_dup (iv->counter));
+	      step->unary_prefix = 1;
+	      step->throw_away = 1;
+	    }
+	  else
+	    step = make_step (iv->counter, -llabs (iv->step));
+	  *link = ast_cat (after, ast_cat (step, t->next));
+	  t->next = NULL;
+	  AST_FREE (t);
+	}
+      else
+	{
+	  link = &(*link)->next;
+	  *link = ast_cat (after, *link);
+	}
+    }
+
+  for (n = 0; n < f->nloops; n++)
+    if (pre[n] != NULL)
+      insert_before_label (body, f->blocks[f->loops[n].header].label,
+			   pre[n]);
+  FREE (pre);
+
+  for (p = 0; p < nptrs; p++)
+    AST_FREE (ptrs[p].temp);
+  for (n = 0; n < nivs; n++)
+    if (ivs[n].counter != NULL)
+      AST_FREE (ivs[n].counter);
+}
+
+/**
+ * Strength reduce the induction variables of the function @c s.
+ *
+ */
+static void
+ivopts_function (struct ast *s)
+{
+  f = ir_lower (s);
+  ir_build_ssa (f);
+  ir_find_loops (f);
+  if (f->nloops == 0)
+    {
+      f = ir_free (f);
+      return;
+    }
+
+  size_t b, n;
+  insn_block = xnmalloc (f->ninsns + 1, sizeof *insn_block);
+  def_insn = xnmalloc (f->nvregs + 1, sizeof *def_insn);
+  def_block = xnmalloc (f->nvregs + 1, sizeof *def_block);
+  for (n = 0; n < (size_t) f->nvregs; n++)
+    def_insn[n] = def_block[n] = -1;
+  for (b = 0; b < f->nblocks; b++)
+    for (n = f->blocks[b].first;
+	 n < f->blocks[b].first + f->blocks[b].count; n++)
+      {
+	insn_block[n] = b;
+	if (f->insns[n].dest >= 0)
+	  {
+	    def_insn[f->insns[n].dest] = n;
+	    def_block[f->insns[n].dest] = b;
+	  }
+      }
+  for (n = 0; n < f->nphis; n++)
+    {
+      def_insn[f->phis[n].dest] = -1;
+      def_block[f->phis[n].dest] = f->phis[n].block;
+    }
+  skip = xzalloc (f->ninsns + 1);
+
+  for (n = 0; n < f->nloops; n++)
+    find_inductions (n, s->ops[1]->ops[0]);
+  for (n = 0; n < nivs; n++)
+    find_accesses (n);
+  for (n = 0; n < nivs; n++)
+    find_exit_test (n);
+
+  /* Only keep the variables that something is done to. */
+  size_t kept = 0, p;
+  for (n = 0; n < nivs; n++)
+    {
+      int used = ivs[n].cmp != NULL;
+      for (p = 0; p < nptrs; p++)
+	if (ptrs[p].iv == n)
+	  {
+	    used = 1;
+	    ptrs[p].iv = kept;
+	  }
+      if (used)
+	ivs[kept++] = ivs[n];
+      else
+	AST_FREE (ivs[n].var);
+    }
+  nivs = kept;
+  if (nivs > 0)
+    apply (s);
+
+  for (p = 0; p < nptrs; p++)
+    AST_FREE (ptrs[p].array);
+  for (n = 0; n < nivs; n++)
+    AST_FREE (ivs[n].var);
+  FREE (accesses);
+  naccesses = aaccesses = 0;
+  FREE (ptrs);
+  nptrs = aptrs = 0;
+  FREE (ivs);
+  nivs = aivs = 0;
+  FREE (skip);
+  FREE (def_block);
+  FREE (def_insn);
+  FREE (insn_block);
+  f = ir_free (f);
+}
+
+int
+reduce_induction_variables (struct ast *s)
+{
+  if (optimize < 1)
+    return 0;
+  for (; s != NULL; s = s->next)
+    if (s->type == function_type)
+      ivopts_function (s);
+  return 0;
+}
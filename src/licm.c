@@ -0,0 +1,463 @@
+/**
+ * @file   licm.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief  Loop invariant code motion.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Each function is lowered into the IR and put into SSA form, and its
+ * natural loops are found from the back edges of the control flow
+ * graph.  A value is invariant in a loop if all of its operands are
+ * defined outside of the loop or are invariant themselves.  Loads are
+ * only invariant if nothing in the loop can change memory, and since
+ * the variables whose address is never taken live in SSA form, reads
+ * of them are invariant whenever no store in the loop reaches them.
+ *
+ * What is moved is the AST that a value came from, not the value, and
+ * the AST reads its variables again wherever it is put.  So a read of
+ * a variable that is assigned anywhere in the loop is never
+ * invariant, even when SSA form shows that it holds an invariant
+ * value, and an operand that is computed in the loop is only
+ * invariant if it is computed by a part of the same AST.
+ *
+ * Every invariant expression is moved out of the outermost loop that
+ * it is invariant in, into a new stack slot that is assigned right
+ * before the label of the loop's header.  Expressions that can trap
+ * (divisions and loads) are only moved if they would be evaluated on
+ * every iteration anyway.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "compiler.h"
+#include "free.h"
+#include "ir.h"
+#include "lib.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct ir_func *f = NULL; /**< The function being optimized. */
+static int *insn_block = NULL;	/**< The block of each instruction. */
+static int *def_insn = NULL;	/**< The instruction defining each
+				   register, or -1 for a phi. */
+static int *def_block = NULL;	/**< The block defining each
+				   register. */
+static char *invariant = NULL;	/**< Which instructions are invariant
+				   in the current loop. */
+static int *target = NULL;	/**< The loop that each instruction is
+				   moved out of, or -1. */
+static enum ir_code *access = NULL; /**< For each instruction,
+				       ir_load or ir_store if it read or
+				       wrote a stack slot before the
+				       function was put into SSA form,
+				       or ir_nop. */
+static long long *access_slot = NULL; /**< The slot that it read or
+					 wrote. */
+
+/**
+ * Test if the AST @c s is or contains the AST @c t.
+ *
+ */
+static int
+contains (const struct ast *s, const struct ast *t)
+{
+  if (s == t)
+    return 1;
+  int i;
+  const struct ast *u;
+  for (i = 0; i < s->num_ops; i++)
+    for (u = s->ops[i]; u != NULL; u = u->next)
+      if (contains (u, t))
+	return 1;
+  return 0;
+}
+
+/**
+ * Test if the operand @c o of the instruction @c in is invariant in
+ * the loop @c l.  If it is computed in the loop, that has to be done
+ * by the AST of @c in, so that it is moved along with it.
+ *
+ */
+static int
+invariant_operand (const struct ir_loop *l, const struct ir_insn *in,
+		   const struct ir_operand *o)
+{
+  if (o->kind != ir_vreg)
+    return 1;
+  if (!l->blocks[def_block[o->val]])
+    return 1;
+  int d = def_insn[o->val];
+  return (d >= 0 && invariant[d] && in->origin != NULL
+	  && f->insns[d].origin != NULL
+	  && contains (in->origin, f->insns[d].origin));
+}
+
+/**
+ * Test if the block @c b runs on every iteration of the loop @c l
+ * that reaches the back edge or leaves the loop.
+ *
+ */
+static int
+always_runs (const struct ir_loop *l, int b)
+{
+  size_t x;
+  for (x = 0; x < f->nblocks; x++)
+    {
+      if (!l->blocks[x])
+	continue;
+      int k;
+      for (k = 0; k < 2; k++)
+	{
+	  int s = f->blocks[x].succ[k];
+	  if (s >= 0 && (s == l->header || !l->blocks[s])
+	      && !ir_dominates (f, b, x))
+	    return 0;
+	}
+    }
+  return 1;
+}
+
+/**
+ * Find the instructions that are invariant in loop number @c n and
+ * mark the ones that can be moved out of it.
+ *
+ */
+static void
+find_invariants (size_t n)
+{
+  const struct ir_loop *l = &f->loops[n];
+  int clobbered = 0;
+  size_t r, i, j, nstored = 0;
+  long long *stored = xnmalloc (f->ninsns + 1, sizeof *stored);
+  memset (invariant, 0, f->ninsns);
+  for (i = 0; i < f->ninsns; i++)
+    if (l->blocks[insn_block[i]])
+      {
+	if (ir_clobbers_memory (&f->insns[i]))
+	  clobbered = 1;
+	if (access[i] == ir_store)
+	  stored[nstored++] = access_slot[i];
+      }
+
+  /* Every operand is defined before it is used, except through a
+     phi, so one pass in reverse postorder is enough. */
+  for (r = 0; r < f->nrpo; r++)
+    {
+      int b = f->rpo[r];
+      if (!l->blocks[b])
+	continue;
+      struct ir_insn *in;
+      IR_FOR_INSNS (in, f, b)
+	{
+	  switch (in->code)
+	    {
+	    case ir_load:
+	    case ir_loadm:
+	      if (clobbered)
+		continue;
+	    case ir_copy:
+	    case ir_addr:
+	    case ir_index:
+	    case ir_binary:
+	    case ir_unary:
+	    case ir_select:
+	      break;
+
+	    default:
+	      continue;
+	    }
+	  i = in - f->insns;
+	  if (access[i] == ir_load)
+	    {
+	      for (j = 0; j < nstored; j++)
+		if (stored[j] == access_slot[i])
+		  break;
+	      if (j < nstored)
+		continue;
+	    }
+	  if (invariant_operand (l, in, &in->a)
+	      && invariant_operand (l, in, &in->b)
+	      && invariant_operand (l, in, &in->c))
+	    invariant[i] = 1;
+	}
+    }
+  FREE (stored);
+
+  int pre = ir_loop_preheader (f, l);
+  if (pre < 0)
+    return;
+  for (i = 0; i < f->ninsns; i++)
+    {
+      struct ir_insn *in = &f->insns[i];
+      if (target[i] >= 0 || !invariant[i] || !ir_defines_origin (in)
+	  || ast_cost (in->origin) < 2)
+	continue;
+      if (ast_can_trap (in->origin) && !always_runs (l, insn_block[i]))
+	continue;
+      target[i] = n;
+    }
+}
+
+/**
+ * An AST that is moved out of a loop.
+ *
+ */
+struct hoist
+{
+  struct ast *node;		/**< The AST. */
+  int loop;			/**< The loop it is moved out of. */
+  struct ast *temp;		/**< The variable holding its value,
+				   or NULL if it is moved along with
+				   an AST containing it. */
+};
+
+static struct hoist *hoists = NULL; /**< The moves, sorted by node. */
+static size_t nhoists = 0;	/**< Number of moves. */
+static size_t ahoists = 0;	/**< Allocated moves. */
+static struct ast **preheaders = NULL; /**< The statements to place
+					  before the header of each
+					  loop. */
+
+static int
+compare_hoist (const void *a, const void *b)
+{
+  uintptr_t x = (uintptr_t) ((const struct hoist *) a)->node;
+  uintptr_t y = (uintptr_t) ((const struct hoist *) b)->node;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Collect the moves from the marked instructions.
+ *
+ */
+static void
+collect_hoists (void)
+{
+  size_t i;
+  for (i = 0; i < f->ninsns; i++)
+    if (target[i] >= 0)
+      {
+	if (nhoists == ahoists)
+	  hoists = x2nrealloc (hoists, &ahoists, sizeof *hoists);
+	hoists[nhoists].node = f->insns[i].origin;
+	hoists[nhoists].loop = target[i];
+	hoists[nhoists].temp = NULL;
+	nhoists++;
+      }
+  qsort (hoists, nhoists, sizeof *hoists, compare_hoist);
+}
+
+/**
+ * Find the move of @c s.
+ *
+ * @return The move, or NULL if @c s stays where it is.
+ */
+static struct hoist *
+find_hoist (struct ast *s)
+{
+  struct hoist key = { s, 0, NULL };
+  return bsearch (&key, hoists, nhoists, sizeof *hoists, compare_hoist);
+}
+
+/**
+ * Give a variable to every AST that is moved on its own, rather than
+ * inside of an AST containing it that is moved out of the same loop.
+ * The variables are all made before anything is moved since they add
+ * to the allocation at the start of the function.
+ *
+ * @param s The AST to check.
+ * @param loop The loop that the AST being moved is moved out of, or
+ * -1 if @c s isn't being moved.
+ * @param function The function that @c s is in.
+ */
+static void
+make_temporaries (struct ast *s, int loop, struct ast *function)
+{
+  for (; s != NULL; s = s->next)
+    {
+      struct hoist *h = find_hoist (s);
+      int inner = loop;
+      if (h != NULL && h->loop != loop)
+	{
+	  h->temp = make_temporary (function);
+	  inner = h->loop;
+	}
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	make_temporaries (s->ops[i], inner, function);
+    }
+}
+
+/**
+ * Move the collected ASTs out of their loops, replacing them with
+ * their variables.
+ *
+ * @param ss Reference to an AST pointer.
+ */
+static void
+hoist_r (struct ast **ss)
+{
+  assert (ss != NULL);
+#define s (*ss)
+  if (s == NULL)
+    return;
+  struct hoist *h = find_hoist (s);
+  int i;
+  for (i = 0; i < s->num_ops; i++)
+    hoist_r (&s->ops[i]);
+  if (h != NULL && h->temp != NULL)
+    {
+      struct ast *t = ast_dup (h->temp);
+      t->throw_away = s->throw_away;
+      t->noreturnint = s->noreturnint;
+      SWAP_AST (t, s);
+      t->noreturnint = 0;
+      t = make_binary ('=', h->temp, t);
+      t->throw_away = 1;
+      h->temp = NULL;
+      preheaders[h->loop] = ast_cat (preheaders[h->loop], t);
+    }
+  hoist_r (&s->next);
+#undef s
+}
+
+/**
+ * Place the statements that were moved out of each loop right before
+ * the label of its header.
+ *
+ */
+static void
+place_preheaders (struct ast *body)
+{
+  size_t n;
+  for (n = 0; n < f->nloops; n++)
+    {
+      if (preheaders[n] == NULL)
+	continue;
+      const char *label = f->blocks[f->loops[n].header].label;
+      struct ast **link;
+      for (link = &body->ops[0]; *link != NULL; link = &(*link)->next)
+	if ((*link)->type == label_type
+	    && STREQ (ast_label_name (*link), label))
+	  break;
+      assert (*link != NULL);
+      *link = ast_cat (preheaders[n], *link);
+      preheaders[n] = NULL;
+    }
+}
+
+/**
+ * Move the invariant code out of the loops of the function @c s.
+ *
+ */
+static void
+licm_function (struct ast *s)
+{
+  size_t b, n;
+  f = ir_lower (s);
+  access = xnmalloc (f->ninsns + 1, sizeof *access);
+  access_slot = xnmalloc (f->ninsns + 1, sizeof *access_slot);
+  for (n = 0; n < f->ninsns; n++)
+    {
+      const struct ir_insn *in = &f->insns[n];
+      access[n] = ir_nop;
+      if ((in->code == ir_load || in->code == ir_store)
+	  && in->a.kind == ir_slot)
+	{
+	  access[n] = in->code;
+	  access_slot[n] = in->a.val;
+	}
+    }
+  ir_build_ssa (f);
+  ir_find_loops (f);
+  if (f->nloops == 0)
+    {
+      FREE (access_slot);
+      FREE (access);
+      f = ir_free (f);
+      return;
+    }
+
+  insn_block = xnmalloc (f->ninsns + 1, sizeof *insn_block);
+  def_insn = xnmalloc (f->nvregs + 1, sizeof *def_insn);
+  def_block = xnmalloc (f->nvregs + 1, sizeof *def_block);
+  for (b = 0; b < f->nblocks; b++)
+    for (n = f->blocks[b].first;
+	 n < f->blocks[b].first + f->blocks[b].count; n++)
+      {
+	insn_block[n] = b;
+	if (f->insns[n].dest >= 0)
+	  {
+	    def_insn[f->insns[n].dest] = n;
+	    def_block[f->insns[n].dest] = b;
+	  }
+      }
+  for (n = 0; n < f->nphis; n++)
+    {
+      def_insn[f->phis[n].dest] = -1;
+      def_block[f->phis[n].dest] = f->phis[n].block;
+    }
+  invariant = xnmalloc (f->ninsns + 1, 1);
+  target = xnmalloc (f->ninsns + 1, sizeof *target);
+  for (n = 0; n < f->ninsns; n++)
+    target[n] = -1;
+
+  /* The outer loops come first, so everything is moved as far out as
+     it can go. */
+  for (n = 0; n < f->nloops; n++)
+    find_invariants (n);
+
+  collect_hoists ();
+  preheaders = xzalloc ((f->nloops + 1) * sizeof *preheaders);
+  make_temporaries (s->ops[1]->ops[0], -1, s);
+  hoist_r (&s->ops[1]->ops[0]);
+  place_preheaders (s->ops[1]);
+
+  FREE (preheaders);
+  FREE (hoists);
+  nhoists = ahoists = 0;
+  FREE (target);
+  FREE (invariant);
+  FREE (def_block);
+  FREE (def_insn);
+  FREE (insn_block);
+  FREE (access_slot);
+  FREE (access);
+  f = ir_free (f);
+}
+
+int
+hoist_invariants (struct ast *s)
+{
+  if (optimize < 1)
+    return 0;
+  for (; s != NULL; s = s->next)
+    if (s->type == function_type)
+      licm_function (s);
+  return 0;
+}
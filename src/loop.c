@@ -0,0 +1,332 @@
+/**
+ * @file   loop.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief  Matching of counted loops in the flattened body of a
+ * function.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "free.h"
+#include "lib.h"
+#include "loc.h"
+#include "loop.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct ast ***links = NULL;
+size_t nlinks = 0;
+static size_t alinks = 0;	/**< Allocated links. */
+
+void
+collect_links (struct ast *body)
+{
+  struct ast **link;
+  nlinks = 0;
+  for (link = &body->ops[0]; *link != NULL; link = &(*link)->next)
+    {
+      if (nlinks == alinks)
+	links = x2nrealloc (links, &alinks, sizeof *links);
+      links[nlinks++] = link;
+    }
+}
+
+void
+free_links (void)
+{
+  FREE (links);
+  nlinks = alinks = 0;
+}
+
+int
+refers_to (const struct ast *s, const char *name)
+{
+  return ((s->type == label_type || s->type == jump_type
+	   || s->type == cond_type) && STREQ (ast_label_name (s), name));
+}
+
+int
+count_refs (const char *name, size_t from, size_t to)
+{
+  int n = 0;
+  for (; from < to; from++)
+    if (STMT (from)->type != label_type && refers_to (STMT (from), name))
+      n++;
+  return n;
+}
+
+int
+is_local (const struct ast *s)
+{
+  return (s != NULL && s->type == variable_type && !s->boolean_not
+	  && IS_MEMORY (s->loc) && s->loc->index == NULL);
+}
+
+int
+same_local (const struct ast *a, const struct ast *b)
+{
+  return (is_local (a) && is_local (b) && a->loc->offset == b->loc->offset
+	  && STREQ (a->loc->base, b->loc->base));
+}
+
+int
+same_expr (const struct ast *a, const struct ast *b)
+{
+  if (a->type != b->type || a->boolean_not != b->boolean_not)
+    return 0;
+  switch (a->type)
+    {
+    case integer_type:
+      return a->op.integer.i == b->op.integer.i;
+    case variable_type:
+      return same_local (a, b);
+    case binary_type:
+      return (a->op.binary.op == b->op.binary.op
+	      && same_expr (a->ops[0], b->ops[0])
+	      && same_expr (a->ops[1], b->ops[1]));
+    case unary_type:
+      return (a->op.unary.op == b->op.unary.op
+	      && same_expr (a->ops[0], b->ops[0]));
+    default:
+      return 0;
+    }
+}
+
+int
+address_taken (const struct ast *s, const struct ast *v)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == unary_type && s->op.unary.op == '&'
+	  && same_local (s->ops[0], v))
+	return 1;
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	if (address_taken (s->ops[i], v))
+	  return 1;
+    }
+  return 0;
+}
+
+int
+invariant (const struct ast *s, const struct ast *i, const struct ast *body)
+{
+  switch (s->type)
+    {
+    case integer_type:
+      return 1;
+    case variable_type:
+      return (is_local (s) && !same_local (s, i)
+	      && !address_taken (body, s));
+    case binary_type:
+      switch (s->op.binary.op)
+	{
+	case '+':
+	case '-':
+	case '*':
+	case '&':
+	case '|':
+	case '^':
+	  return (invariant (s->ops[0], i, body)
+		  && invariant (s->ops[1], i, body));
+	}
+      return 0;
+    case unary_type:
+      return ((s->op.unary.op == '-' || s->op.unary.op == '~')
+	      && invariant (s->ops[0], i, body));
+    default:
+      return 0;
+    }
+}
+
+int
+is_array (const struct ast *s, const struct ast *v)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == binary_type && s->op.binary.op == '='
+	  && s->ops[0]->type == variable_type
+	  && s->ops[0]->op.variable.type != NULL
+	  && s->ops[1]->type == alloc_type && same_local (s->ops[0], v))
+	{
+	  const char *type = s->ops[0]->op.variable.type;
+	  size_t n = strlen (type);
+	  return n >= 7 && STREQ (type + n - 7, "* const");
+	}
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	if (is_array (s->ops[i], v))
+	  return 1;
+    }
+  return 0;
+}
+
+struct ast *
+element (const struct ast *s, const struct ast *i)
+{
+  if (s->type != binary_type || s->op.binary.op != '[' || s->boolean_not
+      || !is_local (s->ops[0]) || !same_local (s->ops[1], i))
+    return NULL;
+  return s->ops[0];
+}
+
+struct ast *
+counter_of (const struct ast *s)
+{
+  if (s->type == unary_type)
+    return s->op.unary.op == INC && is_local (s->ops[0]) ? s->ops[0] : NULL;
+  if (s->type != binary_type || s->op.binary.op != '='
+      || !is_local (s->ops[0]))
+    return NULL;
+  const struct ast *i = s->ops[0], *v = s->ops[1];
+  if (v->type != binary_type || v->op.binary.op != '+' || v->boolean_not)
+    return NULL;
+  int k;
+  for (k = 0; k < 2; k++)
+    if (same_local (v->ops[k], i) && v->ops[!k]->type == integer_type
+	&& !v->ops[!k]->boolean_not && v->ops[!k]->op.integer.i == 1)
+      return s->ops[0];
+  return NULL;
+}
+
+struct ast *
+loop_end (const struct ast *test, const struct ast *i,
+	  const struct ast *body, int *inclusive)
+{
+  if (test->type != binary_type || test->boolean_not)
+    return NULL;
+  int side;
+  switch (test->op.binary.op)
+    {
+    case '<': side = 0; *inclusive = 0; break;
+    case LE: side = 0; *inclusive = 1; break;
+    case '>': side = 1; *inclusive = 0; break;
+    case GE: side = 1; *inclusive = 1; break;
+    default: return NULL;
+    }
+  struct ast *end = test->ops[!side];
+  if (!same_local (test->ops[side], i) || !invariant (end, i, body))
+    return NULL;
+  return end;
+}
+
+int
+is_guarded (size_t head, size_t back, const struct ast *i, int known,
+	    long long start)
+{
+  if (head == 0 || back + 1 >= nlinks)
+    return 0;
+  const struct ast *s = STMT (head - 1), *after = STMT (back + 1);
+  if (s->type != cond_type || after->type != label_type
+      || STRNEQ (ast_label_name (s), ast_label_name (after)))
+    return 0;
+  const struct ast *t = s->ops[0], *u = STMT (back)->ops[0];
+  if (t->type != binary_type || t->boolean_not == u->boolean_not
+      || t->op.binary.op != u->op.binary.op)
+    return 0;
+  int side;
+  for (side = 0; side < 2; side++)
+    if (!same_expr (t->ops[side], u->ops[side])
+	&& !(known && same_local (u->ops[side], i)
+	     && t->ops[side]->type == integer_type
+	     && !t->ops[side]->boolean_not
+	     && t->ops[side]->op.integer.i == start))
+      return 0;
+  return 1;
+}
+
+/**
+ * Test if the variable @c i is assigned, incremented or decremented
+ * in @c s or the ASTs below it.
+ *
+ */
+static int
+writes (const struct ast *s, const struct ast *i)
+{
+  if ((s->type == binary_type && s->op.binary.op == '='
+       && same_local (s->ops[0], i))
+      || (s->type == unary_type
+	  && (s->op.unary.op == INC || s->op.unary.op == DEC)
+	  && same_local (s->ops[0], i)))
+    return 1;
+  int k;
+  for (k = 0; k < s->num_ops; k++)
+    {
+      const struct ast *t;
+      for (t = s->ops[k]; t != NULL; t = t->next)
+	if (writes (t, i))
+	  return 1;
+    }
+  return 0;
+}
+
+int
+start_value (size_t head, const struct ast *i, long long *out)
+{
+  size_t k;
+  for (k = head; k-- > 0;)
+    {
+      const struct ast *t = STMT (k);
+      if (t->type == label_type || t->type == jump_type
+	  || t->type == ret_type)
+	return 0;
+      if (!writes (t, i))
+	continue;
+      if (t->type == binary_type && t->op.binary.op == '='
+	  && same_local (t->ops[0], i) && t->ops[1]->type == integer_type
+	  && !t->ops[1]->boolean_not)
+	{
+	  *out = t->ops[1]->op.integer.i;
+	  return 1;
+	}
+      return 0;
+    }
+  return 0;
+}
+
+struct ast *
+make_target (struct ast *s)
+{
+  char *name = xstrdup (ast_label_name (s));
+  MAKE_BASE_LOC (s->loc, symbol_loc, name);
+  return s;
+}
+
+struct ast *
+make_call (const char *name, struct ast *args)
+{
+  struct ast *f = make_variable (NULL, xstrdup (name));
+  MAKE_BASE_LOC (f->loc, literal_loc, xstrdup (name));
+  return make_function_call (f, args);
+}
+
+struct ast *
+address_of (const struct ast *a, struct ast *index)
+{
+  return make_unary ('&', make_binary ('[', ast_dup (a), index));
+}
@@ -0,0 +1,180 @@
+/**
+ * @file   loop.h
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief  Matching of counted loops in the flattened body of a
+ * function.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The loop passes that work on the AST see the body of a function as
+ * a list of statements, where a loop is a run of statements from a
+ * label to a cond that branches back to it.  These are the pieces
+ * that they share for finding the statements, the counter and the
+ * bounds of such a loop.
+ *
+ */
+
+#ifndef LOOP_H
+#define LOOP_H
+
+#include "ast.h"
+
+#include <stddef.h>
+
+extern struct ast ***links;	/**< The link to each statement of
+				   the function body. */
+extern size_t nlinks;		/**< Number of statements. */
+
+/** The statement number @c N of the body. */
+#define STMT(N) (*links[N])
+
+/**
+ * Collect the links to the statements of @c body.
+ *
+ */
+extern void collect_links (struct ast *body);
+
+/**
+ * Free the links collected by collect_links.
+ *
+ */
+extern void free_links (void);
+
+/**
+ * Test if the label, jump or cond @c s refers to the label @c name.
+ *
+ */
+extern int refers_to (const struct ast *s, const char *name);
+
+/**
+ * Count the jumps and conds that branch to the label @c name between
+ * statements @c from and @c to.
+ *
+ */
+extern int count_refs (const char *name, size_t from, size_t to);
+
+/**
+ * Test if @c s is a local variable.
+ *
+ */
+extern int is_local (const struct ast *s);
+
+/**
+ * Test if @c a and @c b are the same local variable.
+ *
+ */
+extern int same_local (const struct ast *a, const struct ast *b);
+
+/**
+ * Test if @c a and @c b are the same expression of local variables
+ * and constants.
+ *
+ */
+extern int same_expr (const struct ast *a, const struct ast *b);
+
+/**
+ * Test if the address of the variable @c v is taken in @c s or the
+ * ASTs that follow it.
+ *
+ */
+extern int address_taken (const struct ast *s, const struct ast *v);
+
+/**
+ * Test if the expression @c s only reads constants and local
+ * variables other than @c i whose addresses aren't taken in @c body,
+ * so that it can't change while the loop runs.
+ *
+ */
+extern int invariant (const struct ast *s, const struct ast *i,
+		      const struct ast *body);
+
+/**
+ * Test if the variable @c v is declared as an array in @c s or the
+ * ASTs that follow it.  The pointer to an array is constant, so it
+ * never points anywhere else.
+ *
+ */
+extern int is_array (const struct ast *s, const struct ast *v);
+
+/**
+ * Get the array that @c s indexes with the variable @c i.
+ *
+ * @return The array, or NULL if @c s is something else.
+ */
+extern struct ast *element (const struct ast *s, const struct ast *i);
+
+/**
+ * Get the counter that the statement @c s adds one to.
+ *
+ * @return The counter, or NULL if @c s is something else.
+ */
+extern struct ast *counter_of (const struct ast *s);
+
+/**
+ * Find the value that the loop that repeats while @c test is true
+ * counts the variable @c i up to.
+ *
+ * @param body The first statement of the body of the function.
+ * @param inclusive Where to store whether the loop runs for the end
+ * as well.
+ *
+ * @return The end, or NULL if @c test isn't such a test.
+ */
+extern struct ast *loop_end (const struct ast *test, const struct ast *i,
+			     const struct ast *body, int *inclusive);
+
+/**
+ * Test if the loop from statement @c head to @c back is skipped,
+ * unless its test is true, by a cond just before it that branches to
+ * just after it.  The counter @c i in the test of the cond may have
+ * been replaced by its @c start value.
+ *
+ */
+extern int is_guarded (size_t head, size_t back, const struct ast *i,
+		       int known, long long start);
+
+/**
+ * Find the constant that the variable @c i holds on entry to the loop
+ * starting at statement @c head.
+ *
+ * @return true if it was found, false otherwise.
+ */
+extern int start_value (size_t head, const struct ast *i, long long *out);
+
+/**
+ * Give the new label, jump or cond @c s the location of its label.
+ *
+ */
+extern struct ast *make_target (struct ast *s);
+
+/**
+ * Make the call of the library function or builtin @c name with the
+ * arguments @c args.
+ *
+ */
+extern struct ast *make_call (const char *name, struct ast *args);
+
+/**
+ * Make the address of the element @c index of the array @c a.
+ *
+ */
+extern struct ast *address_of (const struct ast *a, struct ast *index);
+
+#endif
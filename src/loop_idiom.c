@@ -0,0 +1,184 @@
+/**
+ * @file   loop_idiom.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief  Replacement of fill and copy loops with library calls.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * A loop that does nothing but store a constant into every element of
+ * an array, or copy every element of one array into another, stores
+ * one word per iteration.  It is replaced with a call of memset or
+ * memcpy, which the code generator expands when the length is a small
+ * constant and the library does with vector instructions otherwise.
+ *
+ *     if (!(i < n)) goto X;
+ *   L:
+ *     a[i] = 0;
+ *     i = i + 1;
+ *     if (i < n) goto L;
+ *   X:
+ *
+ * becomes
+ *
+ *     if (!(i < n)) goto X;
+ *     memset (&a[i], 0, (n - i) * 8);
+ *     i = n;
+ *   X:
+ *
+ * The loop must either be guarded by the test that it repeats on, or
+ * start and end at constants, so that it is known to run at least
+ * once.  Since memset stores a byte, only the constants whose bytes
+ * are all the same are filled with it.  A copy is only replaced when
+ * both sides are arrays declared in the function, which can't
+ * overlap.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "loc.h"
+#include "loop.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** The most elements that a loop with constant bounds may have. */
+#define MAX_ELEMENTS (1LL << 40)
+
+/**
+ * Replace the loop at statement @c head if it fills or copies an
+ * array.
+ *
+ * @param body The first statement of the body of the function.
+ *
+ * @return true if the loop was replaced, false otherwise.
+ */
+static int
+replace_loop (struct ast *body, size_t head)
+{
+  if (head + 3 >= nlinks)
+    return 0;
+  struct ast *label = STMT (head), *store = STMT (head + 1);
+  struct ast *step = STMT (head + 2), *back = STMT (head + 3);
+  if (label->type != label_type || back->type != cond_type
+      || STRNEQ (ast_label_name (label), ast_label_name (back))
+      || count_refs (ast_label_name (label), 0, nlinks) != 1
+      || store->type != binary_type || store->op.binary.op != '='
+      || !store->throw_away)
+    return 0;
+
+  /* The index and the end of the loop are in variables that nothing
+     else can change through a pointer. */
+  struct ast *i = store->ops[0]->type == binary_type
+    ? store->ops[0]->ops[1] : NULL;
+  int inclusive;
+  struct ast *a, *end, *from = NULL;
+  if (!is_local (i) || !same_local (counter_of (step), i)
+      || (a = element (store->ops[0], i)) == NULL || same_local (a, i)
+      || (end = loop_end (back->ops[0], i, body, &inclusive)) == NULL
+      || address_taken (body, i) || address_taken (body, a))
+    return 0;
+
+  struct ast *v = store->ops[1];
+  long long fill = 0;
+  if (v->type == integer_type && !v->boolean_not)
+    {
+      fill = v->op.integer.i & 0xff;
+      if ((long long) (fill * 0x0101010101010101ull) != v->op.integer.i)
+	return 0;
+    }
+  else if ((from = element (v, i)) == NULL || same_local (from, a)
+	   || !is_array (body, a) || !is_array (body, from))
+    return 0;
+
+  /* Either the loop is skipped when it wouldn't run, or it is known
+     to run from a constant to a larger one. */
+  long long start = 0, count = 0;
+  int known = start_value (head, i, &start);
+  if (known && end->type == integer_type && !end->boolean_not)
+    {
+      count = end->op.integer.i - start + inclusive;
+      if (start > end->op.integer.i || count <= 0 || count > MAX_ELEMENTS)
+	return 0;
+    }
+  else if (!is_guarded (head, head + 3, i, known, start))
+    return 0;
+
+  struct ast *dst, *len, *last;
+  if (count > 0)
+    {
+      dst = address_of (a, make_integer (start));
+      len = make_integer (count * 8);
+      last = make_integer (start + count);
+    }
+  else
+    {
+      dst = address_of (a, ast_dup (i));
+      len = make_binary ('-', ast_dup (end), ast_dup (i));
+      if (inclusive)
+	len = make_binary ('+', len, make_integer (1));
+      len = make_binary ('*', len, make_integer (8));
+      last = ast_dup (end);
+      if (inclusive)
+	last = make_binary ('+', last, make_integer (1));
+    }
+  struct ast *src = from != NULL
+    ? address_of (from, ast_dup (dst->ops[0]->ops[1]))
+    : make_integer (fill);
+  struct ast *call = make_call (from != NULL ? "memcpy" : "memset",
+				ast_cat (dst, ast_cat (src, len)));
+  call->throw_away = 1;
+  struct ast *set = make_binary ('=', ast_dup (i), last);
+  set->throw_away = 1;
+
+  *links[head] = ast_cat (call, ast_cat (set, back->next));
+  back->next = NULL;
+  AST_FREE (label);
+  return 1;
+}
+
+int
+replace_loop_idioms (struct ast *s)
+{
+  if (optimize < 2)
+    return 0;
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type != function_type)
+	continue;
+      struct ast *body = s->ops[1];
+      assert (body != NULL && body->type == block_type);
+      size_t k;
+      collect_links (body);
+      for (k = 0; k < nlinks; k++)
+	if (replace_loop (body->ops[0], k))
+	  collect_links (body);
+    }
+  free_links ();
+  return 0;
+}
@@ -33,52 +33,696 @@
 #include "parse.h"
 
 #include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+
+static unsigned long changes = 0; /**< Number of rewrites made by
+				     the current pass. */
+
+int
+fold_constant_binary (int op, long long l, long long r, long long *out)
+{
+  unsigned long long ul = l, ur = r;
+  switch (op)
+    {
+    case '+': *out = ul + ur; break;
+    case '-': *out = ul - ur; break;
+    case '*': *out = ul * ur; break;
+    case '&': *out = l & r; break;
+    case '|': *out = l | r; break;
+    case '^': *out = l ^ r; break;
+    case '<': *out = l < r; break;
+    case '>': *out = l > r; break;
+    case LE: *out = l <= r; break;
+    case GE: *out = l >= r; break;
+    case EQ: *out = l == r; break;
+    case NE: *out = l != r; break;
+    case '/':
+    case '%':
+      if (r == 0 || (l == LLONG_MIN && r == -1))
+	return 0;
+      *out = op == '/' ? l / r : l % r;
+      break;
+    case LS:
+    case RS:
+      if (r < 0 || r > 63)
+	return 0;
+      *out = op == LS ? (long long) (ul << r) : l >> r;
+      break;
+    case MIN: *out = l < r ? l : r; break;
+    case MAX: *out = l > r ? l : r; break;
+    case ROL:
+    case ROR:
+      ur &= 63;
+      if (op == ROR)
+	ur = (64 - ur) & 63;
+      *out = ur == 0 ? ul : (ul << ur) | (ul >> (64 - ur));
+      break;
+    default:
+      return 0;
+    }
+  return 1;
+}
+
+int
+fold_constant_unary (int op, long long a, long long *out)
+{
+  unsigned long long ua = a;
+  int n;
+  switch (op)
+    {
+    case '-': *out = -ua; break;
+    case '~': *out = ~a; break;
+    case '!': *out = !a; break;
+    case ABS: *out = a < 0 ? -ua : ua; break;
+    case BLSR: *out = ua & (ua - 1); break;
+    case BLSI: *out = ua & -ua; break;
+    case POPCOUNT:
+      for (n = 0; ua != 0; ua &= ua - 1)
+	n++;
+      *out = n;
+      break;
+    case CTZ:
+    case CLZ:
+      /* Neither of them is defined for zero. */
+      if (ua == 0)
+	return 0;
+      for (n = 0; op == CTZ ? !(ua & 1) : !(ua >> 63); n++)
+	ua = op == CTZ ? ua >> 1 : ua << 1;
+      *out = n;
+      break;
+    case BSWAP:
+      *out = 0;
+      for (n = 0; n < 8; n++, ua >>= 8)
+	*out = (unsigned long long) *out << 8 | (ua & 0xff);
+      break;
+    default:
+      return 0;
+    }
+  return 1;
+}
+
+/** 
+ * Replace @c s with the constant @c v, applying its boolean NOT.
+ * 
+ * @param ss Reference to the AST to replace.
+ * @param v The value of the AST.
+ * 
+ * @return true
+ */
+static int
+fold_to (struct ast **ss, long long v)
+{
+#define s (*ss)
+  struct ast *t = make_integer (s->boolean_not ? !v : v);
+  t->throw_away = s->throw_away;
+  t->noreturnint = s->noreturnint;
+  SWAP_AST (s, t);
+  AST_FREE (t);
+  return 1;
+#undef s
+}
+
+/** 
+ * Replace @c s with its operand number @c n.
+ * 
+ * @return true if @c s was replaced, false otherwise.
+ */
+static int
+keep_operand (struct ast **ss, int n)
+{
+#define s (*ss)
+  if (s->boolean_not)
+    return 0;
+  struct ast *t = s->ops[n];
+  s->ops[n] = NULL;
+  t->throw_away = s->throw_away;
+  SWAP_AST (s, t);
+  AST_FREE (t);
+  return 1;
+#undef s
+}
+
+/** 
+ * Replace @c s with the negation of its operand number @c n.
+ * 
+ * @return true if @c s was replaced, false otherwise.
+ */
+static int
+negate_operand (struct ast **ss, int n)
+{
+#define s (*ss)
+  if (s->boolean_not)
+    return 0;
+  struct ast *t = make_unary ('-', s->ops[n]);
+  s->ops[n] = NULL;
+  t->throw_away = s->throw_away;
+  SWAP_AST (s, t);
+  AST_FREE (t);
+  return 1;
+#undef s
+}
+
+/** 
+ * Replace the unary @c s with the operand of its operand.
+ * 
+ * @return true if @c s was replaced, false otherwise.
+ */
+static int
+keep_inner (struct ast **ss)
+{
+#define s (*ss)
+  if (s->boolean_not || s->ops[0]->boolean_not)
+    return 0;
+  struct ast *t = s->ops[0]->ops[0];
+  s->ops[0]->ops[0] = NULL;
+  t->throw_away = s->throw_away;
+  SWAP_AST (s, t);
+  AST_FREE (t);
+  return 1;
+#undef s
+}
+
+/** 
+ * Fold the constant operand of @c s into the constant operand of its
+ * left hand side, which has the same operator.
+ * 
+ * @return true if @c s was replaced, false otherwise.
+ */
+static int
+reassociate (struct ast **ss)
+{
+#define s (*ss)
+  long long v;
+  if (s->boolean_not
+      || !fold_constant_binary (s->op.binary.op,
+				s->ops[0]->ops[1]->op.integer.i,
+				s->ops[1]->op.integer.i, &v))
+    return 0;
+  s->ops[0]->ops[1]->op.integer.i = v;
+  return keep_operand (ss, 0);
+#undef s
+}
+
+/** 
+ * Swap the operands of @c s.
+ * 
+ * @return true if they were swapped, false otherwise.
+ */
+static int
+commute (struct ast **ss)
+{
+#define s (*ss)
+  if (s->boolean_not)
+    return 0;
+  SWAP (s->ops[0], s->ops[1]);
+  return 1;
+#undef s
+}
+
+/** 
+ * Turn @c s, which subtracts a constant, into an addition of the
+ * negated constant.
+ * 
+ * @return true if @c s was changed, false otherwise.
+ */
+static int
+sub_to_add (struct ast **ss)
+{
+#define s (*ss)
+  if (s->boolean_not)
+    return 0;
+  s->op.binary.op = '+';
+  s->ops[1]->op.integer.i = -(unsigned long long) s->ops[1]->op.integer.i;
+  return 1;
+#undef s
+}
+
+/** 
+ * Test if two possibly NULL strings are equal.
+ * 
+ */
+static int
+same_string (const char *a, const char *b)
+{
+  return a == b || (a != NULL && b != NULL && STREQ (a, b));
+}
+
+/** 
+ * Test if the variables @c a and @c b are the same, ignoring any
+ * boolean NOT on them.
+ * 
+ */
+static int
+same_variable (const struct ast *a, const struct ast *b)
+{
+  if (a->loc != NULL && b->loc != NULL)
+    return (a->loc->kind == b->loc->kind
+	    && a->loc->offset == b->loc->offset
+	    && a->loc->scale == b->loc->scale
+	    && same_string (a->loc->base, b->loc->base)
+	    && same_string (a->loc->index, b->loc->index));
+  return (a->loc == NULL && b->loc == NULL
+	  && STREQ (a->op.variable.name, b->op.variable.name));
+}
+
+/** 
+ * Test if @c a and @c b are both the same variable or constant.
+ * 
+ */
+static int
+same_value (const struct ast *a, const struct ast *b)
+{
+  if (a->type != b->type || a->boolean_not != b->boolean_not)
+    return 0;
+  if (a->type == integer_type)
+    return a->op.integer.i == b->op.integer.i;
+  if (a->type != variable_type)
+    return 0;
+  return same_variable (a, b);
+}
+
+/** 
+ * Replace @c s with the unary @c op of its operand number @c n.
+ * 
+ * @return true if @c s was replaced, false otherwise.
+ */
+static int
+apply_unary (struct ast **ss, int op, int n)
+{
+#define s (*ss)
+  if (s->boolean_not)
+    return 0;
+  struct ast *t = make_unary (op, s->ops[n]);
+  s->ops[n] = NULL;
+  t->throw_away = s->throw_away;
+  t->noreturnint = s->noreturnint;
+  SWAP_AST (s, t);
+  AST_FREE (t);
+  return 1;
+#undef s
+}
+
+/** 
+ * Replace @c s with the binary @c op of its operands number @c m and
+ * @c n, or of the operands of its left hand side if @c m is -1.
+ * 
+ * @return true if @c s was replaced, false otherwise.
+ */
+static int
+apply_binary (struct ast **ss, int op, int m, int n)
+{
+#define s (*ss)
+  if (s->boolean_not)
+    return 0;
+  struct ast **from = m < 0 ? s->ops[0]->ops : s->ops;
+  if (m < 0)
+    {
+      m = 0;
+      n = 1;
+    }
+  struct ast *t = make_binary (op, from[m], from[n]);
+  from[m] = from[n] = NULL;
+  t->throw_away = s->throw_away;
+  t->noreturnint = s->noreturnint;
+  SWAP_AST (s, t);
+  AST_FREE (t);
+  return 1;
+#undef s
+}
+
+/** 
+ * Turn the ternary @c s with a boolean NOT on its condition around,
+ * so the NOT is gone.
+ * 
+ * @return true if @c s was changed, false otherwise.
+ */
+static int
+invert_ternary (struct ast **ss)
+{
+#define s (*ss)
+  if (s->boolean_not)
+    return 0;
+  s->ops[0]->boolean_not = 0;
+  SWAP (s->ops[1], s->ops[2]);
+  return 1;
+#undef s
+}
+
+/** 
+ * Test if @c a is the comparison @c op of @c l and @c r.
+ * 
+ */
+static int
+compares (const struct ast *a, int op, const struct ast *l,
+	  const struct ast *r)
+{
+  return (a->type == binary_type && a->op.binary.op == op
+	  && !a->boolean_not && same_value (a->ops[0], l)
+	  && same_value (a->ops[1], r));
+}
+
+/** 
+ * Test if @c a is @c b minus one.
+ * 
+ */
+static int
+decrement (const struct ast *a, const struct ast *b)
+{
+  return (a->type == binary_type && a->op.binary.op == '+'
+	  && !a->boolean_not && a->ops[1]->type == integer_type
+	  && !a->ops[1]->boolean_not && a->ops[1]->op.integer.i == -1
+	  && same_value (a->ops[0], b));
+}
+
+/** 
+ * Test if @c a is the negation of @c b.
+ * 
+ */
+static int
+negation (const struct ast *a, const struct ast *b)
+{
+  return (a->type == unary_type && a->op.unary.op == '-'
+	  && !a->boolean_not && same_value (a->ops[0], b));
+}
+
+/** 
+ * Test if @c a and @c b are the same variable or constant, or the
+ * same one masked by the same constant.
+ * 
+ */
+static int
+same_masked (const struct ast *a, const struct ast *b)
+{
+  if (same_value (a, b))
+    return 1;
+  return (a->type == binary_type && a->op.binary.op == '&'
+	  && !a->boolean_not && b->type == binary_type
+	  && b->op.binary.op == '&' && !b->boolean_not
+	  && same_value (a->ops[0], b->ops[0])
+	  && same_value (a->ops[1], b->ops[1]));
+}
+
+/** 
+ * Test if the value of @c a is never negative, because it is a
+ * constant or is masked by one.
+ * 
+ */
+static int
+non_negative (const struct ast *a)
+{
+  if (a->boolean_not)
+    return 0;
+  if (a->type == integer_type)
+    return a->op.integer.i >= 0;
+  return (a->type == binary_type && a->op.binary.op == '&'
+	  && (non_negative (a->ops[0]) || non_negative (a->ops[1])));
+}
+
+/** 
+ * Test if @c a shifts a value left and @c b shifts the same value
+ * right by the rest of its 64 bits, which together rotate it.  The
+ * value must not be negative, since the right shift would only bring
+ * in zeros like a rotation does if it were logical, and constant
+ * folding treats it as arithmetic.
+ * 
+ */
+static int
+rotation (const struct ast *a, const struct ast *b)
+{
+  if (a->type != binary_type || a->op.binary.op != LS || a->boolean_not
+      || b->type != binary_type || b->op.binary.op != RS || b->boolean_not
+      || !same_masked (a->ops[0], b->ops[0]) || !non_negative (a->ops[0]))
+    return 0;
+  const struct ast *m = a->ops[1], *n = b->ops[1];
+  if (m->type == integer_type && n->type == integer_type)
+    return (!m->boolean_not && !n->boolean_not && m->op.integer.i > 0
+	    && m->op.integer.i < 64 && m->op.integer.i + n->op.integer.i == 64);
+  if (m->type == binary_type && m->op.binary.op == '-' && !m->boolean_not)
+    {
+      const struct ast *t = m;
+      m = n;
+      n = t;
+    }
+  return (n->type == binary_type && n->op.binary.op == '-'
+	  && !n->boolean_not && n->ops[0]->type == integer_type
+	  && !n->ops[0]->boolean_not && n->ops[0]->op.integer.i == 64
+	  && same_value (n->ops[1], m));
+}
+
+/* The vocabulary of simplify.def. */
+#define L (s->ops[0])
+#define R (s->ops[1])
+#define X (s->ops[0])
+#define INT(A) ((A)->type == integer_type && !(A)->boolean_not)
+#define INT_IS(A, V) (INT (A) && (A)->op.integer.i == (V))
+#define PURE(A) (!ast_has_side_effects (A))
+#define SAME(A, B) (same_value ((A), (B)))
+#define CHAIN(A, OP) ((A)->type == binary_type && (A)->op.binary.op == (OP) \
+		      && !(A)->boolean_not && INT ((A)->ops[1]))
+#define OPPOSITE(A) ((A)->type == unary_type				\
+		     && (A)->op.unary.op == s->op.unary.op)
+#define KEEP(N) keep_operand (ss, (N))
+#define CONST(V) fold_to (ss, (V))
+#define NEGATE(N) negate_operand (ss, (N))
+#define COMMUTE commute (ss)
+#define REASSOCIATE reassociate (ss)
+#define SUB_TO_ADD sub_to_add (ss)
+#define KEEP_INNER keep_inner (ss)
+#define C (s->ops[0])
+#define T (s->ops[1])
+#define F (s->ops[2])
+#define COMPARES(A, OP, B, D) compares ((A), (OP), (B), (D))
+#define DECREMENT(A, B) decrement ((A), (B))
+#define NEGATION(A, B) negation ((A), (B))
+#define ROTATION(A, B) rotation ((A), (B))
+#define APPLY(OP, N) apply_unary (ss, (OP), (N))
+#define SELECT(OP) apply_binary (ss, (OP), 1, 2)
+#define ROTATE(OP) apply_binary (ss, (OP), -1, -1)
+#define INVERT invert_ternary (ss)
+
+/** 
+ * Apply the first rule of simplify.def that matches the binary AST
+ * @c s.
+ * 
+ * @return true if a rule was applied, false otherwise.
+ */
+static int
+simplify_binary (struct ast **ss)
+{
+#define s (*ss)
+#define BINARY(OP, CONDITION, ACTION)		\
+  if (s->op.binary.op == (OP) && (CONDITION) && (ACTION))	\
+    return 1;
+#define UNARY(OP, CONDITION, ACTION)
+#define TERNARY(CONDITION, ACTION)
+#include "simplify.def"
+#undef TERNARY
+#undef UNARY
+#undef BINARY
+  return 0;
+#undef s
+}
+
+/** 
+ * Apply the first rule of simplify.def that matches the unary AST @c
+ * s.
+ * 
+ * @return true if a rule was applied, false otherwise.
+ */
+static int
+simplify_unary (struct ast **ss)
+{
+#define s (*ss)
+#define BINARY(OP, CONDITION, ACTION)
+#define UNARY(OP, CONDITION, ACTION)		\
+  if (s->op.unary.op == (OP) && (CONDITION) && (ACTION))	\
+    return 1;
+#define TERNARY(CONDITION, ACTION)
+#include "simplify.def"
+#undef TERNARY
+#undef UNARY
+#undef BINARY
+  return 0;
+#undef s
+}
+
+/** 
+ * Apply the first rule of simplify.def that matches the ternary AST
+ * @c s.
+ * 
+ * @return true if a rule was applied, false otherwise.
+ */
+static int
+simplify_ternary (struct ast **ss)
+{
+#define s (*ss)
+#define BINARY(OP, CONDITION, ACTION)
+#define UNARY(OP, CONDITION, ACTION)
+#define TERNARY(CONDITION, ACTION)		\
+  if ((CONDITION) && (ACTION))			\
+    return 1;
+#include "simplify.def"
+#undef TERNARY
+#undef UNARY
+#undef BINARY
+  return 0;
+#undef s
+}
+
+#undef L
+#undef R
+#undef X
+#undef INT
+#undef INT_IS
+#undef PURE
+#undef SAME
+#undef CHAIN
+#undef OPPOSITE
+#undef KEEP
+#undef CONST
+#undef NEGATE
+#undef COMMUTE
+#undef REASSOCIATE
+#undef SUB_TO_ADD
+#undef KEEP_INNER
+#undef C
+#undef T
+#undef F
+#undef COMPARES
+#undef DECREMENT
+#undef NEGATION
+#undef ROTATION
+#undef APPLY
+#undef SELECT
+#undef ROTATE
+#undef INVERT
+
+/** 
+ * Count the ASTs in @c s.
+ * 
+ */
+static unsigned long
+count_nodes (const struct ast *s)
+{
+  unsigned long n = 0;
+  for (; s != NULL; s = s->next)
+    {
+      int i;
+      n++;
+      for (i = 0; i < s->num_ops; i++)
+	n += count_nodes (s->ops[i]);
+    }
+  return n;
+}
 
 /** 
- * Fold a unary operator on a constant integer into a single integer.
+ * Test if the statement @c s assigns @c x with its lowest set bit
+ * cleared.
  * 
- * @param OP The operator to fold on.
  */
-#define FOLD_INTEGER_UNI(OP) do {		\
-    if (s->ops[0]->type == integer_type)	\
-      {						\
-	long long a = s->ops[0]->op.integer.i;	\
-	AST_FREE (s);				\
-	s = make_integer (OP a);		\
-      }						\
-  } while (0)
+static int
+clears_lowest_bit (const struct ast *s, const struct ast *x)
+{
+  if (s->type != binary_type || s->op.binary.op != '='
+      || !same_value (s->ops[0], x))
+    return 0;
+  const struct ast *v = s->ops[1];
+  if (v->boolean_not)
+    return 0;
+  if (v->type == unary_type)
+    return v->op.unary.op == BLSR && same_value (v->ops[0], x);
+  return (v->type == binary_type && v->op.binary.op == '&'
+	  && ((same_value (v->ops[0], x) && decrement (v->ops[1], x))
+	      || (same_value (v->ops[1], x) && decrement (v->ops[0], x))));
+}
 
 /** 
- * Fold up expressions involving constant integer expressions into a
- * single constant integer.
+ * Get the variable that the statement @c s adds one to.
  * 
- * @param OP The operator to fold on.
+ * @return The variable, or NULL if @c s is something else.
  */
-#define FOLD_INTEGER_BIN(OP) do {		\
-    if (s->ops[0]->type == integer_type &&	\
-	s->ops[1]->type == integer_type)	\
-      {						\
-	long long l = s->ops[0]->op.integer.i;	\
-	long long r = s->ops[1]->op.integer.i;	\
-	long long res = l OP r;			\
-	if (s->boolean_not)			\
-	  res = !res;				\
-	struct ast *t = make_integer (res);	\
-	SWAP_AST (s, t);			\
-	AST_FREE (t);				\
-      }						\
-  } while (0)
+static const struct ast *
+increments (const struct ast *s)
+{
+  if (s->type == unary_type && s->op.unary.op == INC
+      && s->ops[0]->type == variable_type)
+    return s->ops[0];
+  if (s->type == binary_type && s->op.binary.op == '='
+      && s->ops[0]->type == variable_type
+      && s->ops[1]->type == binary_type && s->ops[1]->op.binary.op == '+'
+      && !s->ops[1]->boolean_not && same_value (s->ops[1]->ops[0], s->ops[0])
+      && s->ops[1]->ops[1]->type == integer_type
+      && !s->ops[1]->ops[1]->boolean_not
+      && s->ops[1]->ops[1]->op.integer.i == 1)
+    return s->ops[0];
+  return NULL;
+}
 
 /** 
- * Convience macro for declaring how to fold up each binary operator.
+ * Replace the loop starting with the cond @c s that clears the lowest
+ * set bit of a variable until it is zero, counting the iterations,
+ * with a population count:
+ *
+ *     while (x) { x &= x - 1; c++; }
+ *
+ * becomes
+ *
+ *     c = c + popcount (x);
+ *     x = 0;
+ *
+ * The label at the top of a while loop is only ever branched to by
+ * the test at its bottom.
  * 
- * @param CASE 
- * @param OP 
+ * @return true if the loop was replaced, false otherwise.
  */
-#define FOLD_INT_BIN(CASE, OP)			\
-  case CASE:					\
-  FOLD_INTEGER_BIN (OP);			\
-  break
+static int
+popcount_loop (struct ast **ss)
+{
+#define s (*ss)
+  struct ast *x = s->ops[0], *head = s->next, *a, *b, *back;
+  if (!target_popcnt || x->type != variable_type || !x->boolean_not
+      || head == NULL || head->type != label_type || head->next == NULL)
+    return 0;
+  a = head->next;
+  if (a->type == block_type)
+    {
+      back = a->next;
+      a = a->ops[0];
+      if (a == NULL || a->next == NULL || a->next->next != NULL)
+	return 0;
+      b = a->next;
+    }
+  else
+    {
+      b = a->next;
+      back = b == NULL ? NULL : b->next;
+    }
+  if (back == NULL || back->type != cond_type
+      || STRNEQ (ast_label_name (back), ast_label_name (head))
+      || back->ops[0]->type != variable_type || back->ops[0]->boolean_not
+      || !same_variable (back->ops[0], x))
+    return 0;
+  x = back->ops[0];
+  if (!clears_lowest_bit (a, x))
+    SWAP (a, b);
+  const struct ast *c = increments (b);
+  if (!clears_lowest_bit (a, x) || c == NULL || same_variable (c, x))
+    return 0;
+
+  struct ast *count = make_binary ('+', ast_dup (c),
+				   make_unary (POPCOUNT, ast_dup (x)));
+  count = make_binary ('=', ast_dup (c), count);
+  count->throw_away = 1;
+  struct ast *clear = make_binary ('=', ast_dup (x), make_integer (0));
+  clear->throw_away = 1;
+  struct ast *t = s;
+  s = ast_cat (count, ast_cat (clear, back->next));
+  back->next = NULL;
+  AST_FREE (t);
+  return 1;
+#undef s
+}
 
 /** 
  * Recursive version of the optimizer.
@@ -97,6 +741,7 @@ optimizer_r (struct ast **ss)
     {
       /* Fold up repetitive allocations into one allocation. */
     case alloc_type:
+      optimizer_r (&s->ops[0]);
       if (s->ops[0] != NULL
 	  && s->ops[0]->type == integer_type
 	  && s->next != NULL
@@ -122,7 +767,7 @@ optimizer_r (struct ast **ss)
       if (s->ops[0]->type == integer_type)
 	{
 	  struct ast *t = NULL;
-	  if (!s->ops[0]->op.integer.i)
+	  if (!s->ops[0]->op.integer.i == !s->ops[0]->boolean_not)
 	    {
 	      t = s;
 	      s = s->next;
@@ -135,6 +780,19 @@ optimizer_r (struct ast **ss)
 	      SWAP_AST (t, s);
 	    }
 	  AST_FREE (t);
+	  changes++;
+	}
+      else if (optimize > 0)
+	changes += popcount_loop (ss);
+      break;
+
+      /* Apply a boolean NOT to a constant. */
+    case integer_type:
+      if (optimize > 0 && s->boolean_not)
+	{
+	  s->op.integer.i = !s->op.integer.i;
+	  s->boolean_not = 0;
+	  changes++;
 	}
       break;
 
@@ -144,41 +802,39 @@ optimizer_r (struct ast **ss)
       optimizer_r (&s->ops[1]);
       if (optimize > 0)
 	{
-	  switch (s->op.binary.op)
-	    {
-	      FOLD_INT_BIN ('+', +);
-	      FOLD_INT_BIN ('-', -);
-	      FOLD_INT_BIN ('*', *);
-	      FOLD_INT_BIN ('/', /);
-	      FOLD_INT_BIN ('%', %);
-	      FOLD_INT_BIN ('>', >);
-	      FOLD_INT_BIN ('<', <);
-	      FOLD_INT_BIN (GE, >=);
-	      FOLD_INT_BIN (LE, <=);
-	      FOLD_INT_BIN (EQ, ==);
-	      FOLD_INT_BIN (NE, !=);
-	      FOLD_INT_BIN (RS, >>);
-	      FOLD_INT_BIN (LS, <<);
-	    default:
-	      break;
-	    }
+	  long long v;
+	  if (s->ops[0]->type == integer_type && !s->ops[0]->boolean_not
+	      && s->ops[1]->type == integer_type && !s->ops[1]->boolean_not
+	      && fold_constant_binary (s->op.binary.op,
+				       s->ops[0]->op.integer.i,
+				       s->ops[1]->op.integer.i, &v))
+	    changes += fold_to (ss, v);
+	  else
+	    changes += simplify_binary (ss);
 	}
       break;
 
+      /* Recognize the idioms that are made out of ternaries. */
+    case ternary_type:
+      optimizer_r (&s->ops[0]);
+      optimizer_r (&s->ops[1]);
+      optimizer_r (&s->ops[2]);
+      if (optimize > 0)
+	changes += simplify_ternary (ss);
+      break;
+
       /* Fold up constant expressions. */
     case unary_type:
       optimizer_r (&s->ops[0]);
       if (optimize > 0)
 	{
-	  switch (s->op.unary.op)
-	    {
-	    case '-':
-	      FOLD_INTEGER_UNI (-);
-	      break;
-
-	    default:
-	      break;
-	    }
+	  struct ast *a = s->ops[0];
+	  long long v;
+	  if (a->type == integer_type && !a->boolean_not
+	      && fold_constant_unary (s->op.unary.op, a->op.integer.i, &v))
+	    changes += fold_to (ss, v);
+	  else
+	    changes += simplify_unary (ss);
 	}
       break;
 
@@ -191,9 +847,31 @@ optimizer_r (struct ast **ss)
 #undef s
 }
 
+int
+simplify_expression (struct ast **ss)
+{
+  do
+    {
+      changes = 0;
+      optimizer_r (ss);
+    }
+  while (changes > 0);
+  return 0;
+}
+
 int
 optimizer (struct ast **ss)
 {
-  optimizer_r (ss);
+  unsigned long before = count_nodes (*ss), passes = 0;
+  do
+    {
+      changes = 0;
+      optimizer_r (ss);
+      passes++;
+    }
+  while (changes > 0);
+  if (optimizer_stats)
+    fprintf (stderr, _("optimizer: removed %lu of %lu nodes in %lu passes\n"),
+	     before - count_nodes (*ss), before, passes);
   return 0;
 }
@@ -53,6 +53,7 @@ struct ast *make_whileloop (struct ast *, struct ast *);
 struct ast *make_array (char *, char *, struct ast *);
 struct ast *make_forloop (struct ast *, struct ast *, struct ast *, struct ast *);
 struct ast *make_ifelse (struct ast *, struct ast *, struct ast *);
+struct ast *make_switch (struct ast *, struct ast *);
 
 #ifndef YYDEBUG
 #define YYDEBUG 1
@@ -103,6 +104,21 @@ struct ast *make_ifelse (struct ast *, struct ast *, struct ast *);
 %token MUT_OR "|="
 %token MUT_XOR "^="
 
+/* Operators that the optimizer makes out of idioms and builtins,
+   which have no syntax of their own. */
+%token MIN "minimum"
+%token MAX "maximum"
+%token ABS "absolute value"
+%token ROL "rotate left"
+%token ROR "rotate right"
+%token BLSR "lowest set bit reset"
+%token BLSI "lowest set bit isolated"
+%token POPCOUNT "population count"
+%token CTZ "trailing zero count"
+%token CLZ "leading zero count"
+%token BSWAP "byte swap"
+%token PREFETCH "prefetch"
+
 %union { long long i; }
 %token <i> INT
 
@@ -146,6 +162,7 @@ file:		/* empty */   { $$ = NULL; }
 /* Function definitions. */
 def:		STR STR '(' defargs ')' scoped_body { $$ = make_function ($1, $2, $4, $6); }
 	|	STR STR '('         ')' scoped_body { $$ = make_function ($1, $2, NULL, $5); }
+	|	INLINE def { $$ = $2; $$->op.function.declared_inline = 1; }
 	;
 
 defargs:	STR STR             { $$ = make_variable ($1, $2); }
@@ -177,6 +194,11 @@ statement:	';'                             { $$ = NULL; }
 	|	IF '(' expr ')' sub_body ELSE sub_body { $$ = make_ifelse ($3, $5, $7); }
 	|	STR ':' statement               { $$ = ast_cat (make_label ($1), $3); }
 	|	GOTO STR ';'                    { $$ = make_jump ($2); }
+	|	SWITCH '(' expr ')' scoped_body { $$ = make_switch ($3, $5); }
+	|	CASE INT ':' statement          { $$ = ast_cat (make_label (my_printf ("case$%lld", $2)), $4); }
+	|	CASE '-' INT ':' statement      { $$ = ast_cat (make_label (my_printf ("case$%lld", -$3)), $5); }
+	|	DEFAULT ':' statement           { $$ = ast_cat (make_label (xstrdup ("default$")), $3); }
+	|	BREAK ';'                       { $$ = make_jump (xstrdup ("break$")); }
 	|	WHILE '(' expr ')' sub_body     { $$ = make_whileloop ($3, $5); }
 	|	DO sub_body WHILE '(' expr ')' ';' { $$ = make_dowhileloop ($5, $2); }
 	|	FOR '(' maybe_expr ';' expr ';' maybe_expr ')' sub_body { $$ = make_forloop ($3, $5, $7, $9); }
@@ -212,6 +234,8 @@ expr:		STR                   { $$ = make_variable (NULL, $1); }
 	|	expr MUT_XOR expr     { $$ = make_binary ('=', $1, make_binary ('^', ast_dup ($1), $3)); }
 	|	expr '<' expr         { $$ = make_binary ('<', $1, $3); }
 	|	expr '>' expr         { $$ = make_binary ('>', $1, $3); }
+	|	expr AND expr         { $$ = make_binary (AND, $1, $3); }
+	|	expr OR expr          { $$ = make_binary (OR, $1, $3); }
 	|	expr '&' expr         { $$ = make_binary ('&', $1, $3); }
 	|	expr '|' expr         { $$ = make_binary ('|', $1, $3); }
 	|	expr '^' expr         { $$ = make_binary ('^', $1, $3); }
@@ -273,18 +297,57 @@ make_ifstatement (struct ast *cond, struct ast *body)
   return ast_cat (make_cond (t, cond) , ast_cat (body, make_label (tt)));
 }
 
+/** 
+ * Send the breaks in @c s that aren't inside of a loop or a switch of
+ * their own to the label @c end.  The ones in nested loops and
+ * switches were already renamed when those were made.
+ * 
+ * @return The number of breaks that were renamed.
+ */
+static int
+bind_breaks (struct ast *s, const char *end)
+{
+  int n = 0;
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == jump_type && STREQ (s->op.jump.name, "break$"))
+	{
+	  FREE (s->op.jump.name);
+	  s->op.jump.name = xstrdup (end);
+	  n++;
+	}
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	n += bind_breaks (s->ops[i], end);
+    }
+  return n;
+}
+
 struct ast *
 make_dowhileloop (struct ast *cond, struct ast *body)
 {
-  char *t = place_holder (), *tt = xstrdup (t);
-  return ast_cat (make_label (t), ast_cat (body, make_cond (tt, cond)));
+  /* The while and for loops are made out of this one, so this is
+     where the breaks of all of them find the end of their loop. */
+  char *t = place_holder (), *tt = xstrdup (t), *end = place_holder ();
+  int breaks = bind_breaks (body, end);
+  struct ast *out = ast_cat (make_label (t),
+			     ast_cat (body, make_cond (tt, cond)));
+  if (breaks == 0)
+    {
+      FREE (end);
+      return out;
+    }
+  return ast_cat (out, make_label (end));
 }
 
 struct ast *
 make_whileloop (struct ast *cond, struct ast *body)
 {
-  char *t = place_holder (), *tt = xstrdup (t);
-  return ast_cat (make_label (t), make_ifstatement (cond, ast_cat (body, make_jump (tt))));
+  /* Rotate the loop so that the condition is tested once on entry and
+     then at the bottom, where it costs only one branch per
+     iteration. */
+  struct ast *again = ast_dup (cond);
+  return make_ifstatement (cond, make_dowhileloop (again, body));
 }
 
 struct ast *
@@ -292,7 +355,10 @@ make_array (char *type, char *name, struct ast *size)
 {
   char *newtype = my_printf ("%s * const", type);
   FREE (type);
-  size = make_binary ('*', size, make_integer (8));
+  if (size->type == integer_type)
+    size->op.integer.i *= 8;
+  else
+    size = make_binary ('*', size, make_integer (8));
   return make_binary ('=', make_variable (newtype, name), make_alloc (size));
 }
 
@@ -316,3 +382,79 @@ make_ifelse (struct ast *cond, struct ast *body, struct ast *elsebody)
   out = ast_cat (make_ifstatement (cond, body), out);
   return out;
 }
+
+/** 
+ * Give the case labels and the default label in @c s that belong to
+ * the switch on @c var their real names.  The ones in nested switches
+ * were already renamed when those were made.
+ * 
+ * @param s The body of the switch.
+ * @param var The variable holding the value switched on.
+ * @param conds Where to add the branch to each case.
+ * @param deflt Where to store the jump to the default label.
+ */
+static void
+bind_cases (struct ast *s, const char *var, struct ast **conds,
+	    struct ast **deflt)
+{
+  for (; s != NULL; s = s->next)
+    {
+      char **name = NULL;
+      if (s->type == label_type)
+	name = &s->op.label.name;
+
+      if (name != NULL && strncmp (*name, "case$", 5) == 0)
+	{
+	  long long v = strtoll (*name + 5, NULL, 10);
+	  struct ast *c;
+	  for (c = *conds; c != NULL; c = c->next)
+	    if (c->ops[0]->ops[1]->op.integer.i == v)
+	      yyerror ("duplicate case value");
+	  FREE (*name);
+	  *name = place_holder ();
+	  struct ast *test = make_binary (EQ, make_variable (NULL, xstrdup (var)),
+					  make_integer (v));
+	  *conds = ast_cat (*conds, make_cond (xstrdup (*name), test));
+	}
+      else if (name != NULL && STREQ (*name, "default$"))
+	{
+	  if (*deflt != NULL)
+	    yyerror ("multiple default labels in one switch");
+	  FREE (*name);
+	  *name = place_holder ();
+	  *deflt = make_jump (xstrdup (*name));
+	}
+
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	bind_cases (s->ops[i], var, conds, deflt);
+    }
+}
+
+/** 
+ * Make a switch statement.  The value is stored in a variable and
+ * compared against each case in turn; the code generator recognizes
+ * the run of branches and picks a better way to dispatch on it.
+ * 
+ * @param value The value switched on.
+ * @param body The body of the switch.
+ * 
+ * @return The statements that the switch is made of.
+ */
+struct ast *
+make_switch (struct ast *value, struct ast *body)
+{
+  static int switchno = 0;
+  char *var = my_printf ("switch$%d", switchno++), *end = place_holder ();
+  struct ast *conds = NULL, *deflt = NULL;
+  bind_cases (body, var, &conds, &deflt);
+  bind_breaks (body, end);
+  if (deflt == NULL)
+    deflt = make_jump (xstrdup (end));
+
+  struct ast *out = make_binary ('=', make_variable (xstrdup ("int"), var),
+				 value);
+  out->throw_away = 1;
+  out = ast_cat (out, ast_cat (conds, deflt));
+  return ast_cat (out, ast_cat (body, make_label (end)));
+}
@@ -0,0 +1,849 @@
+/**
+ * @file   peephole.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief  The buffered instruction list and its peephole optimizer.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Every rule in @c rules looks at the instruction it is given and the
+ * ones that follow it and rewrites them in place if it matches.  The
+ * rules are applied over the whole list until none of them match.
+ * The rules only ever look within a basic block, and they assume that
+ * nothing is live across a label or a jump, so they are conservative
+ * there.
+ *
+ */
+
+#include "config.h"
+
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "my_printf.h"
+#include "peephole.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct asm_insn *insns = NULL; /**< The instruction list. */
+static size_t ninsns = 0;	/**< Number of instructions. */
+static size_t ainsns = 0;	/**< Allocated instructions. */
+
+/**
+ * The names of each 64-bit register and its 32, 16 and 8-bit parts.
+ *
+ */
+static const char *const reg_names[][4] = {
+  { "rax", "eax", "ax", "al" },
+  { "rbx", "ebx", "bx", "bl" },
+  { "rcx", "ecx", "cx", "cl" },
+  { "rdx", "edx", "dx", "dl" },
+  { "rsi", "esi", "si", "sil" },
+  { "rdi", "edi", "di", "dil" },
+  { "rbp", "ebp", "bp", "bpl" },
+  { "rsp", "esp", "sp", "spl" },
+  { "r8", "r8d", "r8w", "r8b" },
+  { "r9", "r9d", "r9w", "r9b" },
+  { "r10", "r10d", "r10w", "r10b" },
+  { "r11", "r11d", "r11w", "r11b" },
+  { "r12", "r12d", "r12w", "r12b" },
+  { "r13", "r13d", "r13w", "r13b" },
+  { "r14", "r14d", "r14w", "r14b" },
+  { "r15", "r15d", "r15w", "r15b" }
+};
+
+/**
+ * Get the bit that represents register number @c N.
+ *
+ */
+#define REG_BIT(N) (1u << (N))
+
+/** The registers that are preserved across a call. */
+#define CALLEE_SAVED (REG_BIT (1) | REG_BIT (6) | REG_BIT (7) | REG_BIT (12) \
+		      | REG_BIT (13) | REG_BIT (14) | REG_BIT (15))
+/** The registers that a call may read. */
+#define CALL_USES (REG_BIT (0) | REG_BIT (2) | REG_BIT (3) | REG_BIT (4) \
+		   | REG_BIT (5) | REG_BIT (7) | REG_BIT (8) | REG_BIT (9))
+/** The registers that a call may clobber. */
+#define CALL_CLOBBERS (0xffffu & ~CALLEE_SAVED)
+
+/**
+ * Find the register that is named at the start of @c s, which must
+ * point just after the '%'.
+ *
+ * @param s The name of the register.
+ * @param len Where to store the length of the name.
+ *
+ * @return The number of the register, or -1.
+ */
+static int
+reg_number (const char *s, size_t *len)
+{
+  size_t n = 0, r;
+  int k;
+  while ((s[n] >= 'a' && s[n] <= 'z') || (s[n] >= '0' && s[n] <= '9'))
+    n++;
+  *len = n;
+  for (r = 0; r < sizeof reg_names / sizeof *reg_names; r++)
+    for (k = 0; k < 4; k++)
+      if (strlen (reg_names[r][k]) == n
+	  && strncmp (reg_names[r][k], s, n) == 0)
+	return r;
+  return -1;
+}
+
+/**
+ * Get the set of registers that the operand @c o mentions.
+ *
+ */
+static unsigned
+regs_of (const char *o)
+{
+  unsigned out = 0;
+  if (o == NULL)
+    return 0;
+  while ((o = strchr (o, '%')) != NULL)
+    {
+      size_t len;
+      int r = reg_number (++o, &len);
+      if (r >= 0)
+	out |= REG_BIT (r);
+      o += len;
+    }
+  return out;
+}
+
+/**
+ * Test if the operand @c o is a register.
+ *
+ */
+static int
+is_reg (const char *o)
+{
+  size_t len;
+  return o != NULL && o[0] == '%' && reg_number (o + 1, &len) >= 0
+    && o[len + 1] == '\0';
+}
+
+/**
+ * Test if the operand @c o is in memory.
+ *
+ */
+static int
+is_mem (const char *o)
+{
+  return o != NULL && o[0] != '%' && o[0] != '$';
+}
+
+/**
+ * Test if the opcode @c op is @c base, with or without a size suffix.
+ *
+ */
+static int
+op_is (const char *op, const char *base)
+{
+  size_t n = strlen (base);
+  return (op != NULL && strncmp (op, base, n) == 0
+	  && (op[n] == '\0' || (strchr ("bwlq", op[n]) && op[n + 1] == '\0')));
+}
+
+/**
+ * Test if @c op starts with @c prefix.
+ *
+ */
+static int
+starts_with (const char *op, const char *prefix)
+{
+  return op != NULL && strncmp (op, prefix, strlen (prefix)) == 0;
+}
+
+/**
+ * Test if the operand @c o is a register that isn't tracked, like
+ * one of the vector registers.
+ *
+ */
+static int
+is_other_reg (const char *o)
+{
+  return o != NULL && o[0] == '%' && !is_reg (o);
+}
+
+/**
+ * Test if @c i is a plain move.
+ *
+ */
+static int
+is_move (const struct asm_insn *i)
+{
+  return i->label == NULL && op_is (i->op, "mov") && i->nargs == 2
+    && !is_other_reg (i->args[0]) && !is_other_reg (i->args[1]);
+}
+
+/**
+ * Replace operand @c n of @c i with @c s.
+ *
+ */
+static void
+set_arg (struct asm_insn *i, int n, const char *s)
+{
+  char *t = xstrdup (s);
+  FREE (i->args[n]);
+  i->args[n] = t;
+}
+
+/**
+ * Replace the opcode of @c i with @c op.
+ *
+ */
+static void
+set_op (struct asm_insn *i, const char *op)
+{
+  FREE (i->op);
+  i->op = xstrdup (op);
+}
+
+/**
+ * How an instruction affects the flow of control.
+ *
+ */
+enum flow
+{
+  flow_next,			/**< Goes on to the next instruction. */
+  flow_stop,			/**< A label, branch or something
+				   unknown. */
+  flow_ret			/**< Leaves the function. */
+};
+
+/**
+ * Find the registers that @c i reads and writes.
+ *
+ * @return How @c i affects the flow of control.
+ */
+static enum flow
+analyze (const struct asm_insn *i, unsigned *use, unsigned *def)
+{
+  const char *op = i->op;
+  const char *a = i->args[0], *b = i->args[1];
+  *use = *def = 0;
+  if (i->label != NULL || op[0] == '.')
+    return flow_stop;
+  if (op_is (op, "ret"))
+    {
+      *use = REG_BIT (0) | CALLEE_SAVED;
+      return flow_ret;
+    }
+  if (op_is (op, "call"))
+    {
+      *use = CALL_USES | regs_of (a);
+      *def = CALL_CLOBBERS;
+      return flow_next;
+    }
+  if (op[0] == 'j')
+    return flow_stop;
+  if (op_is (op, "push"))
+    {
+      *use = regs_of (a) | REG_BIT (7);
+      *def = REG_BIT (7);
+      return flow_next;
+    }
+  if (op_is (op, "pop"))
+    {
+      *use = REG_BIT (7) | (is_reg (a) ? 0 : regs_of (a));
+      *def = REG_BIT (7) | (is_reg (a) ? regs_of (a) : 0);
+      return flow_next;
+    }
+  if (op_is (op, "cqto") || op_is (op, "cqo"))
+    {
+      *use = REG_BIT (0);
+      *def = REG_BIT (3);
+      return flow_next;
+    }
+  if (i->nargs == 1 && (op_is (op, "imul") || op_is (op, "mul")
+			|| op_is (op, "idiv") || op_is (op, "div")))
+    {
+      *use = regs_of (a) | REG_BIT (0) | REG_BIT (3);
+      *def = REG_BIT (0) | REG_BIT (3);
+      return flow_next;
+    }
+  if (i->nargs == 1)
+    {
+      /* Read-modify-write operations, like incq and negq. */
+      *use = regs_of (a);
+      *def = is_reg (a) ? regs_of (a) : 0;
+      return flow_next;
+    }
+  if (i->nargs == 3)
+    {
+      *use = regs_of (a) | regs_of (b)
+	| (is_reg (i->args[2]) ? 0 : regs_of (i->args[2]));
+      *def = is_reg (i->args[2]) ? regs_of (i->args[2]) : 0;
+      return flow_next;
+    }
+  if (i->nargs != 2)
+    return flow_stop;
+  if (op_is (op, "mov") || op_is (op, "lea") || starts_with (op, "movs")
+      || starts_with (op, "movz")
+      || (op_is (op, "xor") && STREQ (a, b)))
+    {
+      *use = (op_is (op, "xor") ? 0 : regs_of (a))
+	| (is_reg (b) ? 0 : regs_of (b));
+      *def = is_reg (b) ? regs_of (b) : 0;
+      return flow_next;
+    }
+  /* Everything else reads both of its operands and writes the
+     second. */
+  *use = regs_of (a) | regs_of (b);
+  *def = is_reg (b) && !op_is (op, "cmp") && !op_is (op, "test")
+    ? regs_of (b) : 0;
+  return flow_next;
+}
+
+/**
+ * Get the next instruction after @c i that hasn't been deleted.
+ *
+ */
+static size_t
+next_live (size_t i)
+{
+  for (i++; i < ninsns && insns[i].deleted; i++)
+    ;
+  return i;
+}
+
+/**
+ * Test if none of the registers in @c regs are read after instruction
+ * @c i before they are written again.
+ *
+ */
+static int
+regs_dead_after (size_t i, unsigned regs)
+{
+  for (i = next_live (i); i < ninsns; i = next_live (i))
+    {
+      unsigned use, def;
+      enum flow f = analyze (&insns[i], &use, &def);
+      if (use & regs)
+	return 0;
+      if (f == flow_ret)
+	return 1;
+      if (f == flow_stop)
+	return 0;
+      regs &= ~def;
+      if (regs == 0)
+	return 1;
+    }
+  return 0;
+}
+
+/**
+ * Test if the condition flags are not read after instruction @c i.
+ *
+ */
+static int
+flags_dead_after (size_t i)
+{
+  for (i = next_live (i); i < ninsns; i = next_live (i))
+    {
+      const struct asm_insn *in = &insns[i];
+      const char *op = in->op;
+      if (in->label != NULL || op[0] == '.'
+	  || (op[0] == 'j' && !op_is (op, "jmp"))
+	  || starts_with (op, "cmov") || starts_with (op, "set")
+	  || op_is (op, "adc") || op_is (op, "sbb"))
+	return 0;
+      if (op_is (op, "ret") || op_is (op, "call") || op_is (op, "jmp"))
+	return 1;
+      if (op_is (op, "cmp") || op_is (op, "test") || op_is (op, "add")
+	  || op_is (op, "sub") || op_is (op, "and") || op_is (op, "or")
+	  || op_is (op, "xor") || op_is (op, "neg") || op_is (op, "imul")
+	  || op_is (op, "idiv"))
+	return 1;
+    }
+  return 0;
+}
+
+/**
+ * Test if the immediate operand @c o can be stored straight into
+ * memory, which only allows a sign extended 32-bit immediate.
+ *
+ */
+static int
+imm_fits_store (const char *o)
+{
+  if (o[0] != '$')
+    return 1;
+  if (!((o[1] >= '0' && o[1] <= '9') || o[1] == '-'))
+    return 1;
+  long long v = strtoll (o + 1, NULL, 0);
+  return v >= INT_MIN && v <= INT_MAX;
+}
+
+/**
+ * Delete instruction @c i.
+ *
+ */
+static void
+delete_insn (size_t i)
+{
+  insns[i].deleted = 1;
+}
+
+/**
+ * Remove a move of a register to itself.
+ *
+ */
+static int
+rule_self_move (size_t i)
+{
+  if (!is_move (&insns[i]) || !STREQ (insns[i].args[0], insns[i].args[1]))
+    return 0;
+  delete_insn (i);
+  return 1;
+}
+
+/**
+ * Reuse the register that was just stored to memory instead of
+ * loading it back.
+ *
+ */
+static int
+rule_store_load (size_t i)
+{
+  size_t j = next_live (i);
+  if (j >= ninsns || !is_move (&insns[i]) || !is_move (&insns[j])
+      || !is_reg (insns[i].args[0]) || !is_mem (insns[i].args[1])
+      || !STREQ (insns[i].args[1], insns[j].args[0])
+      || !is_reg (insns[j].args[1]))
+    return 0;
+  set_arg (&insns[j], 0, insns[i].args[0]);
+  set_op (&insns[j], "mov");
+  return 1;
+}
+
+/**
+ * Move straight to the destination instead of through a register
+ * that is never read again.
+ *
+ */
+static int
+rule_forward_move (size_t i)
+{
+  size_t j = next_live (i);
+  struct asm_insn *a = &insns[i], *b;
+  if (j >= ninsns)
+    return 0;
+  b = &insns[j];
+  if (!(is_move (a) || (a->label == NULL && op_is (a->op, "lea")
+			&& a->nargs == 2 && is_reg (b->args[1])))
+      || !is_move (b) || !is_reg (a->args[1])
+      || !STREQ (a->args[1], b->args[0])
+      || (regs_of (b->args[1]) & regs_of (a->args[1]))
+      || (regs_of (a->args[1]) & (REG_BIT (6) | REG_BIT (7)))
+      || (is_mem (a->args[0]) && is_mem (b->args[1]))
+      || (is_mem (b->args[1]) && !imm_fits_store (a->args[0]))
+      || !regs_dead_after (j, regs_of (a->args[1])))
+    return 0;
+  set_arg (b, 0, a->args[0]);
+  set_op (b, op_is (a->op, "lea") ? "lea"
+	  : is_mem (b->args[1]) ? "movq" : "mov");
+  delete_insn (i);
+  return 1;
+}
+
+/**
+ * Remove a move to a register that is never read.
+ *
+ */
+static int
+rule_dead_move (size_t i)
+{
+  struct asm_insn *a = &insns[i];
+  if (!(is_move (a) || (a->label == NULL && op_is (a->op, "lea")))
+      || !is_reg (a->args[1])
+      || (regs_of (a->args[1]) & (REG_BIT (6) | REG_BIT (7)))
+      || !regs_dead_after (i, regs_of (a->args[1])))
+    return 0;
+  delete_insn (i);
+  return 1;
+}
+
+/**
+ * Zero a register with the shorter xor when the flags are dead.
+ *
+ */
+static int
+rule_xor_zero (size_t i)
+{
+  struct asm_insn *a = &insns[i];
+  size_t len;
+  if (!is_move (a) || !STREQ (a->args[0], "$0") || !is_reg (a->args[1])
+      || !flags_dead_after (i))
+    return 0;
+  char *r = my_printf ("%%%s", reg_names[reg_number (a->args[1] + 1,
+						     &len)][1]);
+  set_op (a, "xorl");
+  set_arg (a, 0, r);
+  set_arg (a, 1, r);
+  FREE (r);
+  return 1;
+}
+
+/**
+ * Compare a register against zero with the shorter test.
+ *
+ */
+static int
+rule_test_zero (size_t i)
+{
+  struct asm_insn *a = &insns[i];
+  if (a->label != NULL || !op_is (a->op, "cmp") || a->nargs != 2
+      || !STREQ (a->args[0], "$0") || !is_reg (a->args[1]))
+    return 0;
+  set_op (a, "test");
+  set_arg (a, 0, a->args[1]);
+  return 1;
+}
+
+/**
+ * Test if @c i sets the zero and sign flags from its result, the same
+ * way comparing the result with zero would.
+ *
+ */
+static int
+sets_result_flags (const struct asm_insn *i)
+{
+  const char *op = i->op;
+  if (i->label != NULL)
+    return 0;
+  if (i->nargs == 1)
+    return op_is (op, "inc") || op_is (op, "dec") || op_is (op, "neg");
+  return i->nargs == 2 && (op_is (op, "add") || op_is (op, "sub")
+			   || op_is (op, "and") || op_is (op, "or")
+			   || op_is (op, "xor"));
+}
+
+/**
+ * Test if @c i is a conditional jump that only looks at the zero,
+ * sign and overflow flags.
+ *
+ */
+static int
+is_signed_jump (const struct asm_insn *i)
+{
+  const char *c = i->op + 1;
+  if (i->label != NULL || i->op[0] != 'j' || op_is (i->op, "jmp"))
+    return 0;
+  if (*c == 'n')
+    c++;
+  return (STREQ (c, "e") || STREQ (c, "z") || STREQ (c, "s")
+	  || STREQ (c, "l") || STREQ (c, "le") || STREQ (c, "g")
+	  || STREQ (c, "ge"));
+}
+
+/**
+ * Remove a comparison with zero of a value that was just computed,
+ * since computing it already set the flags.  Arithmetic sets the
+ * overflow flag where the comparison clears it, but that only changes
+ * the signed conditions when the arithmetic overflowed.
+ *
+ */
+static int
+rule_flags_reuse (size_t i)
+{
+  struct asm_insn *a = &insns[i];
+  const char *same[4];
+  int nsame = 1, moves = 0, k;
+  size_t j;
+  if (!sets_result_flags (a))
+    return 0;
+  same[0] = a->args[a->nargs - 1];
+
+  /* Follow the copies of the result through the moves in between,
+     which leave the flags alone. */
+  for (j = next_live (i); j < ninsns && is_move (&insns[j]) && moves < 3;
+       j = next_live (j), moves++)
+    {
+      const char *from = insns[j].args[0], *to = insns[j].args[1];
+      int copied = 0;
+      for (k = 0; k < nsame; k++)
+	if (STREQ (same[k], from))
+	  copied = 1;
+      for (k = 0; k < nsame; k++)
+	if (STREQ (same[k], to)
+	    || (is_mem (same[k]) && (is_mem (to)
+				     || (regs_of (same[k]) & regs_of (to)))))
+	  same[k--] = same[--nsame];
+      if (copied && nsame < 4)
+	same[nsame++] = to;
+    }
+
+  if (j >= ninsns || insns[j].label != NULL || insns[j].nargs != 2
+      || !((op_is (insns[j].op, "cmp") && STREQ (insns[j].args[0], "$0"))
+	   || (op_is (insns[j].op, "test")
+	       && STREQ (insns[j].args[0], insns[j].args[1]))))
+    return 0;
+  for (k = 0; k < nsame; k++)
+    if (STREQ (same[k], insns[j].args[1]))
+      break;
+  size_t use = next_live (j), after;
+  if (k == nsame || use >= ninsns || !is_signed_jump (&insns[use]))
+    return 0;
+  /* Nothing reads the flags across a label. */
+  after = next_live (use);
+  if (after < ninsns && insns[after].label == NULL
+      && !flags_dead_after (use))
+    return 0;
+  delete_insn (j);
+  return 1;
+}
+
+/**
+ * Remove the instructions that follow an unconditional jump or a
+ * return up to the next label.
+ *
+ */
+static int
+rule_unreachable (size_t i)
+{
+  struct asm_insn *a = &insns[i];
+  int changed = 0;
+  if (a->label != NULL || !(op_is (a->op, "jmp") || op_is (a->op, "ret")))
+    return 0;
+  for (i = next_live (i); i < ninsns; i = next_live (i))
+    {
+      if (insns[i].label != NULL || insns[i].op[0] == '.')
+	break;
+      delete_insn (i);
+      changed = 1;
+    }
+  return changed;
+}
+
+/**
+ * Remove a jump to the label that follows it.
+ *
+ */
+static int
+rule_jump_next (size_t i)
+{
+  struct asm_insn *a = &insns[i];
+  size_t j;
+  if (a->label != NULL || !op_is (a->op, "jmp"))
+    return 0;
+  for (j = next_live (i); j < ninsns && insns[j].label != NULL;
+       j = next_live (j))
+    if (STREQ (insns[j].label, a->args[0]))
+      {
+	delete_insn (i);
+	return 1;
+      }
+  return 0;
+}
+
+/**
+ * A peephole rule.
+ *
+ */
+struct peephole_rule
+{
+  const char *name;		/**< The name printed in the
+				   statistics. */
+  int (*apply) (size_t);	/**< Try to apply the rule at an
+				   instruction, returning true if it
+				   changed anything. */
+  unsigned long hits;		/**< How often the rule applied. */
+};
+
+/**
+ * Every peephole rule, in the order they are tried.
+ *
+ */
+static struct peephole_rule rules[] = {
+  { "unreachable", rule_unreachable, 0 },
+  { "jump-next", rule_jump_next, 0 },
+  { "self-move", rule_self_move, 0 },
+  { "store-load", rule_store_load, 0 },
+  { "forward-move", rule_forward_move, 0 },
+  { "dead-move", rule_dead_move, 0 },
+  { "xor-zero", rule_xor_zero, 0 },
+  { "test-zero", rule_test_zero, 0 },
+  { "flags-reuse", rule_flags_reuse, 0 }
+};
+
+/**
+ * Apply the rules until none of them match.
+ *
+ */
+static void
+peephole (void)
+{
+  int changed;
+  do
+    {
+      size_t i, r;
+      changed = 0;
+      for (i = 0; i < ninsns; i = next_live (i))
+	{
+	  if (insns[i].deleted)
+	    continue;
+	  for (r = 0; r < sizeof rules / sizeof *rules; r++)
+	    if (rules[r].apply (i))
+	      {
+		rules[r].hits++;
+		changed = 1;
+		if (insns[i].deleted)
+		  break;
+	      }
+	}
+    }
+  while (changed);
+}
+
+/**
+ * Get a new entry at the end of the list.
+ *
+ */
+static struct asm_insn *
+new_insn (void)
+{
+  if (ninsns == ainsns)
+    insns = x2nrealloc (insns, &ainsns, sizeof *insns);
+  struct asm_insn *i = &insns[ninsns++];
+  memset (i, 0, sizeof *i);
+  return i;
+}
+
+void
+asm_emit (const char *op, int nargs, ...)
+{
+  struct asm_insn *i = new_insn ();
+  va_list ap;
+  int n;
+  assert (nargs >= 0 && nargs <= 3);
+  i->op = xstrdup (op);
+  i->nargs = nargs;
+  va_start (ap, nargs);
+  for (n = 0; n < nargs; n++)
+    i->args[n] = xstrdup (va_arg (ap, const char *));
+  va_end (ap);
+}
+
+void
+asm_label (const char *label)
+{
+  new_insn ()->label = xstrdup (label);
+}
+
+size_t
+asm_mark (void)
+{
+  return ninsns;
+}
+
+/**
+ * Rewrite the operand @c o from an offset off of %rbp to one off of
+ * %rsp, moving it by @c delta bytes.
+ *
+ * @return The new operand, or NULL if @c o doesn't address the frame.
+ */
+static char *
+rebase_operand (const char *o, long long delta)
+{
+  const char *p = o == NULL ? NULL : strstr (o, "(%rbp");
+  if (p == NULL)
+    return NULL;
+  long long disp = p == o ? 0 : strtoll (o, NULL, 10);
+  const char *rest = p + strlen ("(%rbp");
+  if (disp + delta == 0)
+    return my_printf ("(%%rsp%s", rest);
+  return my_printf ("%lld(%%rsp%s", disp + delta, rest);
+}
+
+void
+asm_rebase_frame (size_t from, long long delta)
+{
+  size_t i;
+  int n;
+  for (i = from; i < ninsns; i++)
+    for (n = 0; n < insns[i].nargs; n++)
+      {
+	char *t = rebase_operand (insns[i].args[n], delta);
+	if (t != NULL)
+	  {
+	    FREE (insns[i].args[n]);
+	    insns[i].args[n] = t;
+	  }
+      }
+}
+
+/**
+ * Print the instruction @c i on @c out.
+ *
+ */
+static void
+print_insn (FILE *out, const struct asm_insn *i)
+{
+  int n;
+  if (i->label != NULL)
+    {
+      fprintf (out, "%s:\n", i->label);
+      return;
+    }
+  fprintf (out, "\t%s", i->op);
+  for (n = 0; n < i->nargs; n++)
+    fprintf (out, "%s%s", n == 0 ? "\t" : ", ", i->args[n]);
+  fputc ('\n', out);
+}
+
+void
+asm_flush (FILE *out)
+{
+  size_t i;
+  int n;
+  if (optimize > 0)
+    peephole ();
+  for (i = 0; i < ninsns; i++)
+    {
+      if (!insns[i].deleted)
+	{
+	  print_insn (out, &insns[i]);
+	  if (debug)
+	    print_insn (stderr, &insns[i]);
+	}
+      FREE (insns[i].label);
+      FREE (insns[i].op);
+      for (n = 0; n < insns[i].nargs; n++)
+	FREE (insns[i].args[n]);
+    }
+  FREE (insns);
+  ninsns = ainsns = 0;
+}
+
+void
+peephole_print_stats (FILE *out)
+{
+  size_t r;
+  for (r = 0; r < sizeof rules / sizeof *rules; r++)
+    fprintf (out, "%-16s %lu\n", rules[r].name, rules[r].hits);
+}
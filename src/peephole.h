@@ -0,0 +1,96 @@
+/**
+ * @file   peephole.h
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief  The buffered instruction list and its peephole optimizer.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The code generator doesn't print its instructions directly, it
+ * appends them to a list that is rewritten by a set of peephole rules
+ * before being printed.
+ *
+ */
+
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <stdio.h>
+
+/**
+ * A single instruction, directive or label in the list.
+ *
+ */
+struct asm_insn
+{
+  char *label;			/**< The label, or NULL if this is an
+				   instruction. */
+  char *op;			/**< The opcode or directive. */
+  char *args[3];		/**< The operands in AT&T order. */
+  int nargs;			/**< Number of operands. */
+  int deleted;			/**< Whether a rule removed this. */
+};
+
+/**
+ * Append an instruction to the list.
+ *
+ * @param op The opcode or directive.
+ * @param nargs The number of operands that follow.
+ */
+extern void asm_emit (const char *op, int nargs, ...);
+
+/**
+ * Append a label to the list.
+ *
+ * @param label The name of the label.
+ */
+extern void asm_label (const char *label);
+
+/**
+ * Get the position that the next instruction will be put at.
+ *
+ */
+extern size_t asm_mark (void);
+
+/**
+ * Rewrite the frame addresses of the instructions from @c from to the
+ * end of the list to be off of %rsp instead of %rbp, for functions
+ * that don't keep a frame pointer.
+ *
+ * @param from The position of the first instruction to rewrite.
+ * @param delta The distance from %rsp to where %rbp would point.
+ */
+extern void asm_rebase_frame (size_t from, long long delta);
+
+/**
+ * Run the peephole rules over the list (if optimizing), print it and
+ * empty it.
+ *
+ * @param out The stream to print the instructions on.
+ */
+extern void asm_flush (FILE *out);
+
+/**
+ * Print how often each peephole rule was applied.
+ *
+ * @param out The stream to print on.
+ */
+extern void peephole_print_stats (FILE *out);
+
+#endif
@@ -0,0 +1,519 @@
+/**
+ * @file   sccp.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This is the sparse conditional constant propagation pass.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Each function is lowered into the IR and put into SSA form, then
+ * the algorithm of Wegman and Zadeck finds every value that is
+ * constant along the executable paths.  The results are written back
+ * into the AST: each read of a variable that is known to be constant
+ * becomes an integer, and each conditional whose outcome is known has
+ * its test replaced so that the optimizer can prune the dead branch.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "compiler.h"
+#include "free.h"
+#include "ir.h"
+#include "lib.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The state of a value in the lattice.
+ *
+ */
+enum lattice_state {
+  top_value,			/**< Not yet known (undefined). */
+  const_value,			/**< A known constant. */
+  bottom_value			/**< Not a constant. */
+};
+
+/**
+ * A value in the lattice.
+ *
+ */
+struct lattice
+{
+  enum lattice_state state;	/**< Where in the lattice. */
+  long long c;			/**< The constant if
+				   lattice::state is const_value. */
+};
+
+static const struct lattice top = { top_value, 0 }; /**< Top. */
+static const struct lattice bottom = { bottom_value, 0 }; /**< Bottom. */
+
+static struct ir_func *f = NULL; /**< The function being analyzed. */
+static struct lattice *values = NULL; /**< The value of each
+					 register. */
+static int *insn_block = NULL;	/**< The block of each instruction. */
+static char *exec_block = NULL;	/**< Which blocks are executable. */
+static char *exec_edge = NULL;	/**< Which edges are executable, two
+				   for each block. */
+
+static int *uses = NULL;	/**< The uses of every register, where
+				   an instruction is stored as its
+				   index and a phi as -1 - its
+				   index. */
+static size_t *use_first = NULL; /**< Where the uses of each register
+				    start in @c uses. */
+
+static int *flow_work = NULL;	/**< Worklist of edges. */
+static size_t nflow = 0;	/**< Size of the edge worklist. */
+static size_t aflow = 0;	/**< Allocated size of the edge
+				   worklist. */
+static int *ssa_work = NULL;	/**< Worklist of registers. */
+static size_t nssa = 0;		/**< Size of the register worklist. */
+static size_t assa = 0;		/**< Allocated size of the register
+				   worklist. */
+
+/**
+ * Push @c X onto the worklist @c W.
+ *
+ */
+#define PUSH_WORK(W, X) do {						\
+    if (n##W == a##W)							\
+      W##_work = x2nrealloc (W##_work, &a##W, sizeof *W##_work);	\
+    W##_work[n##W++] = (X);						\
+  } while (0)
+
+/**
+ * Find the value of an operand.
+ *
+ */
+static struct lattice
+operand_value (const struct ir_operand *o)
+{
+  struct lattice out = bottom;
+  switch (o->kind)
+    {
+    case ir_imm:
+      out.state = const_value;
+      out.c = o->val;
+      break;
+    case ir_vreg:
+      out = values[o->val];
+      break;
+    default:
+      break;
+    }
+  return out;
+}
+
+/**
+ * Evaluate the instruction @c i over the lattice.
+ *
+ */
+static struct lattice
+evaluate (const struct ir_insn *i)
+{
+  struct lattice a = operand_value (&i->a);
+  struct lattice b = operand_value (&i->b);
+  struct lattice out = bottom;
+  switch (i->code)
+    {
+    case ir_copy:
+      return a;
+
+    case ir_binary:
+      if (a.state == bottom_value || b.state == bottom_value)
+	return bottom;
+      if (a.state == top_value || b.state == top_value)
+	return top;
+      if (fold_constant_binary (i->op, a.c, b.c, &out.c))
+	out.state = const_value;
+      return out;
+
+    case ir_unary:
+      if (a.state != const_value)
+	return a;
+      out.state = fold_constant_unary (i->op, a.c, &out.c)
+	? const_value : bottom_value;
+      return out;
+
+    case ir_select:
+      if (a.state == top_value)
+	return top;
+      if (a.state == const_value)
+	return a.c ? b : operand_value (&i->c);
+      out = operand_value (&i->c);
+      if (b.state == top_value)
+	return out;
+      if (out.state == top_value
+	  || (b.state == const_value && out.state == const_value
+	      && b.c == out.c))
+	return b;
+      return bottom;
+
+    default:
+      return bottom;
+    }
+}
+
+/**
+ * Lower the value of register @c r to @c v, queueing its uses if it
+ * changed.
+ *
+ */
+static void
+update (int r, struct lattice v)
+{
+  struct lattice *old = &values[r];
+  if (old->state == bottom_value || v.state == top_value)
+    return;
+  if (old->state == const_value && (v.state != const_value || v.c != old->c))
+    v = bottom;
+  if (old->state == v.state && old->c == v.c)
+    return;
+  *old = v;
+  PUSH_WORK (ssa, r);
+}
+
+/**
+ * Test if the edge from @c p to @c b is executable.
+ *
+ */
+static int
+edge_executable (int p, int b)
+{
+  return ((exec_edge[2 * p] && f->blocks[p].succ[0] == b)
+	  || (exec_edge[2 * p + 1] && f->blocks[p].succ[1] == b));
+}
+
+/**
+ * Evaluate phi number @c p as the meet of its executable inputs.
+ *
+ */
+static void
+visit_phi (size_t p)
+{
+  const struct ir_phi *phi = &f->phis[p];
+  const struct ir_block *bb = &f->blocks[phi->block];
+  struct lattice v = top;
+  int k;
+  for (k = 0; k < bb->npreds; k++)
+    {
+      if (!edge_executable (bb->preds[k], phi->block))
+	continue;
+      struct lattice a = operand_value (&phi->args[k]);
+      if (a.state == top_value)
+	continue;
+      if (v.state == top_value)
+	v = a;
+      else if (a.state == bottom_value || a.c != v.c)
+	v = bottom;
+    }
+  update (phi->dest, v);
+}
+
+/**
+ * Evaluate instruction number @c n.
+ *
+ */
+static void
+visit_insn (size_t n)
+{
+  const struct ir_insn *i = &f->insns[n];
+  int b = insn_block[n];
+  struct lattice c;
+  switch (i->code)
+    {
+    case ir_jump:
+      PUSH_WORK (flow, 2 * b);
+      break;
+
+    case ir_branch:
+      c = operand_value (&i->a);
+      if (c.state == const_value)
+	PUSH_WORK (flow, 2 * b + !c.c);
+      else if (c.state == bottom_value)
+	{
+	  PUSH_WORK (flow, 2 * b);
+	  PUSH_WORK (flow, 2 * b + 1);
+	}
+      break;
+
+    default:
+      if (i->dest >= 0)
+	update (i->dest, evaluate (i));
+    }
+}
+
+/**
+ * Build the def-use chains of every register.
+ *
+ */
+static void
+build_uses (void)
+{
+  size_t n, r, p, total = 0;
+  int k;
+  use_first = xcalloc (f->nvregs + 2, sizeof *use_first);
+
+#define FOR_EACH_USE(BODY) do {						\
+    for (n = 0; n < f->ninsns; n++)					\
+      {									\
+	const struct ir_operand *ops[] =				\
+	  { &f->insns[n].a, &f->insns[n].b, &f->insns[n].c };		\
+	for (k = 0; k < 3; k++)						\
+	  if (ops[k]->kind == ir_vreg)					\
+	    {								\
+	      r = ops[k]->val;						\
+	      int use = n;						\
+	      BODY;							\
+	    }								\
+      }									\
+    for (p = 0; p < f->nphis; p++)					\
+      for (k = 0; k < f->blocks[f->phis[p].block].npreds; k++)	\
+	if (f->phis[p].args[k].kind == ir_vreg)				\
+	  {								\
+	    r = f->phis[p].args[k].val;					\
+	    int use = -1 - (int) p;					\
+	    BODY;							\
+	  }								\
+  } while (0)
+
+  FOR_EACH_USE ((void) use; use_first[r + 1]++; total++);
+  for (r = 0; r < (size_t) f->nvregs; r++)
+    use_first[r + 1] += use_first[r];
+  uses = xnmalloc (total + 1, sizeof *uses);
+  size_t *fill = xnmalloc (f->nvregs + 1, sizeof *fill);
+  memcpy (fill, use_first, f->nvregs * sizeof *fill);
+  FOR_EACH_USE (uses[fill[r]++] = use);
+  FREE (fill);
+#undef FOR_EACH_USE
+}
+
+/**
+ * Run the propagation to a fixed point.
+ *
+ */
+static void
+propagate (void)
+{
+  size_t n;
+  for (n = 0; n < (size_t) f->nvregs; n++)
+    values[n] = top;
+  exec_block[0] = 1;
+  const struct ir_block *entry = &f->blocks[0];
+  for (n = entry->phi_first; n < entry->phi_first + entry->phi_count; n++)
+    visit_phi (n);
+  for (n = entry->first; n < entry->first + entry->count; n++)
+    visit_insn (n);
+
+  while (nflow > 0 || nssa > 0)
+    {
+      if (nflow > 0)
+	{
+	  int e = flow_work[--nflow];
+	  int b = f->blocks[e / 2].succ[e % 2];
+	  if (exec_edge[e] || b < 0)
+	    continue;
+	  exec_edge[e] = 1;
+	  const struct ir_block *bb = &f->blocks[b];
+	  for (n = bb->phi_first; n < bb->phi_first + bb->phi_count; n++)
+	    visit_phi (n);
+	  if (!exec_block[b])
+	    {
+	      exec_block[b] = 1;
+	      for (n = bb->first; n < bb->first + bb->count; n++)
+		visit_insn (n);
+	    }
+	}
+      else
+	{
+	  int r = ssa_work[--nssa];
+	  size_t u;
+	  for (u = use_first[r]; u < use_first[r + 1]; u++)
+	    {
+	      int use = uses[u];
+	      if (use < 0)
+		{
+		  if (exec_block[f->phis[-1 - use].block])
+		    visit_phi (-1 - use);
+		}
+	      else if (exec_block[insn_block[use]])
+		visit_insn (use);
+	    }
+	}
+    }
+}
+
+/**
+ * A rewrite to be applied to the AST.
+ *
+ */
+struct rewrite
+{
+  struct ast *node;		/**< The AST to rewrite. */
+  long long val;		/**< The value it is known to have. */
+};
+
+static struct rewrite *rewrites = NULL; /**< The rewrites, sorted by
+					   node. */
+static size_t nrewrites = 0;	/**< Number of rewrites. */
+static size_t arewrites = 0;	/**< Allocated rewrites. */
+
+static int
+compare_rewrite (const void *a, const void *b)
+{
+  uintptr_t x = (uintptr_t) ((const struct rewrite *) a)->node;
+  uintptr_t y = (uintptr_t) ((const struct rewrite *) b)->node;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Queue the rewrite of @c node into the value @c val.
+ *
+ */
+static void
+add_rewrite (struct ast *node, long long val)
+{
+  if (nrewrites == arewrites)
+    rewrites = x2nrealloc (rewrites, &arewrites, sizeof *rewrites);
+  rewrites[nrewrites].node = node;
+  rewrites[nrewrites].val = val;
+  nrewrites++;
+}
+
+/**
+ * Collect the rewrites from the results of the propagation.
+ *
+ */
+static void
+collect_rewrites (void)
+{
+  size_t n;
+  for (n = 0; n < f->ninsns; n++)
+    {
+      const struct ir_insn *i = &f->insns[n];
+      struct ast *o = i->origin;
+      if (!exec_block[insn_block[n]] || o == NULL)
+	continue;
+      struct lattice v;
+      if (i->code == ir_copy && o->type == variable_type
+	  && (v = values[i->dest]).state == const_value)
+	add_rewrite (o, o->boolean_not ? !v.c : v.c);
+      else if (i->code == ir_branch && o->type == cond_type
+	       && (v = operand_value (&i->a)).state == const_value
+	       && o->ops[0]->type != integer_type
+	       && !ast_has_side_effects (o->ops[0]))
+	add_rewrite (o, v.c != 0);
+    }
+  qsort (rewrites, nrewrites, sizeof *rewrites, compare_rewrite);
+}
+
+/**
+ * Apply the collected rewrites to the AST.
+ *
+ * @param ss Reference to an AST pointer.
+ */
+static void
+rewrite_r (struct ast **ss)
+{
+  assert (ss != NULL);
+#define s (*ss)
+  if (s == NULL)
+    return;
+  struct rewrite key = { s, 0 };
+  struct rewrite *r = bsearch (&key, rewrites, nrewrites, sizeof *rewrites,
+			       compare_rewrite);
+  if (r != NULL && s->type == variable_type)
+    {
+      struct ast *t = make_integer (r->val);
+      t->throw_away = s->throw_away;
+      t->noreturnint = s->noreturnint;
+      SWAP_AST (t, s);
+      AST_FREE (t);
+    }
+  else if (r != NULL && s->type == cond_type)
+    {
+      AST_FREE (s->ops[0]);
+      s->ops[0] = make_integer (r->val);
+      s->ops[0]->noreturnint = 1;
+    }
+  int i;
+  for (i = 0; i < s->num_ops; i++)
+    rewrite_r (&s->ops[i]);
+  rewrite_r (&s->next);
+#undef s
+}
+
+/**
+ * Propagate the constants of the function @c s.
+ *
+ */
+static void
+sccp_function (struct ast *s)
+{
+  f = ir_lower (s);
+  ir_build_ssa (f);
+
+  size_t b, n;
+  insn_block = xnmalloc (f->ninsns + 1, sizeof *insn_block);
+  for (b = 0; b < f->nblocks; b++)
+    for (n = f->blocks[b].first;
+	 n < f->blocks[b].first + f->blocks[b].count; n++)
+      insn_block[n] = b;
+  values = xnmalloc (f->nvregs + 1, sizeof *values);
+  exec_block = xzalloc (f->nblocks + 1);
+  exec_edge = xzalloc (2 * f->nblocks + 1);
+  build_uses ();
+
+  propagate ();
+  collect_rewrites ();
+  rewrite_r (&s->ops[1]);
+
+  FREE (rewrites);
+  nrewrites = arewrites = 0;
+  FREE (flow_work);
+  nflow = aflow = 0;
+  FREE (ssa_work);
+  nssa = assa = 0;
+  FREE (uses);
+  FREE (use_first);
+  FREE (exec_edge);
+  FREE (exec_block);
+  FREE (values);
+  FREE (insn_block);
+  f = ir_free (f);
+}
+
+int
+propagate_constants (struct ast *s)
+{
+  if (optimize < 2)
+    return 0;
+  for (; s != NULL; s = s->next)
+    if (s->type == function_type)
+      sccp_function (s);
+  return 0;
+}
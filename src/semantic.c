@@ -117,6 +117,20 @@ semantic_r (struct ast *s)
 	CHECK_LVAL (s->ops[0]);
       break;
 
+      /* The switches give their labels real names and the loops and
+	 switches do the same for their breaks, so the ones that are
+	 left are outside of any of them. */
+    case label_type:
+      ERROR (strncmp (s->op.label.name, "case$", 5) != 0
+	     && STRNEQ (s->op.label.name, "default$"),
+	     _("case label not within a switch statement"));
+      break;
+
+    case jump_type:
+      ERROR (STRNEQ (s->op.jump.name, "break$"),
+	     _("break statement not within a loop or switch"));
+      break;
+
     default:
       break;
     }
@@ -0,0 +1,357 @@
+/**
+ * @file   ssa.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief This is the routine that puts the IR into SSA form.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This follows Cytron et al.  Phis are placed on the iterated
+ * dominance frontier of the blocks that store to a slot, and then a
+ * walk over the dominator tree renames every load to the value that
+ * reaches it.  The stores themselves are left alone, since the AST is
+ * still the one that gets compiled.
+ *
+ */
+
+#include "config.h"
+
+#include "free.h"
+#include "ir.h"
+#include "lib.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+/**
+ * The information kept on each promoted slot while renaming.
+ *
+ */
+struct slot_info
+{
+  long long slot;		/**< The slot offset. */
+  struct ir_operand *stack;	/**< The reaching definitions. */
+  size_t nstack;		/**< Depth of the stack. */
+  size_t astack;		/**< Allocated depth. */
+};
+
+static struct slot_info *slots = NULL; /**< The promoted slots. */
+static size_t nslots = 0;	/**< Number of promoted slots. */
+
+static int
+compare_slot (const void *a, const void *b)
+{
+  long long x = ((const struct slot_info *) a)->slot;
+  long long y = ((const struct slot_info *) b)->slot;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Find the promoted slot @c slot.
+ *
+ * @return The slot's information or NULL if it was not promoted.
+ */
+static struct slot_info *
+find_slot (long long slot)
+{
+  struct slot_info key = { slot, NULL, 0, 0 };
+  return bsearch (&key, slots, nslots, sizeof *slots, compare_slot);
+}
+
+/**
+ * Collect every slot that is accessed in @c f but never has its
+ * address taken.
+ *
+ */
+static void
+collect_slots (struct ir_func *f)
+{
+  size_t i, n = 0;
+  slots = xnmalloc (f->ninsns + 1, sizeof *slots);
+  for (i = 0; i < f->ninsns; i++)
+    {
+      struct ir_insn *in = &f->insns[i];
+      if (in->code == ir_load || in->code == ir_store)
+	{
+	  slots[n].slot = in->a.val;
+	  slots[n].stack = NULL;
+	  slots[n].nstack = slots[n].astack = 0;
+	  n++;
+	}
+    }
+  qsort (slots, n, sizeof *slots, compare_slot);
+
+  /* Remove the duplicates and any slot that escapes. */
+  nslots = 0;
+  for (i = 0; i < n; i++)
+    if (nslots == 0 || slots[nslots - 1].slot != slots[i].slot)
+      slots[nslots++] = slots[i];
+  for (i = 0; i < f->ninsns; i++)
+    {
+      struct ir_insn *in = &f->insns[i];
+      struct ir_operand *ops[] = { &in->a, &in->b, &in->c };
+      int k;
+      for (k = 0; k < 3; k++)
+	if (ops[k]->kind == ir_slot
+	    && !((in->code == ir_load || in->code == ir_store) && k == 0))
+	  {
+	    struct slot_info *s = find_slot (ops[k]->val);
+	    if (s != NULL)
+	      {
+		*s = slots[--nslots];
+		qsort (slots, nslots, sizeof *slots, compare_slot);
+	      }
+	  }
+    }
+}
+
+/**
+ * Compute the dominance frontier of every block.
+ *
+ * @param f The function after ir_dominators.
+ * @param df The frontier of each block, as a bit matrix.
+ */
+static void
+frontiers (struct ir_func *f, char *df)
+{
+  size_t b;
+  for (b = 0; b < f->nblocks; b++)
+    {
+      struct ir_block *bb = &f->blocks[b];
+      if (bb->npreds < 2 || bb->idom < 0)
+	continue;
+      int k;
+      for (k = 0; k < bb->npreds; k++)
+	{
+	  int runner = bb->preds[k];
+	  if (f->blocks[runner].idom < 0)
+	    continue;
+	  while (runner != bb->idom)
+	    {
+	      df[runner * f->nblocks + b] = 1;
+	      if (runner == 0)
+		break;
+	      runner = f->blocks[runner].idom;
+	    }
+	}
+    }
+}
+
+/**
+ * Place the phis for every promoted slot and sort them by block.
+ *
+ */
+static void
+place_phis (struct ir_func *f)
+{
+  size_t nb = f->nblocks, s, b, aphis = 0;
+  char *df = xzalloc (nb * nb + 1);
+  char *has_phi = xmalloc (nb + 1);
+  char *in_list = xmalloc (nb + 1);
+  int *work = xnmalloc (nb + 1, sizeof *work);
+  frontiers (f, df);
+
+  for (s = 0; s < nslots; s++)
+    {
+      size_t nwork = 0;
+      memset (has_phi, 0, nb);
+      memset (in_list, 0, nb);
+      for (b = 0; b < nb; b++)
+	{
+	  struct ir_insn *i;
+	  IR_FOR_INSNS (i, f, b)
+	    if (i->code == ir_store && i->a.val == slots[s].slot)
+	      {
+		in_list[b] = 1;
+		work[nwork++] = b;
+		break;
+	      }
+	}
+      while (nwork > 0)
+	{
+	  int x = work[--nwork];
+	  for (b = 0; b < nb; b++)
+	    if (df[x * nb + b] && !has_phi[b])
+	      {
+		has_phi[b] = 1;
+		if (f->nphis == aphis)
+		  f->phis = x2nrealloc (f->phis, &aphis, sizeof *f->phis);
+		struct ir_phi *p = &f->phis[f->nphis++];
+		p->block = b;
+		p->slot = slots[s].slot;
+		p->dest = f->nvregs++;
+		p->args = xcalloc (f->blocks[b].npreds + 1, sizeof *p->args);
+		if (!in_list[b])
+		  {
+		    in_list[b] = 1;
+		    work[nwork++] = b;
+		  }
+	      }
+	}
+    }
+
+  /* Group the phis by the block they are in. */
+  size_t *count = xcalloc (nb + 1, sizeof *count);
+  struct ir_phi *sorted = xnmalloc (f->nphis + 1, sizeof *sorted);
+  for (s = 0; s < f->nphis; s++)
+    count[f->phis[s].block]++;
+  size_t at = 0;
+  for (b = 0; b < nb; b++)
+    {
+      f->blocks[b].phi_first = at;
+      f->blocks[b].phi_count = 0;
+      at += count[b];
+    }
+  for (s = 0; s < f->nphis; s++)
+    {
+      struct ir_block *bb = &f->blocks[f->phis[s].block];
+      sorted[bb->phi_first + bb->phi_count++] = f->phis[s];
+    }
+  FREE (f->phis);
+  f->phis = sorted;
+
+  FREE (count);
+  FREE (work);
+  FREE (in_list);
+  FREE (has_phi);
+  FREE (df);
+}
+
+/**
+ * Push @c v as the newest definition of @c s.
+ *
+ */
+static void
+push (struct slot_info *s, struct ir_operand v)
+{
+  if (s->nstack == s->astack)
+    s->stack = x2nrealloc (s->stack, &s->astack, sizeof *s->stack);
+  s->stack[s->nstack++] = v;
+}
+
+/**
+ * Get the definition of @c s that reaches the current point.
+ *
+ */
+static struct ir_operand
+top (struct slot_info *s)
+{
+  if (s->nstack > 0)
+    return s->stack[s->nstack - 1];
+  struct ir_operand entry = { ir_slot, s->slot, NULL };
+  return entry;
+}
+
+/**
+ * Rename the loads of block @c b and of every block it dominates.
+ *
+ * @param f The function.
+ * @param b The block to rename.
+ * @param children The dominator tree, as a list of first children.
+ * @param sibling The next sibling of each block in the dominator tree.
+ */
+static void
+rename_block (struct ir_func *f, int b, const int *children,
+	      const int *sibling)
+{
+  struct ir_block *bb = &f->blocks[b];
+  size_t *depth = xnmalloc (nslots + 1, sizeof *depth);
+  size_t p, s;
+  for (s = 0; s < nslots; s++)
+    depth[s] = slots[s].nstack;
+
+  for (p = bb->phi_first; p < bb->phi_first + bb->phi_count; p++)
+    {
+      struct ir_operand v = { ir_vreg, f->phis[p].dest, NULL };
+      push (find_slot (f->phis[p].slot), v);
+    }
+
+  struct ir_insn *i;
+  IR_FOR_INSNS (i, f, b)
+    {
+      struct slot_info *si;
+      if (i->code == ir_load && (si = find_slot (i->a.val)) != NULL)
+	{
+	  i->code = ir_copy;
+	  i->a = top (si);
+	}
+      else if (i->code == ir_store && (si = find_slot (i->a.val)) != NULL)
+	{
+	  push (si, i->b);
+	  i->code = ir_nop;
+	  i->a.kind = i->b.kind = ir_none;
+	}
+    }
+
+  int k;
+  for (k = 0; k < 2; k++)
+    {
+      int t = bb->succ[k];
+      if (t < 0 || (k == 1 && t == bb->succ[0]))
+	continue;
+      struct ir_block *tb = &f->blocks[t];
+      int j;
+      for (j = 0; j < tb->npreds; j++)
+	if (tb->preds[j] == b)
+	  for (p = tb->phi_first; p < tb->phi_first + tb->phi_count; p++)
+	    f->phis[p].args[j] = top (find_slot (f->phis[p].slot));
+    }
+
+  int c;
+  for (c = children[b]; c >= 0; c = sibling[c])
+    rename_block (f, c, children, sibling);
+
+  for (s = 0; s < nslots; s++)
+    slots[s].nstack = depth[s];
+  FREE (depth);
+}
+
+void
+ir_build_ssa (struct ir_func *f)
+{
+  assert (f->nphis == 0);
+  ir_dominators (f);
+  collect_slots (f);
+  place_phis (f);
+
+  size_t nb = f->nblocks, b;
+  int *children = xnmalloc (nb + 1, sizeof *children);
+  int *sibling = xnmalloc (nb + 1, sizeof *sibling);
+  for (b = 0; b < nb; b++)
+    children[b] = sibling[b] = -1;
+  for (b = nb; b-- > 1;)
+    {
+      int d = f->blocks[b].idom;
+      if (d >= 0)
+	{
+	  sibling[b] = children[d];
+	  children[d] = b;
+	}
+    }
+  rename_block (f, 0, children, sibling);
+  FREE (sibling);
+  FREE (children);
+
+  size_t s;
+  for (s = 0; s < nslots; s++)
+    FREE (slots[s].stack);
+  FREE (slots);
+  nslots = 0;
+}
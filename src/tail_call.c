@@ -0,0 +1,236 @@
+/**
+ * @file   tail_call.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief  Tail recursion elimination.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * A function that returns the result of calling itself doesn't need a
+ * new stack frame for the call: the arguments are stored into the
+ * parameters and control jumps back to the start of the body, after
+ * the allocation of its variables.
+ *
+ *     return f (n - 1, a * n);
+ *
+ * becomes
+ *
+ *     n = n - 1;
+ *     a = a * n';      (n' is a copy of n taken before it changed)
+ *     goto start;
+ *
+ * An argument is only copied into a temporary first if it reads a
+ * parameter that is assigned before it.  Since every call reuses the
+ * same variables, this is only done in functions that never let the
+ * address of anything in their frame escape.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "loc.h"
+#include "my_printf.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+static int labelno = 0;		/**< The number of the next label. */
+
+int
+address_escapes (const struct ast *s)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == unary_type && s->op.unary.op == '&'
+	  && s->ops[0]->type != string_type)
+	return 1;
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	if ((s->ops[i] != NULL && s->ops[i]->type == alloc_type)
+	    || address_escapes (s->ops[i]))
+	  return 1;
+    }
+  return 0;
+}
+
+/**
+ * Test if @c s is a call of the function @c function with one
+ * argument for each of its parameters.
+ *
+ */
+static int
+is_self_call (const struct ast *s, const struct ast *function)
+{
+  if (s == NULL || s->type != function_call_type || s->boolean_not)
+    return 0;
+  const struct ast *name = s->ops[0];
+  if (name->type != variable_type || !IS_LITERAL (name->loc)
+      || STRNEQ (name->loc->base, function->op.function.name))
+    return 0;
+  int n = 0;
+  const struct ast *t;
+  for (t = s->ops[1]; t != NULL; t = t->next)
+    n++;
+  for (t = function->ops[0]; t != NULL; t = t->next)
+    if (t->type == variable_type)
+      n--;
+  return n == 0;
+}
+
+/**
+ * Test if @c s contains a self tail call of @c function.
+ *
+ */
+static int
+has_tail_call (const struct ast *s, const struct ast *function)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == ret_type && is_self_call (s->ops[0], function))
+	return 1;
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	if (has_tail_call (s->ops[i], function))
+	  return 1;
+    }
+  return 0;
+}
+
+/**
+ * Test if @c s reads the parameter @c param.
+ *
+ */
+static int
+reads (const struct ast *s, const struct ast *param)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == variable_type && IS_MEMORY (s->loc)
+	  && s->loc->index == NULL && STREQ (s->loc->base, param->loc->base)
+	  && s->loc->offset == param->loc->offset)
+	return 1;
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	if (reads (s->ops[i], param))
+	  return 1;
+    }
+  return 0;
+}
+
+/**
+ * Make a reference to the variable @c v.
+ *
+ */
+static struct ast *
+reference (const struct ast *v)
+{
+  struct ast *t = make_variable (NULL, xstrdup (v->op.variable.name));
+  t->op.variable.alloc = v->op.variable.alloc;
+  t->loc = loc_dup (v->loc);
+  return t;
+}
+
+/**
+ * Replace the self tail calls in @c s with jumps to @c start.
+ *
+ * @param ss Reference to an AST pointer.
+ * @param function The function that @c s is in.
+ */
+static void
+eliminate_r (struct ast **ss, struct ast *function, const char *start)
+{
+  assert (ss != NULL);
+#define s (*ss)
+  if (s == NULL)
+    return;
+  eliminate_r (&s->next, function, start);
+  if (s->type != ret_type || !is_self_call (s->ops[0], function))
+    {
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	eliminate_r (&s->ops[i], function, start);
+      return;
+    }
+
+  struct ast *copies = NULL, *stores = NULL, *arg = s->ops[0]->ops[1];
+  const struct ast *param, *p;
+  s->ops[0]->ops[1] = NULL;
+  for (param = function->ops[0]; param != NULL; param = param->next)
+    {
+      if (param->type != variable_type)
+	continue;
+      struct ast *next = arg->next;
+      arg->next = NULL;
+
+      /* The parameters that come before this one have been assigned
+	 by the time that it is evaluated. */
+      for (p = function->ops[0]; p != param; p = p->next)
+	if (p->type == variable_type && reads (arg, p))
+	  break;
+      if (p != param)
+	{
+	  struct ast *t = make_temporary (function);
+	  copies = ast_cat (copies, make_assign (ast_dup (t), arg));
+	  arg = t;
+	}
+      stores = ast_cat (stores, make_assign (reference (param), arg));
+      arg = next;
+    }
+
+  struct ast *jump = make_jump (xstrdup (start));
+  MAKE_BASE_LOC (jump->loc, symbol_loc, xstrdup (start));
+  struct ast *t = ast_cat (ast_cat (copies, stores), jump);
+  t = ast_cat (t, s->next);
+  s->next = NULL;
+  AST_FREE (s);
+  s = t;
+#undef s
+}
+
+int
+eliminate_tail_recursion (struct ast *s)
+{
+  if (optimize < 1)
+    return 0;
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type != function_type || address_escapes (s->ops[1])
+	  || !has_tail_call (s->ops[1], s))
+	continue;
+
+      /* The loop starts after the allocations, so the stack doesn't
+	 grow on every iteration. */
+      char *start = my_printf (".LT%d", labelno++);
+      struct ast **link = &s->ops[1]->ops[0];
+      while (*link != NULL && (*link)->type == alloc_type)
+	link = &(*link)->next;
+      struct ast *label = make_label (xstrdup (start));
+      MAKE_BASE_LOC (label->loc, symbol_loc, xstrdup (start));
+      *link = ast_cat (label, *link);
+      eliminate_r (&s->ops[1]->ops[0], s, start);
+      FREE (start);
+    }
+  return 0;
+}
@@ -30,15 +30,304 @@
 #include "ast.h"
 #include "ast_util.h"
 #include "compiler.h"
+#include "free.h"
 #include "lib.h"
+#include "my_printf.h"
 #include "parse.h"
+#include "xalloc.h"
 
 #include <assert.h>
+#include <string.h>
 
 #define IS_BUILTIN(A, B)					\
   ((A)->ops[0]->type == variable_type				\
    && STREQ ((A)->ops[0]->op.variable.name, BUILTIN (B)))
 
+/** Test if @c S is an @c && or @c || operator. */
+#define IS_LOGICAL(S)						\
+  ((S)->type == binary_type					\
+   && ((S)->op.binary.op == AND || (S)->op.binary.op == OR))
+
+/** Test if @c S is a comparison, whose value is already 0 or 1. */
+#define IS_COMPARISON(S)					\
+  ((S)->type == binary_type					\
+   && ((S)->op.binary.op == EQ || (S)->op.binary.op == NE	\
+       || (S)->op.binary.op == '<' || (S)->op.binary.op == '>'	\
+       || (S)->op.binary.op == LE || (S)->op.binary.op == GE))
+
+/** The builtins that are operators.  A builtin whose operator is 0
+    is the value of its first argument. */
+static const struct
+{
+  const char *name;		/**< The name of the builtin. */
+  int op;			/**< The operator that it becomes. */
+} builtin_ops[] = {
+  { BUILTIN (popcount), POPCOUNT },
+  { BUILTIN (popcountl), POPCOUNT },
+  { BUILTIN (popcountll), POPCOUNT },
+  { BUILTIN (ctz), CTZ },
+  { BUILTIN (ctzl), CTZ },
+  { BUILTIN (ctzll), CTZ },
+  { BUILTIN (clz), CLZ },
+  { BUILTIN (clzl), CLZ },
+  { BUILTIN (clzll), CLZ },
+  { BUILTIN (bswap64), BSWAP },
+  { BUILTIN (prefetch), PREFETCH },
+  { BUILTIN (expect), 0 },
+};
+
+/** The builtins that are library functions.  They are called by
+    their library name, unless the code generator expands them. */
+static const char *const builtin_calls[] = { "memcpy", "memmove", "memset" };
+
+static int logicalno = 0;	/**< The number of the next value that
+				   is taken out of an expression. */
+
+/**
+ * Test if @c s contains an @c && or @c || operator.
+ *
+ */
+static int
+has_logical (const struct ast *s)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (IS_LOGICAL (s))
+	return 1;
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	if (has_logical (s->ops[i]))
+	  return 1;
+    }
+  return 0;
+}
+
+/**
+ * Replace the call @c s of a builtin that is an operator with the
+ * operator applied to its first argument.  The other arguments are
+ * hints that are dropped.
+ *
+ * @param ss Reference to the call.
+ *
+ * @return true if @c s was replaced, false otherwise.
+ */
+static int
+lower_builtin (struct ast **ss)
+{
+#define s (*ss)
+  if (s->ops[0]->type != variable_type || s->ops[1] == NULL)
+    return 0;
+  size_t i;
+  for (i = 0; i < sizeof builtin_ops / sizeof *builtin_ops; i++)
+    if (STREQ (s->ops[0]->op.variable.name, builtin_ops[i].name))
+      break;
+  if (i == sizeof builtin_ops / sizeof *builtin_ops)
+    return 0;
+
+  struct ast *arg = s->ops[1];
+  s->ops[1] = arg->next;
+  arg->next = NULL;
+  struct ast *t = builtin_ops[i].op == 0 ? arg
+    : make_unary (builtin_ops[i].op, arg);
+  t->throw_away = s->throw_away;
+  t->boolean_not ^= s->boolean_not;
+  t->noreturnint |= s->noreturnint;
+  SWAP_AST (s, t);
+  AST_FREE (t);
+  return 1;
+#undef s
+}
+
+/**
+ * Rename the call @c s of a builtin that is a library function to the
+ * library function.
+ *
+ */
+static void
+rename_builtin (struct ast *s)
+{
+  if (s->ops[0]->type != variable_type)
+    return;
+  char **name = &s->ops[0]->op.variable.name;
+  size_t i;
+  for (i = 0; i < sizeof builtin_calls / sizeof *builtin_calls; i++)
+    if (strncmp (*name, "__builtin_", 10) == 0
+	&& STREQ (*name + 10, builtin_calls[i]))
+      {
+	char *t = xstrdup (builtin_calls[i]);
+	FREE (*name);
+	*name = t;
+	return;
+      }
+}
+
+/**
+ * Find an @c && or @c || operator in the statement @c ss that is used
+ * as a value, or a ternary whose branches contain one.  Nothing is
+ * looked for in the branches of a ternary, since they aren't always
+ * evaluated.
+ *
+ * @return The operator, or NULL if there isn't one.
+ */
+static struct ast **
+find_logical (struct ast **ss)
+{
+  assert (ss != NULL);
+#define s (*ss)
+  if (IS_LOGICAL (s)
+      || (s->type == ternary_type
+	  && (has_logical (s->ops[1]) || has_logical (s->ops[2]))))
+    return ss;
+  int i, n = s->type == ternary_type ? 1 : s->num_ops;
+  for (i = 0; i < n; i++)
+    {
+      struct ast **t;
+      for (t = &s->ops[i]; *t != NULL; t = &(*t)->next)
+	{
+	  struct ast **found = find_logical (t);
+	  if (found != NULL)
+	    return found;
+	}
+    }
+  return NULL;
+#undef s
+}
+
+/**
+ * Make the statement that assigns @c value to the variable @c name.
+ *
+ */
+static struct ast *
+assign (const char *name, struct ast *value)
+{
+  struct ast *t = make_binary ('=', make_variable (NULL, xstrdup (name)),
+			       value);
+  t->throw_away = 1;
+  return t;
+}
+
+/**
+ * Take the operator at @c value out of its statement, which is at
+ * @c link, computing it into a new variable before the statement with
+ * branches that only evaluate what they need to.
+ *
+ *     x = a && b;
+ *
+ * becomes
+ *
+ *     int t = 0;
+ *     if (a)
+ *       t = b != 0;
+ *     x = t;
+ *
+ */
+static void
+lower_value (struct ast **link, struct ast **value)
+{
+  struct ast *s = *value, *out, *t;
+  int n = logicalno++;
+  char *name = my_printf ("logical$%d", n);
+  char *end = my_printf ("logical$%d$end", n);
+  struct ast *a = s->ops[0], *b = s->ops[1];
+  s->ops[0] = s->ops[1] = NULL;
+
+  out = make_variable (xstrdup ("int"), xstrdup (name));
+  if (s->type == ternary_type)
+    {
+      char *other = my_printf ("logical$%d$else", n);
+      struct ast *c = a;
+      a = b;
+      b = s->ops[2];
+      s->ops[2] = NULL;
+      c->boolean_not ^= 1;
+      out = ast_cat (out, make_cond (xstrdup (other), c));
+      out = ast_cat (out, assign (name, a));
+      out = ast_cat (out, make_jump (xstrdup (end)));
+      out = ast_cat (out, make_label (other));
+      out = ast_cat (out, assign (name, b));
+    }
+  else
+    {
+      int and = s->op.binary.op == AND;
+      out = ast_cat (out, assign (name, make_integer (!and)));
+      a->boolean_not ^= and;
+      out = ast_cat (out, make_cond (xstrdup (end), a));
+      if (!IS_COMPARISON (b) && !b->boolean_not)
+	b = make_binary (NE, b, make_integer (0));
+      out = ast_cat (out, assign (name, b));
+    }
+  out = ast_cat (out, make_label (end));
+
+  t = make_variable (NULL, name);
+  t->throw_away = s->throw_away;
+  t->boolean_not = s->boolean_not;
+  SWAP_AST (t, *value);
+  AST_FREE (t);
+  *link = ast_cat (out, *link);
+}
+
+/**
+ * Split the conditional jump @c s on an @c && or @c || operator into
+ * a chain of jumps on its operands.
+ *
+ * @return The chain, followed by the statements after @c s.
+ */
+static struct ast *
+lower_cond (struct ast *s)
+{
+  struct ast *c = s->ops[0], *a = c->ops[0], *b = c->ops[1], *out;
+  const char *target = s->op.cond.name;
+  c->ops[0] = c->ops[1] = NULL;
+
+  /* !(a && b) is !a || !b, and !(a || b) is !a && !b. */
+  int and = (c->op.binary.op == AND) ^ c->boolean_not;
+  a->boolean_not ^= c->boolean_not;
+  b->boolean_not ^= c->boolean_not;
+  if (and)
+    {
+      /* Only jump on b if a holds. */
+      char *skip = my_printf ("logical$%d$end", logicalno++);
+      a->boolean_not ^= 1;
+      out = make_cond (xstrdup (skip), a);
+      out = ast_cat (out, make_cond (xstrdup (target), b));
+      out = ast_cat (out, make_label (skip));
+    }
+  else
+    out = ast_cat (make_cond (xstrdup (target), a),
+		   make_cond (xstrdup (target), b));
+
+  out = ast_cat (out, s->next);
+  s->next = NULL;
+  AST_FREE (s);
+  return out;
+}
+
+/**
+ * Lower every @c && and @c || operator in the statements at @c link.
+ *
+ */
+static void
+lower_logical (struct ast **link)
+{
+  while (*link != NULL)
+    {
+      struct ast *s = *link, **value;
+      if (s->type == block_type)
+	lower_logical (&s->ops[0]);
+      else if (s->type == cond_type && IS_LOGICAL (s->ops[0]))
+	{
+	  *link = lower_cond (s);
+	  continue;
+	}
+      else if ((value = find_logical (link)) != NULL)
+	{
+	  lower_value (link, value);
+	  continue;
+	}
+      link = &s->next;
+    }
+}
+
 static void
 transform_r (struct ast **ss)
 {
@@ -73,6 +362,7 @@ transform_r (struct ast **ss)
       break;
 
     case cond_type:
+    case ternary_type:
       s->ops[0]->noreturnint = 1;
       break;
 
@@ -86,10 +376,26 @@ transform_r (struct ast **ss)
 	  SWAP_AST (t, s);
 	  AST_FREE (t);
 	}
+      else if (lower_builtin (ss))
+	{
+	  transform_r (ss);
+	  return;
+	}
+      else
+	rename_builtin (s);
     
     default:
       break;
     }
+
+  /* Anything else with a NOT applied to it is compared against zero
+     when it is used as a value. */
+  if (s->boolean_not && !s->noreturnint)
+    {
+      s->noreturnint = 1;
+      struct ast *t = make_ternary (s, make_integer (1), make_integer (0));
+      SWAP_AST (t, s);
+    }
   int i;
   for (i = 0; i < s->num_ops; i++)
     transform_r (&s->ops[i]);
@@ -100,6 +406,10 @@ transform_r (struct ast **ss)
 int
 transform (struct ast **ss)
 {
+  struct ast *s;
+  for (s = *ss; s != NULL; s = s->next)
+    if (s->type == function_type)
+      lower_logical (&s->ops[1]->ops[0]);
   transform_r (ss);
   return 0;
 }
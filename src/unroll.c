@@ -0,0 +1,666 @@
+/**
+ * @file   unroll.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief  Loop unrolling.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This works on the flattened body of each function, where a loop is
+ * a run of statements from a label to a cond that branches back to
+ * it.  Only counted loops are unrolled: the cond must compare a
+ * counter with a value that doesn't change in the loop, and a single
+ * statement that runs once on every iteration must step the counter
+ * by a constant.
+ *
+ * A loop is unrolled by a factor chosen so that the unrolled body
+ * stays small.  The copies of the body read the counter plus the
+ * amount that the copies before them would have stepped it, and the
+ * counter is stepped once after all of them.  The unrolled loop runs
+ * while there are enough iterations left for all of the copies, and
+ * the original loop is kept after it to run the rest.
+ *
+ *     if (!(i + 3 < n)) goto L;
+ *   U:
+ *     body (i); body (i + 1); body (i + 2); body (i + 3);
+ *     i = i + 4;
+ *     if (i + 3 < n) goto U;
+ *     if (!(i < n)) goto X;
+ *   L:
+ *     body (i);
+ *     i = i + 1;
+ *     if (i < n) goto L;
+ *   X:
+ *
+ * When the counter starts at a constant and the loop runs a small,
+ * constant number of times, the loop is replaced by that many copies
+ * of its body with the counter replaced by constants.  The optimizer
+ * is run again over a function that was changed to fold them.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "loc.h"
+#include "loop.h"
+#include "my_printf.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** The most nodes that an unrolled body may have. */
+#define UNROLL_BUDGET 64
+
+/** The largest factor a loop is unrolled by. */
+#define UNROLL_MAX 8
+
+/** The most iterations of a loop that is unrolled completely. */
+#define PEEL_MAX 16
+
+/** The most nodes that a completely unrolled loop may have. */
+#define PEEL_BUDGET 128
+
+static int labelno = 0;		/**< The number of the next label. */
+
+/**
+ * A counted loop.
+ *
+ */
+struct counted_loop
+{
+  size_t head;			/**< The statement of the header
+				   label. */
+  size_t back;			/**< The statement of the cond that
+				   branches back to it. */
+  size_t step;			/**< The statement stepping the
+				   counter. */
+  struct ast *var;		/**< The counter. */
+  long long inc;		/**< The amount the counter steps by. */
+  int known;			/**< Whether the counter starts at a
+				   constant. */
+  long long start;		/**< That constant. */
+};
+
+/**
+ * Test if @c s is the local variable at offset @c off in the frame.
+ *
+ */
+static int
+is_var (const struct ast *s, int off)
+{
+  return (s != NULL && s->type == variable_type && IS_MEMORY (s->loc)
+	  && s->loc->index == NULL && s->loc->offset == off);
+}
+
+/**
+ * Count the assignments, increments and decrements of the variable at
+ * offset @c off in @c s and the ASTs that follow it.
+ *
+ */
+static int
+writes (const struct ast *s, int off)
+{
+  int n = 0;
+  for (; s != NULL; s = s->next)
+    {
+      if ((s->type == binary_type && s->op.binary.op == '='
+	   && is_var (s->ops[0], off))
+	  || (s->type == unary_type
+	      && (s->op.unary.op == INC || s->op.unary.op == DEC)
+	      && is_var (s->ops[0], off)))
+	n++;
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	n += writes (s->ops[i], off);
+    }
+  return n;
+}
+
+/**
+ * Find the statement of the label @c name between statements @c from
+ * and @c to.
+ *
+ * @return The statement number, or @c to if there is none.
+ */
+static size_t
+find_label (const char *name, size_t from, size_t to)
+{
+  for (; from < to; from++)
+    if (STMT (from)->type == label_type && refers_to (STMT (from), name))
+      break;
+  return from;
+}
+
+/**
+ * Count the nodes of @c s, not counting the ASTs that follow it.
+ *
+ */
+static size_t
+size_of (const struct ast *s)
+{
+  size_t n = 1;
+  int i;
+  for (i = 0; i < s->num_ops; i++)
+    {
+      const struct ast *t;
+      for (t = s->ops[i]; t != NULL; t = t->next)
+	n += size_of (t);
+    }
+  return n;
+}
+
+/**
+ * Test if the expression @c s has the same value throughout the
+ * statements @c from to @c to.
+ *
+ */
+static int
+invariant_expr (const struct ast *s, struct ast *body, size_t from,
+		size_t to)
+{
+  switch (s->type)
+    {
+    case integer_type:
+      return 1;
+
+    case variable_type:
+      if (!is_local (s) || address_taken (body, s))
+	return 0;
+      for (; from < to; from++)
+	{
+	  struct ast *t = STMT (from), *next = t->next;
+	  t->next = NULL;
+	  int n = writes (t, s->loc->offset);
+	  t->next = next;
+	  if (n > 0)
+	    return 0;
+	}
+      return 1;
+
+    case binary_type:
+      switch (s->op.binary.op)
+	{
+	case '=':
+	case '[':
+	  return 0;
+	}
+      return (invariant_expr (s->ops[0], body, from, to)
+	      && invariant_expr (s->ops[1], body, from, to));
+
+    case unary_type:
+      switch (s->op.unary.op)
+	{
+	case '*':
+	case '&':
+	case INC:
+	case DEC:
+	  return 0;
+	}
+      return invariant_expr (s->ops[0], body, from, to);
+
+    default:
+      return 0;
+    }
+}
+
+/**
+ * Find the amount that the statement @c s steps the variable at
+ * offset @c off by.
+ *
+ * @return The amount, or 0 if @c s doesn't step it by a constant.
+ */
+static long long
+step_of (const struct ast *s, int off)
+{
+  if (s->type == unary_type && is_var (s->ops[0], off))
+    return (s->op.unary.op == INC ? 1 : s->op.unary.op == DEC ? -1 : 0);
+  if (s->type != binary_type || s->op.binary.op != '='
+      || !is_var (s->ops[0], off))
+    return 0;
+  const struct ast *v = s->ops[1];
+  if (v->type != binary_type || v->boolean_not
+      || (v->op.binary.op != '+' && v->op.binary.op != '-'))
+    return 0;
+  if (is_var (v->ops[0], off) && v->ops[1]->type == integer_type
+      && !v->ops[1]->boolean_not)
+    return (v->op.binary.op == '+' ? v->ops[1]->op.integer.i
+	    : -v->ops[1]->op.integer.i);
+  if (v->op.binary.op == '+' && is_var (v->ops[1], off)
+      && v->ops[0]->type == integer_type && !v->ops[0]->boolean_not)
+    return v->ops[0]->op.integer.i;
+  return 0;
+}
+
+/**
+ * Get the comparison that the test @c s really makes, taking its
+ * boolean NOT into account.
+ *
+ * @return The operator, or 0 if it isn't an ordering.
+ */
+static int
+test_op (const struct ast *s)
+{
+  if (s->type != binary_type)
+    return 0;
+  switch (s->op.binary.op)
+    {
+    case '<': return s->boolean_not ? GE : '<';
+    case '>': return s->boolean_not ? LE : '>';
+    case LE: return s->boolean_not ? '>' : LE;
+    case GE: return s->boolean_not ? '<' : GE;
+    default: return 0;
+    }
+}
+
+/**
+ * Evaluate the comparison @c op of @c l and @c r.
+ *
+ */
+static int
+compare (int op, long long l, long long r)
+{
+  switch (op)
+    {
+    case '<': return l < r;
+    case '>': return l > r;
+    case LE: return l <= r;
+    default: return l >= r;
+    }
+}
+
+/**
+ * Check that the loop from statement @c head to @c back is a counted
+ * loop that can be unrolled, and fill in @c l.
+ *
+ */
+static int
+analyze_loop (struct ast *body, size_t head, size_t back,
+	      struct counted_loop *l)
+{
+  struct ast *test = STMT (back)->ops[0];
+  int op = test_op (test);
+  size_t i, j;
+  if (op == 0 || ast_has_side_effects (test)
+      || count_refs (ast_label_name (STMT (head)), 0, nlinks) != 1)
+    return 0;
+
+  /* Every label in the loop must only be branched to from inside of
+     it, so that the copies can be given labels of their own. */
+  for (i = head + 1; i < back; i++)
+    {
+      struct ast *t = STMT (i);
+      if (t->type == alloc_type)
+	return 0;
+      if (t->type == label_type
+	  && (count_refs (ast_label_name (t), 0, nlinks)
+	      != count_refs (ast_label_name (t), head + 1, back)))
+	return 0;
+    }
+
+  int side;
+  for (side = 0; side < 2; side++)
+    {
+      struct ast *v = test->ops[side];
+      if (!is_local (v) || address_taken (body, v)
+	  || !invariant_expr (test->ops[!side], body, head + 1, back))
+	continue;
+      int off = v->loc->offset, n = 0;
+      long long inc = 0;
+      for (i = head + 1; i < back; i++)
+	{
+	  struct ast *t = STMT (i), *next = t->next;
+	  t->next = NULL;
+	  int w = writes (t, off);
+	  t->next = next;
+	  if (w > 0)
+	    {
+	      n += w;
+	      l->step = i;
+	      inc = step_of (t, off);
+	    }
+	}
+      if (n != 1 || inc == 0 || inc < -(1 << 20) || inc > (1 << 20))
+	continue;
+
+      /* The counter has to move towards the end of the loop. */
+      int up = (op == '<' || op == LE) == (side == 0);
+      if (up != (inc > 0))
+	continue;
+
+      l->head = head;
+      l->back = back;
+      l->var = STMT (l->step)->ops[0];
+      l->inc = inc;
+      l->known = start_value (head, l->var, &l->start);
+      break;
+    }
+  if (side == 2)
+    return 0;
+
+  /* The step must run exactly once on every iteration, so no branch
+     may cross it. */
+  for (i = head + 1; i < back; i++)
+    {
+      struct ast *t = STMT (i);
+      if (t->type != jump_type && t->type != cond_type)
+	continue;
+      j = find_label (ast_label_name (t), head + 1, back);
+      if (j < back && (i < l->step) != (j < l->step))
+	return 0;
+    }
+  return 1;
+}
+
+/**
+ * Copy the statement @c s without the statements following it.
+ *
+ */
+static struct ast *
+dup_stmt (struct ast *s)
+{
+  struct ast *next = s->next;
+  s->next = NULL;
+  struct ast *t = ast_dup (s);
+  s->next = next;
+  return t;
+}
+
+/**
+ * Make the label, jump or cond @c s refer to @c name instead.
+ *
+ */
+static void
+rename_label (struct ast *s, const char *name)
+{
+  char **old = (s->type == label_type ? &s->op.label.name
+		: s->type == jump_type ? &s->op.jump.name
+		: &s->op.cond.name);
+  FREE (*old);
+  *old = xstrdup (name);
+  FREE_LOC (s->loc);
+  MAKE_BASE_LOC (s->loc, symbol_loc, xstrdup (name));
+}
+
+/**
+ * Replace every read of the counter in @c s with the counter plus
+ * @c delta, or with the constant @c delta if @c constant is true.
+ *
+ * @param ss Reference to an AST pointer.
+ */
+static void
+offset_reads (struct ast **ss, int off, long long delta, int constant)
+{
+  assert (ss != NULL);
+#define s (*ss)
+  if (s == NULL)
+    return;
+  if (is_var (s, off) && (constant || delta != 0))
+    {
+      struct ast *next = s->next;
+      s->next = NULL;
+      struct ast *t = constant ? make_integer (delta)
+	: make_binary ('+', ast_dup (s), make_integer (delta));
+      s->next = next;
+      t->throw_away = s->throw_away;
+      t->boolean_not = s->boolean_not;
+      t->noreturnint = s->noreturnint;
+      SWAP_AST (t, s);
+      AST_FREE (t);
+    }
+  else
+    {
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	offset_reads (&s->ops[i], off, delta, constant);
+    }
+  offset_reads (&s->next, off, delta, constant);
+#undef s
+}
+
+/**
+ * Make copy number @c k of the body of the loop @c l, without its
+ * step.
+ *
+ * @param constant Whether the counter is replaced by constants.
+ */
+static struct ast *
+copy_body (const struct counted_loop *l, long long k, int constant)
+{
+  struct ast *out = NULL;
+  size_t i, j, nnames = 0;
+  const char **from = xnmalloc (l->back - l->head + 1, sizeof *from);
+  char **to = xnmalloc (l->back - l->head + 1, sizeof *to);
+  for (i = l->head + 1; i < l->back; i++)
+    if (STMT (i)->type == label_type)
+      {
+	from[nnames] = ast_label_name (STMT (i));
+	to[nnames++] = my_printf (".LU%d", labelno++);
+      }
+
+  int off = l->var->loc->offset;
+  long long base = constant ? l->start : 0;
+  for (i = l->head + 1; i < l->back; i++)
+    {
+      struct ast *t = STMT (i);
+      if (i == l->step)
+	continue;
+      t = dup_stmt (t);
+      if (t->type == label_type || t->type == jump_type
+	  || t->type == cond_type)
+	for (j = 0; j < nnames; j++)
+	  if (STREQ (ast_label_name (t), from[j]))
+	    {
+	      rename_label (t, to[j]);
+	      break;
+	    }
+      if (t->type != variable_type)
+	offset_reads (&t, off, base + (i < l->step ? k : k + 1) * l->inc,
+		      constant);
+      out = ast_cat (out, t);
+    }
+  for (j = 0; j < nnames; j++)
+    FREE (to[j]);
+  FREE (to);
+  FREE (from);
+  return out;
+}
+
+/**
+ * Make the statement that sets the counter of @c l to @c v, or steps
+ * it by @c v if @c absolute is false.
+ *
+ */
+static struct ast *
+set_counter (const struct counted_loop *l, long long v, int absolute)
+{
+  struct ast *t = absolute ? make_integer (v)
+    : make_binary ('+', ast_dup (l->var), make_integer (v));
+  t = make_binary ('=', ast_dup (l->var), t);
+  t->throw_away = 1;
+  return t;
+}
+
+/**
+ * Count the number of iterations of the loop @c l.
+ *
+ * @return The count, or 0 if it is more than PEEL_MAX.
+ */
+static int
+trip_count (const struct counted_loop *l)
+{
+  struct ast *test = STMT (l->back)->ops[0];
+  int side = is_var (test->ops[1], l->var->loc->offset);
+  struct ast *end = test->ops[!side];
+  if (!l->known || end->type != integer_type || end->boolean_not)
+    return 0;
+  int op = test_op (test), n;
+  long long v = l->start;
+  for (n = 1; n <= PEEL_MAX; n++)
+    {
+      v += l->inc;
+      if (!(side ? compare (op, end->op.integer.i, v)
+	    : compare (op, v, end->op.integer.i)))
+	return n;
+    }
+  return 0;
+}
+
+/**
+ * Replace the statements @c from to @c to with @c with.
+ *
+ */
+static void
+replace_stmts (size_t from, size_t to, struct ast *with)
+{
+  struct ast *first = STMT (from), *last = STMT (to);
+  *links[from] = ast_cat (with, last->next);
+  last->next = NULL;
+  AST_FREE (first);
+}
+
+/**
+ * Unroll the loop @c l, or unroll it completely if it is small enough.
+ *
+ * @return true if the loop changed, false otherwise.
+ */
+static int
+unroll_loop (const struct counted_loop *l)
+{
+  size_t i, size = 0;
+  for (i = l->head + 1; i < l->back; i++)
+    if (i != l->step)
+      size += size_of (STMT (i));
+  if (size == 0)
+    size = 1;
+
+  int trips = trip_count (l);
+  if (trips > 0 && trips * size <= PEEL_BUDGET)
+    {
+      struct ast *out = NULL;
+      int k;
+      for (k = 0; k < trips; k++)
+	out = ast_cat (out, copy_body (l, k, 1));
+      out = ast_cat (out, set_counter (l, l->start + trips * l->inc, 1));
+      replace_stmts (l->head, l->back, out);
+      return 1;
+    }
+
+  int factor = UNROLL_MAX;
+  while (factor > 1 && factor * size > UNROLL_BUDGET)
+    factor /= 2;
+  if (factor < 2 || (trips > 0 && trips < factor))
+    return 0;
+
+  struct ast *orig = STMT (l->back)->ops[0];
+  int off = l->var->loc->offset;
+  struct ast *enough = ast_dup (orig);
+  offset_reads (&enough, off, (factor - 1) * l->inc, 0);
+  char *head = my_printf (".LU%d", labelno++);
+  char *done = my_printf (".LU%d", labelno++);
+
+  struct ast *t = ast_dup (enough);
+  t->boolean_not ^= 1;
+  struct ast *out
+    = make_target (make_cond (xstrdup (ast_label_name (STMT (l->head))), t));
+  out = ast_cat (out, make_target (make_label (xstrdup (head))));
+  int k;
+  for (k = 0; k < factor; k++)
+    out = ast_cat (out, copy_body (l, k, 0));
+  out = ast_cat (out, set_counter (l, factor * l->inc, 0));
+  out = ast_cat (out, make_target (make_cond (head, enough)));
+  t = ast_dup (orig);
+  t->boolean_not ^= 1;
+  out = ast_cat (out, make_target (make_cond (xstrdup (done), t)));
+
+  struct ast *back = STMT (l->back);
+  back->next = ast_cat (make_target (make_label (done)), back->next);
+  *links[l->head] = ast_cat (out, *links[l->head]);
+  return 1;
+}
+
+/**
+ * Unroll the loops of the function @c s.
+ *
+ */
+static void
+unroll_function (struct ast *s)
+{
+  struct ast *body = s->ops[1];
+  char **seen = NULL;
+  size_t nseen = 0, aseen = 0, i, j;
+  int changed, unrolled = 0;
+  do
+    {
+      changed = 0;
+      collect_links (body);
+      for (i = 0; i < nlinks && !changed; i++)
+	{
+	  struct ast *t = STMT (i);
+	  if (t->type != cond_type)
+	    continue;
+	  const char *name = ast_label_name (t);
+	  size_t head = find_label (name, 0, i);
+	  if (head == i || strncmp (name, ".LU", 3) == 0)
+	    continue;
+	  for (j = 0; j < nseen; j++)
+	    if (STREQ (seen[j], name))
+	      break;
+	  if (j < nseen)
+	    continue;
+
+	  /* Each loop is only looked at once, so the loop that is left
+	     for the remaining iterations isn't unrolled again, and
+	     neither are the loops with the labels made here. */
+	  if (nseen == aseen)
+	    seen = x2nrealloc (seen, &aseen, sizeof *seen);
+	  seen[nseen++] = xstrdup (name);
+	  struct counted_loop l;
+	  if (analyze_loop (body->ops[0], head, i, &l) && unroll_loop (&l))
+	    changed = unrolled = 1;
+	}
+    }
+  while (changed);
+
+  /* The copies are full of constants that can be folded now. */
+  if (unrolled)
+    optimizer (&body->ops[0]);
+  for (j = 0; j < nseen; j++)
+    FREE (seen[j]);
+  FREE (seen);
+  free_links ();
+}
+
+int
+unroll (struct ast *s)
+{
+  if (optimize < 1 || !unroll_loops)
+    return 0;
+  for (; s != NULL; s = s->next)
+    if (s->type == function_type)
+      unroll_function (s);
+  return 0;
+}
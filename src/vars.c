@@ -35,6 +35,15 @@ char stop = 0;
 
 int optimize = 0;
 int debug = 0;
+int dump_ir = 0;
+int peephole_stats = 0;
+int optimizer_stats = 0;
+int unroll_loops = 0;
+int inline_limit = 40;
+int target_popcnt = 0;
+int target_lzcnt = 0;
+int target_bmi = 0;
+int target_avx2 = 0;
 
 gl_list_t infile_name = NULL;
 const char *outfile_name = NULL;
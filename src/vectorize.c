@@ -0,0 +1,461 @@
+/**
+ * @file   vectorize.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief  Vectorization of simple counted loops.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * An innermost loop whose body is a single statement that either
+ * combines the elements of arrays at the counter, or folds the
+ * elements of an array into a variable, does the same thing to every
+ * element.  Vectors of W elements, two with SSE2 and four with AVX2,
+ * can be done at once:
+ *
+ *     if (!(i < n)) goto X;
+ *   L:
+ *     c[i] = a[i] + b[i];
+ *     i = i + 1;
+ *     if (i < n) goto L;
+ *   X:
+ *
+ * becomes
+ *
+ *     if (!(i < n)) goto X;
+ *     if (!(c - a > 0)) goto A;     (only when c and a may overlap)
+ *     if (c - a < W * 8) goto R;
+ *   A:
+ *     __builtin_vector_map ('+', &c[i], &a[i], &b[i], (n - i) & -W);
+ *     i = i + ((n - i) & -W);
+ *   R:
+ *     if (!(i < n)) goto X;
+ *   L:
+ *     c[i] = a[i] + b[i];
+ *     i = i + 1;
+ *     if (i < n) goto L;
+ *   X:
+ *
+ * The code generator expands the builtin into a loop over vectors,
+ * and the original loop is left to do the elements that don't fill a
+ * vector.  A reduction like s = s + a[i] keeps W partial results in a
+ * vector and combines them with s at the end, which gives the same
+ * value since the operators that are reduced are associative on
+ * integers.
+ *
+ * A vector iteration reads all of its elements before storing any of
+ * them, so it only differs from the original loop when the
+ * destination starts less than a vector after a source.  Unless both
+ * are arrays declared in the function, which can't overlap, that is
+ * tested before the vector loop and the original loop does all of
+ * the work if it is true.  The elements are moved with unaligned
+ * loads and stores, so the loop doesn't need a scalar prologue to
+ * align them.
+ *
+ * There are no 64-bit multiplies in SSE2 or AVX2, and no 64-bit
+ * compares in SSE2, so products are never vectorized and minimums and
+ * maximums only are with -mavx2.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "compiler.h"
+#include "free.h"
+#include "lib.h"
+#include "loc.h"
+#include "loop.h"
+#include "my_printf.h"
+#include "parse.h"
+#include "xalloc.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int labelno = 0;		/**< The number of the next label. */
+
+/**
+ * A loop that can be vectorized.
+ *
+ */
+struct vector_loop
+{
+  size_t head;			/**< The statement of the label. */
+  struct ast *i;		/**< The counter. */
+  struct ast *end;		/**< The bound of the counter. */
+  int inclusive;		/**< Whether the loop runs for the end
+				   as well. */
+  long long start;		/**< The constant that the counter
+				   starts at, if the count is known. */
+  long long count;		/**< The number of iterations, or 0 if
+				   it isn't a constant. */
+  int op;			/**< The operator of the body. */
+  struct ast *dst;		/**< The array that is stored to, or
+				   NULL for a reduction. */
+  struct ast *src[2];		/**< The arrays that are read.  The
+				   second is NULL for a reduction or
+				   a scalar operand. */
+  struct ast *scalar;		/**< The variable that is reduced
+				   into, or the operand that is the
+				   same for every element. */
+};
+
+/**
+ * Test if the vectors of the target can apply the operator @c op to
+ * every element.
+ *
+ */
+static int
+vector_op (int op)
+{
+  switch (op)
+    {
+    case '+':
+    case '-':
+    case '&':
+    case '|':
+    case '^':
+    case LS:
+    case RS:
+      return 1;
+    case MIN:
+    case MAX:
+      return target_avx2;
+    default:
+      return 0;
+    }
+}
+
+/**
+ * Test if the operator @c op gives the same value with its operands
+ * swapped.
+ *
+ */
+static int
+commutes (int op)
+{
+  return op == '+' || op == '&' || op == '|' || op == '^' || op == MIN
+    || op == MAX;
+}
+
+/**
+ * Get the operator that the expression @c v applies to its operands,
+ * storing them in @c x and @c y.  A ternary that selects the smaller
+ * or the larger of the two values that it compares is a minimum or a
+ * maximum.
+ *
+ * @return The operator, or 0 if @c v is something else.
+ */
+static int
+operator_of (struct ast *v, struct ast **x, struct ast **y)
+{
+  if (v->boolean_not)
+    return 0;
+  if (v->type == binary_type)
+    {
+      *x = v->ops[0];
+      *y = v->ops[1];
+      return v->op.binary.op;
+    }
+  if (v->type != ternary_type)
+    return 0;
+  const struct ast *c = v->ops[0];
+  int less;
+  if (c->type != binary_type || c->boolean_not)
+    return 0;
+  switch (c->op.binary.op)
+    {
+    case '<': case LE: less = 1; break;
+    case '>': case GE: less = 0; break;
+    default: return 0;
+    }
+  *x = v->ops[1];
+  *y = v->ops[2];
+  if (same_expr (c->ops[0], *x) && same_expr (c->ops[1], *y))
+    return less ? MIN : MAX;
+  if (same_expr (c->ops[0], *y) && same_expr (c->ops[1], *x))
+    return less ? MAX : MIN;
+  return 0;
+}
+
+/**
+ * Match the statement @c s of the loop @c l against the operations
+ * that can be vectorized, filling in the rest of @c l.
+ *
+ * @param body The first statement of the body of the function.
+ *
+ * @return true if it matched, false otherwise.
+ */
+static int
+match_body (const struct ast *s, const struct ast *body,
+	    struct vector_loop *l)
+{
+  if (s->type != binary_type || s->op.binary.op != '=' || !s->throw_away)
+    return 0;
+  struct ast *x, *y;
+  l->op = operator_of (s->ops[1], &x, &y);
+  if (!vector_op (l->op))
+    return 0;
+
+  if (is_local (s->ops[0]))
+    {
+      /* A reduction, s = s op a[i]. */
+      l->dst = NULL;
+      l->scalar = s->ops[0];
+      if (!commutes (l->op))
+	return 0;
+      if (same_local (y, l->scalar))
+	{
+	  struct ast *t = x;
+	  x = y;
+	  y = t;
+	}
+      l->src[0] = element (y, l->i);
+      l->src[1] = NULL;
+      return (same_local (x, l->scalar) && l->src[0] != NULL
+	      && !same_local (l->scalar, l->i)
+	      && !same_local (l->scalar, l->src[0])
+	      && !address_taken (body, l->scalar)
+	      && !address_taken (body, l->src[0]));
+    }
+
+  /* An element by element operation, c[i] = a[i] op b[i] or
+     c[i] = a[i] op k. */
+  if ((l->dst = element (s->ops[0], l->i)) == NULL)
+    return 0;
+  if (element (x, l->i) == NULL && commutes (l->op))
+    {
+      struct ast *t = x;
+      x = y;
+      y = t;
+    }
+  l->src[0] = element (x, l->i);
+  l->src[1] = element (y, l->i);
+  l->scalar = l->src[1] == NULL ? y : NULL;
+  if (l->src[0] == NULL
+      || (l->scalar != NULL && !invariant (l->scalar, l->i, body))
+      || ((l->op == LS || l->op == RS)
+	  && (l->scalar == NULL || l->scalar->type != integer_type
+	      || l->scalar->boolean_not || l->scalar->op.integer.i < 0
+	      || l->scalar->op.integer.i > 63)))
+    return 0;
+  int k;
+  for (k = 0; k < 3; k++)
+    {
+      const struct ast *a = k == 0 ? l->dst : l->src[k - 1];
+      if (a != NULL && (same_local (a, l->i) || address_taken (body, a)))
+	return 0;
+    }
+  return 1;
+}
+
+/**
+ * Find the loop that starts at statement @c head if it can be
+ * vectorized.
+ *
+ * @param body The first statement of the body of the function.
+ *
+ * @return true if it was found, false otherwise.
+ */
+static int
+find_loop (struct ast *body, size_t head, struct vector_loop *l)
+{
+  if (head + 3 >= nlinks)
+    return 0;
+  struct ast *label = STMT (head), *stmt = STMT (head + 1);
+  struct ast *step = STMT (head + 2), *back = STMT (head + 3);
+  if (label->type != label_type || back->type != cond_type
+      || STRNEQ (ast_label_name (label), ast_label_name (back))
+      || count_refs (ast_label_name (label), 0, nlinks) != 1)
+    return 0;
+
+  l->head = head;
+  if ((l->i = counter_of (step)) == NULL
+      || (l->end = loop_end (back->ops[0], l->i, body, &l->inclusive)) == NULL
+      || address_taken (body, l->i) || !match_body (stmt, body, l))
+    return 0;
+
+  /* The vector loop is only entered with the number of elements left,
+     so that must not be negative. */
+  int width = target_avx2 ? 4 : 2;
+  int known = start_value (head, l->i, &l->start);
+  l->count = 0;
+  if (known && l->end->type == integer_type && !l->end->boolean_not)
+    {
+      l->count = l->end->op.integer.i - l->start + l->inclusive;
+      return l->start <= l->end->op.integer.i && l->count >= width;
+    }
+  return is_guarded (head, head + 3, l->i, known, l->start);
+}
+
+/**
+ * Make the branch to @c name when the array @c dst starts less than
+ * a vector after the array @c src.
+ *
+ */
+static struct ast *
+overlap_check (const struct ast *dst, const struct ast *src,
+	       const char *name, int width)
+{
+  char *skip = my_printf (".LV%d", labelno++);
+  struct ast *t = make_binary ('>', make_binary ('-', ast_dup (dst),
+						 ast_dup (src)),
+			       make_integer (0));
+  t->boolean_not = 1;
+  struct ast *out = make_target (make_cond (xstrdup (skip), t));
+  t = make_binary ('<', make_binary ('-', ast_dup (dst), ast_dup (src)),
+		   make_integer (width * 8));
+  out = ast_cat (out, make_target (make_cond (xstrdup (name), t)));
+  return ast_cat (out, make_target (make_label (skip)));
+}
+
+/**
+ * Put the vector loop in front of the loop @c l.
+ *
+ * @param body The first statement of the body of the function.
+ *
+ * @return true if the original loop is still needed, false if it was
+ * deleted.
+ */
+static int
+vectorize_loop (struct ast *body, const struct vector_loop *l)
+{
+  int width = target_avx2 ? 4 : 2;
+  struct ast *back = STMT (l->head + 3);
+  char *rest = my_printf (".LV%d", labelno++);
+
+  /* The sources that might overlap the destination are checked at
+     run time. */
+  struct ast *out = NULL;
+  int k;
+  for (k = 0; k < 2 && l->dst != NULL; k++)
+    if (l->src[k] != NULL && !same_local (l->src[k], l->dst)
+	&& !(k == 1 && same_local (l->src[1], l->src[0]))
+	&& !(is_array (body, l->dst) && is_array (body, l->src[k])))
+      out = ast_cat (out, overlap_check (l->dst, l->src[k], rest, width));
+  int checked = out != NULL;
+
+  /* The number of elements that the vectors do is the number left
+     rounded down to a multiple of the width. */
+  struct ast *n;
+  if (l->count > 0)
+    n = make_integer (l->count & -width);
+  else
+    {
+      n = make_binary ('-', ast_dup (l->end), ast_dup (l->i));
+      if (l->inclusive)
+	n = make_binary ('+', n, make_integer (1));
+      n = make_binary ('&', n, make_integer (-width));
+    }
+
+  struct ast *op = make_integer (l->op), *call;
+  if (l->dst == NULL)
+    {
+      struct ast *args
+	= ast_cat (op, ast_cat (address_of (l->src[0], ast_dup (l->i)),
+				ast_cat (ast_dup (n), ast_dup (l->scalar))));
+      call = make_assign (ast_dup (l->scalar),
+			  make_call (BUILTIN (vector_reduce), args));
+    }
+  else
+    {
+      struct ast *other = l->src[1] != NULL
+	? address_of (l->src[1], ast_dup (l->i)) : ast_dup (l->scalar);
+      call = make_call (l->src[1] != NULL ? BUILTIN (vector_map)
+			: BUILTIN (vector_map_scalar),
+			ast_cat (op,
+				 ast_cat (address_of (l->dst, ast_dup (l->i)),
+					  ast_cat (address_of (l->src[0],
+							       ast_dup (l->i)),
+						   ast_cat (other,
+							    ast_dup (n))))));
+      call->throw_away = 1;
+    }
+  out = ast_cat (out, call);
+  out = ast_cat (out, make_assign (ast_dup (l->i),
+				   make_binary ('+', ast_dup (l->i), n)));
+
+  if (l->count > 0 && (l->count & -width) == l->count && !checked)
+    {
+      /* The vectors do every element. */
+      struct ast *label = STMT (l->head);
+      *links[l->head] = ast_cat (out, back->next);
+      back->next = NULL;
+      AST_FREE (label);
+      FREE (rest);
+      return 0;
+    }
+
+  /* The original loop does what is left, if anything is. */
+  const char *done;
+  if (back->next != NULL && back->next->type == label_type)
+    done = ast_label_name (back->next);
+  else
+    {
+      char *t = my_printf (".LV%d", labelno++);
+      back->next = ast_cat (make_target (make_label (t)), back->next);
+      done = t;
+    }
+  if (checked)
+    out = ast_cat (out, make_target (make_label (rest)));
+  else
+    FREE (rest);
+  struct ast *t = ast_dup (back->ops[0]);
+  t->boolean_not ^= 1;
+  out = ast_cat (out, make_target (make_cond (xstrdup (done), t)));
+  *links[l->head] = ast_cat (out, *links[l->head]);
+  return 1;
+}
+
+int
+vectorize_loops (struct ast *s)
+{
+  if (optimize < 2)
+    return 0;
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type != function_type)
+	continue;
+      struct ast *body = s->ops[1];
+      assert (body != NULL && body->type == block_type);
+      size_t k;
+      collect_links (body);
+      for (k = 0; k < nlinks; k++)
+	{
+	  struct vector_loop l;
+	  if (!find_loop (body->ops[0], k, &l))
+	    continue;
+	  struct ast *label = STMT (k);
+	  int kept = vectorize_loop (body->ops[0], &l);
+	  collect_links (body);
+	  /* The original loop that is left to do the rest isn't
+	     vectorized again. */
+	  if (kept)
+	    {
+	      while (STMT (k) != label)
+		k++;
+	      k += 3;
+	    }
+	}
+    }
+  free_links ();
+  return 0;
+}
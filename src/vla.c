@@ -0,0 +1,156 @@
+/**
+ * @file   vla.c
+ * @author Kieran Colford <colfordk@gmail.com>
+ *
+ * @brief  Giving back the stack memory of variable length arrays.
+ *
+ * Copyright (C) 2014 Kieran Colford
+ *
+ * This file is part of Compiler.
+ *
+ * Compiler is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Compiler is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Compiler; see the file COPYING.  If not see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * An array whose size is only known at run time is allocated by
+ * moving %rsp when its declaration is reached.  If the declaration is
+ * in a loop, then that happens on every iteration, so the block
+ * containing it saves %rsp into a slot of the frame when it starts
+ * and restores it when it ends.  A goto or a break that leaves the
+ * block restores it as well, since a loop made of gotos would
+ * otherwise keep moving %rsp down.
+ *
+ * Arrays whose size is a constant are given a place in the frame by
+ * the code generator instead.
+ *
+ * @note This pass must run after collect_vars, since it allocates
+ * its slots with make_temporary, and before the blocks are flattened.
+ *
+ */
+
+#include "config.h"
+
+#include "ast.h"
+#include "ast_util.h"
+#include "compiler.h"
+#include "lib.h"
+#include "loc.h"
+
+#include <assert.h>
+
+/**
+ * Test if the statements @c s allocate memory of a size that isn't
+ * known, not counting the blocks inside of them.
+ *
+ */
+static int
+allocates (const struct ast *s)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == alloc_type && s->ops[0] != NULL
+	  && s->ops[0]->type != integer_type)
+	return 1;
+      int i;
+      if (s->type != block_type)
+	for (i = 0; i < s->num_ops; i++)
+	  if (allocates (s->ops[i]))
+	    return 1;
+    }
+  return 0;
+}
+
+/**
+ * Test if the label @c name is in @c s or the ASTs that follow it.
+ *
+ */
+static int
+defines (const struct ast *s, const char *name)
+{
+  for (; s != NULL; s = s->next)
+    {
+      if (s->type == label_type && STREQ (s->op.label.name, name))
+	return 1;
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	if (defines (s->ops[i], name))
+	  return 1;
+    }
+  return 0;
+}
+
+/**
+ * Restore the stack pointer from the location @c slot before every
+ * jump in @c ss that goes to a label outside of the statements
+ * @c block.  The parser only makes conds that branch within the
+ * statements around them, so they never leave a block.
+ *
+ * @param ss Reference to an AST pointer.
+ */
+static void
+restore_on_exit (struct ast **ss, const struct ast *block,
+		 const struct loc *slot)
+{
+  for (; *ss != NULL; ss = &(*ss)->next)
+    {
+      struct ast *s = *ss;
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	restore_on_exit (&s->ops[i], block, slot);
+      if (s->type == jump_type && !defines (block, s->op.jump.name))
+	{
+	  struct ast *restore = make_stack (1);
+	  restore->loc = loc_dup (slot);
+	  restore->next = s;
+	  *ss = restore;
+	  ss = &restore->next;
+	}
+    }
+}
+
+/**
+ * Recursive version of @c restore_stack.
+ *
+ * @param s The AST to operate on.
+ * @param function The function that @c s is in.
+ */
+static void
+restore_stack_r (struct ast *s, struct ast *function)
+{
+  for (; s != NULL; s = s->next)
+    {
+      int i;
+      for (i = 0; i < s->num_ops; i++)
+	restore_stack_r (s->ops[i], function);
+      if (s->type != block_type || s == function->ops[1]
+	  || !allocates (s->ops[0]))
+	continue;
+
+      struct ast *slot = make_temporary (function);
+      struct ast *save = make_stack (0), *restore = make_stack (1);
+      save->loc = loc_dup (slot->loc);
+      restore->loc = loc_dup (slot->loc);
+      AST_FREE (slot);
+      restore_on_exit (&s->ops[0], s->ops[0], restore->loc);
+      s->ops[0] = ast_cat (save, ast_cat (s->ops[0], restore));
+    }
+}
+
+int
+restore_stack (struct ast *s)
+{
+  for (; s != NULL; s = s->next)
+    if (s->type == function_type)
+      restore_stack_r (s->ops[1], s);
+  return 0;
+}
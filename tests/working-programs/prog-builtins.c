@@ -0,0 +1,37 @@
+#ifdef GCC
+#define int long
+#endif
+
+int
+hash (int x)
+{
+  x = __builtin_bswap64 (x * 31);
+  return x ^ __builtin_popcountll (x);
+}
+
+int
+main ()
+{
+  int i;
+  int a[16];
+  int x;
+  for (i = 0; i < 16; i++)
+    a[i] = i * i;
+  for (i = 1; i < 40; i++)
+    {
+      x = i * 37 + 5;
+      __builtin_prefetch (&a[i % 16]);
+      printf ("%ld\n", __builtin_popcountll (x));
+      printf ("%ld\n", __builtin_ctzll (x * 8));
+      printf ("%ld\n", __builtin_clzll (x));
+      printf ("%ld\n", __builtin_bswap64 (x) >> 48);
+      if (__builtin_expect (x % 3 == 0, 0))
+	printf ("%ld\n", hash (x) & 65535);
+      if (!__builtin_popcountll (i & 8))
+	printf ("%ld\n", i);
+    }
+  printf ("%ld\n", __builtin_popcountll (255));
+  printf ("%ld\n", __builtin_clzll (1));
+  printf ("%ld\n", __builtin_ctzll (1024));
+  return 0;
+}
@@ -0,0 +1,37 @@
+#ifdef GCC
+#define int long
+#endif
+
+int
+four (int a, int b, int c, int d)
+{
+  return a * 1000 + b * 100 + c * 10 + d;
+}
+
+int
+six (int a, int b, int c, int d, int e, int f)
+{
+  return ((((a * 2 + b) * 2 + c) * 2 + d) * 2 + e) * 2 + f;
+}
+
+int
+main ()
+{
+  int x;
+  int y;
+  int z;
+  int w;
+  x = 3;
+  y = 5;
+  z = 7;
+  w = 9;
+  printf ("%ld %ld\n", x, y);
+  printf ("%ld %ld %ld\n", x, y, z);
+  printf ("%ld %ld %ld %ld\n", x, y, z, w);
+  printf ("%ld %ld %ld %ld %ld\n", w, z, y, x, x + y);
+  x = four (1, 2, 3, 4);
+  printf ("%ld\n", x);
+  x = six (1, 0, 1, 1, 0, 1);
+  printf ("%ld\n", x);
+  return 0;
+}
@@ -0,0 +1,25 @@
+int main ()
+{
+  int n = 10;
+  int debug = 0;
+  int sum = 0;
+  int i;
+  for (i = 0; i < n; i++)
+    {
+      if (debug)
+	printf ("%d\n", i);
+      sum += i * n;
+    }
+  int k = 3;
+  if (k == 3)
+    k = k + 4;
+  else
+    k = 0;
+  int a[8];
+  a[k] = sum;
+  int last = a[7];
+  printf ("%d\n", sum);
+  printf ("%d\n", k);
+  printf ("%d\n", last);
+  return 0;
+}
@@ -0,0 +1,66 @@
+#ifdef GCC
+#define int long
+#endif
+
+int
+fill (int n, int v)
+{
+  int a[n + 2];
+  int b[n + 2];
+  int i;
+  int t;
+  for (i = 0; i < n + 2; i++)
+    a[i] = v;
+  for (i = 1; i <= n; i++)
+    a[i] = 0;
+  for (i = 0; i < n + 2; i++)
+    b[i] = a[i];
+  t = 0;
+  for (i = 0; i < n + 2; i++)
+    t = t + b[i] * (i + 1);
+  return t + i;
+}
+
+int
+main ()
+{
+  int a[64];
+  int b[64];
+  int c[64];
+  int i;
+  int j;
+  int n;
+  int t;
+  for (i = 0; i < 64; i++)
+    a[i] = i * 3 + 1;
+  for (i = 0; i < 64; i++)
+    b[i] = -1;
+  for (i = 0; i < 64; i++)
+    c[i] = 5;
+  for (i = 10; i < 20; i++)
+    b[i] = a[i];
+  printf ("%ld %ld %ld %ld\n", b[9], b[10], b[19], b[20]);
+  printf ("%ld %ld\n", c[0], i);
+  n = 30;
+  j = 5;
+  while (j < n)
+    {
+      a[j] = 0;
+      j++;
+    }
+  printf ("%ld %ld %ld %ld\n", a[4], a[5], a[29], a[30]);
+  printf ("%ld\n", j);
+  for (i = 40; i < n; i++)
+    a[i] = 0;
+  printf ("%ld %ld\n", a[40], i);
+  for (i = 0; i < 64; i++)
+    c[i] = b[i];
+  t = 0;
+  for (i = 0; i < 64; i++)
+    t = t + c[i] * (i + 1) + a[i];
+  printf ("%ld\n", t);
+  printf ("%ld\n", fill (10, 7));
+  printf ("%ld\n", fill (0, 7));
+  printf ("%ld\n", fill (5, 0));
+  return 0;
+}
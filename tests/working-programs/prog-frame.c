@@ -0,0 +1,84 @@
+#ifdef GCC
+#define ptr_t int *
+#endif
+
+int
+small (int a, int b)
+{
+  int c;
+  c = a * b;
+  return c - a;
+}
+
+int
+large (int a, int b)
+{
+  int c0 = a + 1;
+  int c1 = a + 2;
+  int c2 = a + 3;
+  int c3 = a + 4;
+  int c4 = a + 5;
+  int c5 = b + 1;
+  int c6 = b + 2;
+  int c7 = b + 3;
+  int c8 = b + 4;
+  int c9 = b + 5;
+  int d0 = c0 * c5;
+  int d1 = c1 * c6;
+  int d2 = c2 * c7;
+  int d3 = c3 * c8;
+  int d4 = c4 * c9;
+  int e0 = d0 - d1;
+  int e1 = d2 - d3;
+  int e2 = d4 - d0;
+  return e0 + e1 + e2 + c0 + c9;
+}
+
+int
+address (int n)
+{
+  int x;
+  int s;
+  ptr_t p = &x;
+  *p = n;
+  s = small (n, 2);
+  return *p * 2 + s;
+}
+
+int
+calls (int n)
+{
+  int s;
+  s = small (n, 3);
+  printf ("%d\n", s);
+  s = large (n, 7);
+  printf ("%d\n", s);
+  return s;
+}
+
+int
+array (int n)
+{
+  int a[5];
+  int i;
+  for (i = 0; i < 5; i++)
+    a[i] = n * i;
+  return a[4] - a[1];
+}
+
+int
+main ()
+{
+  int i;
+  int a;
+  int b;
+  for (i = 0; i < 3; i++)
+    {
+      calls (i);
+      a = address (i);
+      printf ("%d\n", a);
+      b = array (i);
+      printf ("%d\n", b);
+    }
+  return 0;
+}
@@ -0,0 +1,37 @@
+int
+main ()
+{
+  int a[8];
+  int i;
+  for (i = 0; i < 8; i++)
+    a[i] = i * i + 3;
+  int x = 5;
+  int s = a[x] + a[x] * 2;
+  printf ("%d\n", s);
+  s = x * 7 + a[x];
+  a[5] = 9;
+  s = s + x * 7 + a[x];
+  printf ("%d\n", s);
+  int k = 2;
+  int t = a[k] / 3;
+  if (t > 2)
+    {
+      a[2] = 100;
+      t = t + a[k] / 3;
+    }
+  else
+    t = t - a[k] / 3;
+  printf ("%d\n", t);
+  t = a[k + 1] * a[k + 1];
+  if (k < 5)
+    t = t + a[k + 1] * a[k + 1];
+  printf ("%d\n", t);
+  for (i = 0; i < 3; i++)
+    {
+      t = t + a[i] * a[i];
+      a[i] = a[i] * a[i] - a[i + 1] % 5;
+    }
+  printf ("%d\n", t);
+  printf ("%d\n", a[0] + a[1] + a[2]);
+  return 0;
+}
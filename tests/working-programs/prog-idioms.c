@@ -0,0 +1,71 @@
+#ifdef GCC
+#define int long
+#endif
+
+int
+bits (int x)
+{
+  int c = 0;
+  while (x)
+    {
+      x &= x - 1;
+      c++;
+    }
+  return c;
+}
+
+int
+rotl (int x, int n)
+{
+  return (x << n) | (x >> (64 - n));
+}
+
+int
+rotm (int x, int n)
+{
+  return ((x & 0x7fffffff) << n) | ((x & 0x7fffffff) >> (64 - n));
+}
+
+int
+main ()
+{
+  int i;
+  int a;
+  int b;
+  int x;
+  for (i = -6; i < 7; i++)
+    {
+      a = i * 7;
+      b = 10 - i * i;
+      x = a < b ? a : b;
+      printf ("%ld\n", x);
+      x = a > b ? a : b;
+      printf ("%ld\n", x);
+      x = a < 0 ? -a : a;
+      printf ("%ld\n", x);
+      x = b >= 0 ? b : -b;
+      printf ("%ld\n", x);
+      if (a < b)
+	x = b;
+      else
+	x = a;
+      printf ("%ld\n", x);
+      x = a & (a - 1);
+      printf ("%ld\n", x);
+      x = b & -b;
+      printf ("%ld\n", x);
+      x = bits (a);
+      printf ("%ld\n", x);
+      x = (b * b << 13) | (b * b >> 51);
+      printf ("%ld\n", x);
+      x = rotl (i * i, 5);
+      printf ("%ld\n", x);
+      x = ((a & 0x7fffffff) << 13) | ((a & 0x7fffffff) >> 51);
+      printf ("%ld\n", x);
+      x = ((b & 0x7fffffff) >> 7) + ((b & 0x7fffffff) << 57);
+      printf ("%ld\n", x);
+      x = rotm (i * i * i, 30);
+      printf ("%ld\n", x);
+    }
+  return 0;
+}
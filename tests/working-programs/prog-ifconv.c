@@ -0,0 +1,56 @@
+int
+min (int a, int b)
+{
+  if (a < b)
+    return a;
+  return b;
+}
+
+int
+clamp (int x, int lo, int hi)
+{
+  if (x < lo)
+    x = lo;
+  if (x > hi)
+    x = hi;
+  return x;
+}
+
+int
+sign (int x)
+{
+  int s;
+  if (x < 0)
+    s = -1;
+  else
+    {
+      if (x > 0)
+	s = 1;
+      else
+	s = 0;
+    }
+  return s;
+}
+
+int
+main ()
+{
+  int i;
+  int m = 0;
+  int d;
+  for (i = -5; i < 6; i++)
+    {
+      printf ("%d\n", min (i, 2));
+      printf ("%d\n", clamp (i * 3, -4, 7));
+      printf ("%d\n", sign (i));
+      if (i * i > m)
+	m = i * i;
+      if (i & 1)
+	d = i + 100;
+      else
+	d = i - 100;
+      printf ("%d\n", d);
+    }
+  printf ("%d\n", m);
+  return 0;
+}
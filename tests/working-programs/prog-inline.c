@@ -0,0 +1,79 @@
+#ifdef GCC
+#define inline static inline
+#endif
+
+int
+sq (int x)
+{
+  return x * x;
+}
+
+inline int
+clamp (int v, int lo, int hi)
+{
+  if (v < lo)
+    return lo;
+  if (v > hi)
+    return hi;
+  return v;
+}
+
+inline int
+sum_to (int n)
+{
+  int i;
+  int s = 0;
+  for (i = 1; i <= n; i++)
+    s = s + sq (i);
+  return s;
+}
+
+int
+fact (int n)
+{
+  if (n < 2)
+    return 1;
+  return n * fact (n - 1);
+}
+
+int
+pair (int a, int b)
+{
+  return a * 10 + b;
+}
+
+inline int
+say (int x)
+{
+  printf ("%d\n", x);
+  return x + 1;
+}
+
+int
+main ()
+{
+  int i;
+  int a = 3;
+  int b = 4;
+  int s = 0;
+  int t;
+  for (i = 0; i < 10; i++)
+    {
+      t = clamp (i * 7 - 20, 0, 30);
+      s = s + sq (i) + t;
+    }
+  printf ("%d\n", s);
+  printf ("%d\n", pair (b, a));
+  t = pair (a, b);
+  printf ("%d\n", t + sq (a));
+  printf ("%d\n", fact (sq (2)));
+  printf ("%d\n", sum_to (sq (3)));
+  t = clamp (sq (a), 0, 5);
+  if (t == 5)
+    printf ("%d\n", 1);
+  while (sq (a) < 200)
+    a = a + 5;
+  printf ("%d\n", a);
+  say (say (say (7)));
+  return 0;
+}
@@ -0,0 +1,52 @@
+int
+main ()
+{
+  int a[50];
+  int b[50];
+  int i;
+  int j;
+  int n = 50;
+  int s = 0;
+  for (i = 0; i < n; i++)
+    a[i] = i * i - 7;
+  for (i = 0; i <= 49; i++)
+    b[i] = a[i] + 1;
+  for (i = 49; i >= 0; i--)
+    s = s + b[i];
+  printf ("%d\n", s);
+  for (i = 0; 40 > i; i = i + 3)
+    s = s + a[i + 2] - a[i];
+  printf ("%d\n", s);
+  j = 0;
+  for (i = 0; i < n; i++)
+    if (a[i] > 100)
+      j = j + 1;
+  printf ("%d\n", i + j);
+  i = 0;
+  do
+    {
+      s = s + a[i];
+      i++;
+    }
+  while (i < 10);
+  printf ("%d\n", s);
+  for (i = 0; i < 5; i++)
+    for (j = 0; j < 5; j++)
+      s = s + a[i] * b[j + 10];
+  printf ("%d\n", s);
+  for (i = 1; i < n; i++)
+    a[i] = a[i - 1] + a[i];
+  printf ("%d\n", a[n - 1]);
+  i = 0;
+  while (i != 48)
+    {
+      b[i + 1] = i;
+      i = i + 2;
+    }
+  printf ("%d\n", b[47]);
+  s = 0;
+  for (i = 0; i < 0; i++)
+    s = s + 1;
+  printf ("%d\n", s);
+  return 0;
+}
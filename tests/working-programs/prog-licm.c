@@ -0,0 +1,78 @@
+int
+sq (int x)
+{
+  return x * x;
+}
+
+int
+copies (int e, int u, int k)
+{
+  int p[4];
+  int a = 1;
+  int b = 0;
+  int i;
+  int j;
+  int t;
+  for (i = 0; i < 4; i++)
+    {
+      a = e;
+      p[i] = ~a;
+    }
+  printf ("%d %d\n", p[0], p[3]);
+  for (i = 0; i < 4; i++)
+    {
+      a = k;
+      p[i] = a * u;
+      a = 2;
+    }
+  printf ("%d %d\n", p[1], p[3]);
+  for (i = 0; i < 3; i++)
+    for (j = 0; j < 3; j++)
+      {
+        t = j ? u : 7;
+        b = b + t * j;
+      }
+  return b;
+}
+
+int
+main ()
+{
+  int a[10];
+  int i;
+  int j;
+  int n = 10;
+  int x = 3;
+  int y = 4;
+  int s = 0;
+  for (i = 0; i < n; i++)
+    a[i] = i * 2;
+  for (i = 0; i < n; i++)
+    s = s + x * y + a[i] + n * 8;
+  printf ("%d\n", s);
+  for (i = 0; i < 4; i++)
+    for (j = 0; j < 4; j++)
+      s = s + a[x + 1] * a[y] - i * x + j;
+  printf ("%d\n", s);
+  i = 0;
+  while (i < 5)
+    {
+      if (i > 2)
+        s = s + 100 / (y - 4 + i);
+      i = i + 1;
+    }
+  printf ("%d\n", s);
+  for (i = 0; i < 3; i++)
+    {
+      s = s + a[x] * 3;
+      a[x] = a[x] + 1;
+    }
+  printf ("%d\n", s);
+  s = copies (5, 3, 7);
+  printf ("%d\n", s);
+  j = 0;
+  for (i = 0; i < 5; i = i + sq (2))
+    j = j + 1;
+  printf ("%d %d\n", i, j);
+  return 0;
+}
@@ -0,0 +1,39 @@
+int
+check (int v)
+{
+  printf ("check %d\n", v);
+  return v;
+}
+
+int
+main ()
+{
+  int a = 3;
+  int b = 0;
+  int x;
+  x = a && b;
+  printf ("%d\n", x);
+  x = a || b;
+  printf ("%d\n", x);
+  x = !(a && check (a));
+  printf ("%d\n", x);
+  x = b && check (1);
+  printf ("%d\n", x);
+  x = a || check (2);
+  printf ("%d\n", x);
+  if (a > 1 && b == 0)
+    printf ("yes\n");
+  if (a < 1 || b != 0)
+    printf ("no\n");
+  if (!(a < 1 || b != 0))
+    printf ("yes2\n");
+  if (!(a > 1 && b == 0))
+    printf ("no2\n");
+  for (x = 0; x < 10 && x * x < 20; x++)
+    printf ("%d\n", x);
+  x = (a && b) || (a && check (5));
+  printf ("%d\n", x);
+  x = a ? (b || check (6)) : 4;
+  printf ("%d\n", x);
+  return 0;
+}
@@ -0,0 +1,51 @@
+#ifdef GCC
+#define int long
+#endif
+
+int
+main ()
+{
+  int a[40];
+  int b[40];
+  int i;
+  int p;
+  int t;
+  for (i = 0; i < 40; i++)
+    {
+      a[i] = i * 1001;
+      b[i] = 0;
+    }
+  memcpy (&b[0], &a[0], 24);
+  printf ("%ld %ld %ld %ld\n", b[0], b[1], b[2], b[3]);
+  __builtin_memcpy (&b[4], &a[10], 13);
+  printf ("%ld %ld %ld\n", b[4], b[5], b[6]);
+  memset (&b[0], 0, 40);
+  printf ("%ld %ld %ld\n", b[4], b[5], b[6]);
+  memset (&b[0], 255, 3);
+  printf ("%ld\n", b[0]);
+  p = 7;
+  memset (&b[1], p, 20);
+  printf ("%ld %ld %ld\n", b[1], b[2], b[3]);
+  memmove (&a[1], &a[0], 72);
+  memmove (&a[20], &a[22], 40);
+  memcpy (&b[0], &a[0], 320);
+  t = 0;
+  for (i = 0; i < 40; i++)
+    t = t + b[i] * (i + 1);
+  printf ("%ld\n", t);
+  memset (&b[0], 9, 300);
+  printf ("%ld %ld\n", b[36], b[37]);
+  memmove (&a[3], &a[0], 296);
+  t = 0;
+  for (i = 0; i < 40; i++)
+    t = t + a[i] * (i + 1);
+  printf ("%ld\n", t);
+  i = 40;
+  memcpy (&b[0], &a[0], i);
+  printf ("%ld %ld\n", b[4], b[5]);
+  memcpy (&b[0], &a[3], 3);
+  printf ("%ld\n", b[0]);
+  p = memset (&b[0], 1, 1);
+  printf ("%ld\n", p == &b[0]);
+  return 0;
+}
@@ -0,0 +1,40 @@
+int main ()
+{
+  int vals[12];
+  vals[0] = 0; vals[1] = 1; vals[2] = -1; vals[3] = 7; vals[4] = -7;
+  vals[5] = 100; vals[6] = -100; vals[7] = 12345; vals[8] = -12345;
+  vals[9] = 1000000; vals[10] = -999999; vals[11] = 65537;
+  int i;
+  for (i = 0; i < 12; i++)
+    {
+      int x = vals[i];
+      int r;
+      r = x / 2; printf ("%d\n", r);
+      r = x / 8; printf ("%d\n", r);
+      r = x / -4; printf ("%d\n", r);
+      r = x / 3; printf ("%d\n", r);
+      r = x / 7; printf ("%d\n", r);
+      r = x / -10; printf ("%d\n", r);
+      r = x / 1000; printf ("%d\n", r);
+      r = x / -1; printf ("%d\n", r);
+      r = x / 1; printf ("%d\n", r);
+      r = x % 2; printf ("%d\n", r);
+      r = x % 16; printf ("%d\n", r);
+      r = x % -16; printf ("%d\n", r);
+      r = x % 3; printf ("%d\n", r);
+      r = x % 10; printf ("%d\n", r);
+      r = x % -7; printf ("%d\n", r);
+      r = x % 1; printf ("%d\n", r);
+      r = x * 10; printf ("%d\n", r);
+      r = x * 8; printf ("%d\n", r);
+      r = x * 9; printf ("%d\n", r);
+      r = x * -3; printf ("%d\n", r);
+      r = x * 24; printf ("%d\n", r);
+      r = x * 1234; printf ("%d\n", r);
+      r = x * -1; printf ("%d\n", r);
+      r = x * 1; printf ("%d\n", r);
+      r = x / 641; printf ("%d\n", r);
+      r = x % 641; printf ("%d\n", r);
+    }
+  return 0;
+}
@@ -0,0 +1,72 @@
+/* peephole: store-load test-zero flags-reuse xor-zero dead-move */
+#ifdef GCC
+#define int long
+#endif
+
+int
+zero (int x)
+{
+  if (x == 0)
+    return 1;
+  if (x != 0)
+    x = x * 3;
+  return x;
+}
+
+int
+store (int x)
+{
+  int a;
+  a = x * 5;
+  return a + x;
+}
+
+int
+count (int n)
+{
+  int s;
+  s = 0;
+  while (n > 0)
+    {
+      s = s + n;
+      n = n - 1;
+    }
+  return s;
+}
+
+int
+pick (int x)
+{
+  int r;
+  switch (x)
+    {
+    default:
+      r = 9;
+      break;
+    case 1:
+      r = 4;
+      break;
+    case 2:
+      r = 6;
+      break;
+    }
+  return r;
+}
+
+int
+main ()
+{
+  int i;
+  int a;
+  int b;
+  for (i = -2; i < 3; i++)
+    {
+      a = zero (i);
+      b = store (i);
+      printf ("%ld %ld\n", a, b);
+      a = count (i);
+      b = pick (i + 2);
+      printf ("%ld %ld\n", a, b);
+    }
+  return 0;
+}
@@ -0,0 +1,82 @@
+int
+siblings (int n)
+{
+  int total = 0;
+  if (n > 2)
+    {
+      int a = n * 2;
+      int b = a + 1;
+      total = total + a + b;
+    }
+  else
+    {
+      int c = n * 3;
+      int d = c - 1;
+      total = total + c * d;
+    }
+  if (total >= 0)
+    {
+      int e = total + 5;
+      int f = e * 2;
+      total = f - n;
+    }
+  return total;
+}
+
+int
+loops (int n)
+{
+  int i;
+  int sum = 0;
+  for (i = 0; i < n; i++)
+    {
+      int sq = i * i;
+      sum = sum + sq;
+    }
+  for (i = 0; i < n; i++)
+    {
+      int cube = i * i * i;
+      int half = cube / 2;
+      sum = sum + half;
+    }
+  return sum;
+}
+
+int
+nested (int n)
+{
+  int r = 0;
+  if (n >= 0)
+    {
+      int x = n + 1;
+      if (x > 1)
+	{
+	  int y = x * 2;
+	  r = r + y;
+	}
+      while (x > 0)
+	{
+	  int z = x * 3;
+	  r = r + z;
+	  x = x - 2;
+	}
+    }
+  return r;
+}
+
+int
+main ()
+{
+  int i;
+  int v;
+  for (i = 0; i < 5; i++)
+    {
+      v = siblings (i);
+      printf ("%d\n", v);
+      v = loops (i);
+      printf ("%d\n", v);
+      v = nested (i);
+      printf ("%d\n", v);
+    }
+  return 0;
+}
@@ -0,0 +1,36 @@
+int
+sign (int v)
+{
+  return (v > 0) - (v < 0);
+}
+
+int
+main ()
+{
+  int a = 3;
+  int b = 5;
+  int x;
+  int y;
+  x = a < b;
+  y = !a;
+  printf ("%d\n", x);
+  printf ("%d\n", y);
+  x = (a == b) + (a != b) * 2 + (a >= 3) * 4 + (b <= 4) * 8;
+  printf ("%d\n", x);
+  y = !(a - 3);
+  printf ("%d\n", y);
+  x = !b ? 7 : 9;
+  printf ("%d\n", x);
+  x = sign (a - b);
+  printf ("%d\n", x);
+  x = sign (b - a);
+  printf ("%d\n", x);
+  y = sign (0);
+  printf ("%d\n", y);
+  for (x = 0; x < 4; x++)
+    {
+      y = (x > 1) ? 0 : 1;
+      printf ("%d\n", y);
+    }
+  return 0;
+}
@@ -0,0 +1,39 @@
+int
+main ()
+{
+  int x = 7;
+  int y = -3;
+  printf ("%d\n", x + 0);
+  printf ("%d\n", 0 + x);
+  printf ("%d\n", x - x);
+  printf ("%d\n", x * 1);
+  printf ("%d\n", 3 * x * 4);
+  printf ("%d\n", x + 2 + 5);
+  printf ("%d\n", x - 2 - 5);
+  printf ("%d\n", 0 - y);
+  printf ("%d\n", y * -1);
+  printf ("%d\n", y / -1);
+  printf ("%d\n", x / x);
+  printf ("%d\n", x % 1);
+  printf ("%d\n", x & -1);
+  printf ("%d\n", x & 0);
+  printf ("%d\n", x | 0);
+  printf ("%d\n", x | x);
+  printf ("%d\n", x ^ x);
+  printf ("%d\n", x ^ 0);
+  printf ("%d\n", 12 & 10);
+  printf ("%d\n", 12 | 3);
+  printf ("%d\n", 12 ^ 10);
+  printf ("%d\n", ~5);
+  printf ("%d\n", - -y);
+  printf ("%d\n", ~~y);
+  printf ("%d\n", x == x);
+  printf ("%d\n", x < x);
+  printf ("%d\n", (x << 0) + (x >> 0));
+  printf ("%d\n", -(-8 / 3));
+  if (x - x)
+    printf ("bad\n");
+  if (!(x ^ x))
+    printf ("ok\n");
+  return 0;
+}
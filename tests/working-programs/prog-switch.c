@@ -0,0 +1,145 @@
+int
+dense (int x)
+{
+  int r = 0;
+  switch (x)
+    {
+    case 0:
+      r = 10;
+      break;
+    case 1:
+      r = 11;
+      break;
+    case 2:
+      r = 12;
+    case 3:
+      r = r + 13;
+      break;
+    default:
+      r = -1;
+      break;
+    case 5:
+      r = 15;
+    }
+  return r;
+}
+
+int
+sparse (int x)
+{
+  switch (x)
+    {
+    case -100:
+      return 1;
+    case 7:
+      return 2;
+    case 1000:
+      return 3;
+    case 50000:
+      return 4;
+    case 123456:
+      return 5;
+    }
+  return 0;
+}
+
+int
+vowel (int c)
+{
+  switch (c)
+    {
+    case 97: case 101: case 105: case 111: case 117:
+      return 1;
+    case 121:
+      return 2;
+    }
+  return 0;
+}
+
+int
+nested (int x)
+{
+  int r = 0;
+  switch (x / 10)
+    {
+    case 0:
+      switch (x)
+	{
+	case 1:
+	  r = 100;
+	  break;
+	case 2:
+	  r = 200;
+	  break;
+	}
+      r = r + 1;
+      break;
+    case 1:
+      r = 2;
+      break;
+    }
+  return r;
+}
+
+int
+loops (int x)
+{
+  int i = 0;
+  int r = 0;
+  switch (x)
+    {
+    case 1:
+      while (1)
+	{
+	  i++;
+	  if (i == 3)
+	    break;
+	}
+      printf ("after loop %d\n", i);
+      break;
+    case 2:
+      for (i = 0; i < 10; i++)
+	{
+	  switch (i)
+	    {
+	    case 4:
+	      r = r + 100;
+	      break;
+	    }
+	  if (i == 6)
+	    break;
+	  r = r + i;
+	}
+      do
+	{
+	  r = r + 1000;
+	  break;
+	}
+      while (1);
+      break;
+    default:
+      printf ("default\n");
+    }
+  return r + i;
+}
+
+int
+main ()
+{
+  int i;
+  for (i = -2; i < 8; i++)
+    printf ("%d\n", dense (i));
+  printf ("%d\n", sparse (-100));
+  printf ("%d\n", sparse (1000));
+  printf ("%d\n", sparse (123456));
+  printf ("%d\n", sparse (8));
+  for (i = 97; i <= 122; i++)
+    printf ("%d\n", vowel (i));
+  for (i = 0; i < 20; i = i + 3)
+    printf ("%d\n", nested (i));
+  printf ("%d\n", nested (1));
+  printf ("%d\n", nested (2));
+  for (i = 1; i < 4; i++)
+    printf ("%d\n", loops (i));
+  return 0;
+}
@@ -0,0 +1,61 @@
+int
+gcd (int a, int b)
+{
+  if (b == 0)
+    return a;
+  return gcd (b, a % b);
+}
+
+int
+count (int n, int acc)
+{
+  if (n == 0)
+    return acc;
+  return count (n - 1, acc + n);
+}
+
+int
+rotate (int a, int b, int c, int n)
+{
+  if (n == 0)
+    return a * 100 + b * 10 + c;
+  return rotate (b, c, a, n - 1);
+}
+
+int
+even (int n)
+{
+  if (n == 0)
+    return 1;
+  return odd (n - 1);
+}
+
+int
+odd (int n)
+{
+  if (n == 0)
+    return 0;
+  return even (n - 1);
+}
+
+int
+digits (int n)
+{
+  int d;
+  if (n < 10)
+    return 1;
+  d = digits (n / 10);
+  return d + 1;
+}
+
+int
+main ()
+{
+  printf ("%d\n", gcd (1892, 648));
+  printf ("%d\n", count (50000, 0));
+  printf ("%d\n", rotate (1, 2, 3, 7));
+  printf ("%d\n", even (20000));
+  printf ("%d\n", odd (777));
+  printf ("%d\n", digits (9876543));
+  return 0;
+}
@@ -0,0 +1,57 @@
+int f (int n)
+{
+  if (n > 5)
+    return 1;
+  else
+    return 0;
+  printf ("unreachable\n");
+  return 2;
+}
+
+int g (int n)
+{
+  int s = 0;
+  if (n > 2)
+    goto a;
+  goto b;
+ a:
+  goto c;
+ c:
+  s = s + 10;
+ b:
+  goto d;
+ d:
+  while (n > 0)
+    {
+      s = s + n;
+      n = n - 1;
+    }
+  for (n = 0; n < 0; n++)
+    s = 99;
+  return s;
+}
+
+int main ()
+{
+  if (0)
+    printf ("zero\n");
+  if (1)
+    printf ("one\n");
+  int x = f (7);
+  printf ("%d\n", x);
+  x = f (3);
+  printf ("%d\n", x);
+  x = g (4);
+  printf ("%d\n", x);
+  x = g (0);
+  printf ("%d\n", x);
+  while (1)
+    {
+      if (x < 3)
+	goto done;
+      printf ("never\n");
+    }
+ done:
+  return 0;
+  printf ("dead\n");
+}
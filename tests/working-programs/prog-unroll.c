@@ -0,0 +1,48 @@
+int
+sum (int n)
+{
+  int a[40];
+  int i;
+  int s = 0;
+  for (i = 0; i < n; i++)
+    a[i] = i * 5 - 3;
+  for (i = 0; i < n; i++)
+    s = s + a[i];
+  return s;
+}
+
+int
+main ()
+{
+  int a[40];
+  int i;
+  int j;
+  int s;
+  for (j = 0; j < 20; j++)
+    printf ("%d\n", sum (j));
+  s = 0;
+  for (i = 0; i < 6; i++)
+    s = s + i * i;
+  printf ("%d\n", s);
+  for (i = 10; i > 0; i = i - 3)
+    s = s * 2 + i;
+  printf ("%d\n", s + i);
+  for (i = 0; i < 40; i++)
+    a[i] = 40 - i;
+  for (i = 1; i < 37; i = i + 2)
+    {
+      if (a[i] > 20)
+	a[i] = a[i - 1];
+      else
+	a[i] = 7;
+    }
+  s = 0;
+  for (i = 39; i >= 0; i--)
+    s = (s * 3 + a[i]) % 10007;
+  printf ("%d\n", s);
+  j = 0;
+  for (i = 0; i < 1; i++)
+    j = j + 11;
+  printf ("%d\n", j + i);
+  return 0;
+}
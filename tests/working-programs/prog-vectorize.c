@@ -0,0 +1,102 @@
+#ifdef GCC
+#define int long
+#define ptr_t long *
+#endif
+
+int
+kernels (int n)
+{
+  int a[n + 8];
+  int b[n + 8];
+  int c[n + 8];
+  int i;
+  int s;
+  int t;
+  for (i = 0; i < n + 8; i++)
+    {
+      a[i] = i * 7 + 3;
+      b[i] = n - i * 5;
+      c[i] = 1;
+    }
+  for (i = 0; i < n; i++)
+    c[i] = a[i] + b[i];
+  t = 0;
+  for (i = 0; i < n + 8; i++)
+    t = t * 3 + c[i];
+  for (i = 0; i < n; i++)
+    c[i] = a[i] ^ b[i];
+  for (i = 1; i <= n; i++)
+    c[i] = c[i] - a[i];
+  for (i = 0; i < n; i++)
+    c[i] = (a[i] << 3) | 1;
+  for (i = 0; i < n; i++)
+    b[i] = b[i] + n;
+  for (i = 0; i < n; i++)
+    b[i] = a[i] >> 2;
+  for (i = 0; i < n + 8; i++)
+    t = t * 5 + b[i] + c[i];
+  s = 1;
+  for (i = 0; i < n; i++)
+    s = s + a[i];
+  t = t + s;
+  s = 12345;
+  for (i = 0; i < n; i++)
+    s = c[i] ^ s;
+  t = t ^ s;
+  s = 1000000;
+  for (i = 0; i < n; i++)
+    s = a[i] < s ? a[i] : s;
+  t = t + s;
+  s = -1000000;
+  for (i = 0; i < n; i++)
+    s = s > b[i] ? s : b[i];
+  return t + s + i;
+}
+
+int
+overlap (int n, int d)
+{
+  int a[24];
+  int b[24];
+  int i;
+  int t;
+  ptr_t p = &a[d];
+  for (i = 0; i < n + 8; i++)
+    {
+      a[i] = i + 1;
+      b[i] = i * i;
+    }
+  for (i = 0; i < n; i++)
+    p[i] = a[i] + b[i];
+  t = 0;
+  for (i = 0; i < n + 8; i++)
+    t = t * 3 + a[i];
+  return t;
+}
+
+int
+main ()
+{
+  int a[40];
+  int b[40];
+  int i;
+  int s;
+  for (i = 0; i < 40; i++)
+    a[i] = i * i - 100;
+  for (i = 0; i < 37; i++)
+    b[i] = a[i] + 3;
+  for (i = 37; i < 40; i++)
+    b[i] = a[i] + 3;
+  s = 0;
+  for (i = 0; i < 40; i++)
+    s = s + b[i];
+  printf ("%ld %ld\n", s, i);
+  for (i = 0; i < 20; i++)
+    printf ("%ld\n", kernels (i));
+  for (i = 0; i < 6; i++)
+    {
+      s = overlap (9, i);
+      printf ("%ld %ld\n", s, overlap (2, i));
+    }
+  return 0;
+}
@@ -0,0 +1,93 @@
+int
+fill (int n, int rounds)
+{
+  int r;
+  int total = 0;
+  for (r = 0; r < rounds; r++)
+    {
+      int a[n];
+      int i;
+      for (i = 0; i < n; i++)
+	a[i] = i + r;
+      total = total + a[n - 1] - a[0];
+    }
+  return total;
+}
+
+int
+nested (int n)
+{
+  int r;
+  int total = 0;
+  for (r = 0; r < n; r++)
+    {
+      int a[r + 1];
+      a[r] = r;
+      if (r > 1)
+	{
+	  int b[r];
+	  b[0] = a[r] * 2;
+	  total = total + b[0];
+	}
+      total = total + a[r];
+    }
+  return total;
+}
+
+int
+fixed (int n)
+{
+  int r;
+  int total = 0;
+  for (r = 0; r < n; r++)
+    {
+      int a[4];
+      a[0] = r;
+      a[3] = r * 3;
+      total = total + a[3] - a[0];
+    }
+  return total;
+}
+
+int
+sum (int a, int b)
+{
+  return a + b;
+}
+
+int
+gotoloop (int n, int rounds)
+{
+  int t = 0;
+  int k = 0;
+ top:
+  if (k < rounds)
+    {
+      int c[n];
+      c[0] = k;
+      c[n - 1] = 1;
+      if (k > 3)
+	goto skip;
+      t = t + 1000;
+    skip:
+      t = sum (t, c[0] + c[n - 1]);
+      k++;
+      goto top;
+    }
+  return t;
+}
+
+int
+main ()
+{
+  int v;
+  v = fill (1000, 20000);
+  printf ("%d\n", v);
+  v = nested (30000);
+  printf ("%d\n", v);
+  v = fixed (100);
+  printf ("%d\n", v);
+  v = gotoloop (1000, 20000);
+  printf ("%d\n", v);
+  return 0;
+}
@@ -5,6 +5,7 @@ srcfile=$1
 prog=`mktemp`
 myout=`mktemp`
 nativeout=`mktemp`
+stats=`mktemp`
 
 run () {
     msg=$1
@@ -14,7 +15,7 @@ run () {
     else
 	code=$?
 	echo "FAILED: $msg" >&2
-	rm -f $prog $myout $nativeout
+	rm -f $prog $myout $nativeout $stats
 	exit $code
     fi
 }
@@ -25,15 +26,28 @@ run "the regular C compiler could not create an executable" [ -x $prog ] && \
     run "the regular C compiler's executable failed" $prog > $nativeout
 
 mycompile () {    
-    run "could not compile $srcfile with options: $@" \
+    run "could not compile $srcfile with options: $*" \
 	$COMPILER $@ -o $prog $srcfile
 
-    run "the program is not runable with options: $@" [ -x $prog ] && \
-	run "the program failed to run with options: $@" $prog > $myout
+    run "the program is not runable with options: $*" [ -x $prog ] && \
+	run "the program failed to run with options: $*" $prog > $myout
 
-    run "different output with options: $@" \
+    run "different output with options: $*" \
 	cmp $myout $nativeout
 }
 
 mycompile
 mycompile -O
+mycompile -O2
+mycompile -O2 -funroll-loops
+
+# A test can name the peephole rules that must apply when it is
+# compiled with -O, on a line like: /* peephole: store-load test-zero */
+rules=`sed -n 's|^/\* peephole: \(.*\) \*/$|\1|p' $srcfile`
+if [ -n "$rules" ]; then
+    $COMPILER -O -fpeephole-stats -o $prog $srcfile 2> $stats
+    for rule in $rules; do
+	run "the peephole rule $rule was not applied" \
+	    grep "^$rule  *[1-9]" $stats > /dev/null
+    done
+fi